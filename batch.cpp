@@ -0,0 +1,1077 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <semaphore>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "compress.h"
+#include "compress_cache.h"
+#include "file.h"
+#include "header.h"
+#include "io_ring.h"
+#include "json.h"
+#include "thread_pool.h"
+#include "topdec.h"
+
+namespace {
+// FIFO with a fixed capacity. Push() blocks while the queue is full, Pop() while it's empty.
+template<typename T>
+struct BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : Capacity(capacity) {}
+
+    void Push(T item) {
+        {
+            std::unique_lock lock(Mutex);
+            NotFull.wait(lock, [this]() { return Items.size() < Capacity; });
+            Items.push_back(std::move(item));
+        }
+        NotEmpty.notify_one();
+    }
+
+    std::optional<T> TryPop() {
+        std::optional<T> item;
+        {
+            std::lock_guard lock(Mutex);
+            if (Items.empty()) {
+                return item;
+            }
+            item = std::move(Items.front());
+            Items.pop_front();
+        }
+        NotFull.notify_one();
+        return item;
+    }
+
+    T Pop() {
+        T item;
+        {
+            std::unique_lock lock(Mutex);
+            NotEmpty.wait(lock, [this]() { return !Items.empty(); });
+            item = std::move(Items.front());
+            Items.pop_front();
+        }
+        NotFull.notify_one();
+        return item;
+    }
+
+private:
+    size_t Capacity;
+    std::mutex Mutex;
+    std::condition_variable NotFull;
+    std::condition_variable NotEmpty;
+    std::deque<T> Items;
+};
+
+// Buffers of a job while it travels through the pipeline.
+struct PipelineItem {
+    // The input is either in Input or, if the io_uring reader put it into one of its registered
+    // buffers, in RegisteredInput.
+    std::vector<char> Input;
+    std::span<const char> RegisteredInput;
+    int RegisteredSlot = -1;
+
+    std::vector<char> Output;
+
+    std::span<const char> GetInput() const {
+        return RegisteredSlot >= 0 ? RegisteredInput : std::span<const char>(Input);
+    }
+};
+
+// Recycles input and output buffers between files. Every file needs one of each, so without this
+// a batch allocates, faults in and frees two fresh buffers per file; with it, the buffers of
+// finished files carry their capacity over to the next ones.
+struct BufferPool {
+public:
+    explicit BufferPool(size_t maxBuffers) : MaxBuffers(maxBuffers) {}
+
+    // Returns an empty buffer, with some capacity if one was available.
+    std::vector<char> Take() {
+        std::lock_guard lock(Mutex);
+        if (Free.empty()) {
+            return std::vector<char>();
+        }
+        std::vector<char> buffer = std::move(Free.back());
+        Free.pop_back();
+        return buffer;
+    }
+
+    void Return(std::vector<char>&& buffer) {
+        std::vector<char> released = std::move(buffer);
+        if (released.capacity() == 0 || released.capacity() > max_pooled_buffer_size) {
+            return;
+        }
+        released.clear();
+        std::lock_guard lock(Mutex);
+        if (Free.size() < MaxBuffers) {
+            Free.push_back(std::move(released));
+        }
+    }
+
+private:
+    // outliers shouldn't stay around for the rest of the batch
+    static constexpr size_t max_pooled_buffer_size = 16 * 1024 * 1024;
+
+    size_t MaxBuffers;
+    std::mutex Mutex;
+    std::vector<std::vector<char>> Free;
+};
+} // namespace
+
+bool DirectoryCache::Create(const std::filesystem::path& directory) {
+    std::lock_guard lock(Mutex);
+    return CreateLocked(directory);
+}
+
+bool DirectoryCache::CreateParentOf(const std::filesystem::path& file) {
+    std::lock_guard lock(Mutex);
+    return CreateLocked(file.parent_path());
+}
+
+bool DirectoryCache::CreateLocked(const std::filesystem::path& directory) {
+    if (directory.empty() || Known.contains(directory.native())) {
+        return true;
+    }
+    const auto parent = directory.parent_path();
+    if (parent != directory && !CreateLocked(parent)) {
+        return false;
+    }
+    if (!HyoutaUtils::IO::CreateDirectory(directory)) {
+        return false;
+    }
+    Known.insert(directory.native());
+    return true;
+}
+
+static bool ReadInput(const std::filesystem::path& path, std::vector<char>& data) {
+    HyoutaUtils::IO::File infile(path, HyoutaUtils::IO::OpenMode::Read);
+    if (!infile.IsOpen()) {
+        return false;
+    }
+    const auto length = infile.GetLength();
+    if (!length) {
+        return false;
+    }
+    data.resize(*length);
+    return infile.Read(data.data(), data.size()) == data.size();
+}
+
+namespace {
+// A key that CompressCache::Fetch() missed on, which makes this thread responsible for it. The key
+// is abandoned unless Store() ran, so neither an error nor an exception on the way there can leave
+// other files with the same content waiting for it forever.
+struct CacheKeyClaim {
+public:
+    CacheKeyClaim(CompressCache& cache, std::string key) : Cache(&cache), Key(std::move(key)) {}
+    CacheKeyClaim(const CacheKeyClaim& other) = delete;
+    CacheKeyClaim(CacheKeyClaim&& other) = delete;
+    CacheKeyClaim& operator=(const CacheKeyClaim& other) = delete;
+    CacheKeyClaim& operator=(CacheKeyClaim&& other) = delete;
+    ~CacheKeyClaim() {
+        if (Cache) {
+            Cache->Abandon(Key);
+        }
+    }
+
+    void Store(std::span<const char> compressedFile) {
+        Cache->Store(Key, compressedFile);
+        Cache = nullptr;
+    }
+
+private:
+    CompressCache* Cache;
+    std::string Key;
+};
+} // namespace
+
+static void RunCodec(const BatchJob& job,
+                     PipelineItem& item,
+                     BatchFileStatus& status,
+                     CompressCache* cache,
+                     DirectoryCache& directories) {
+    std::error_code ec;
+    if (job.Op == BatchOp::Decompress) {
+        TopDec::decode_file_image(item.GetInput(), item.Output, ec);
+        if (ec == TopDec::Error::LengthMismatch) {
+            status.Warning = ec.message();
+        } else if (ec) {
+            status.Error = ec.message();
+            return;
+        }
+        status.OutputBytes = item.Output.size();
+        status.Success = true;
+        return;
+    }
+
+    std::optional<CacheKeyClaim> claim;
+    if (cache) {
+        if (!directories.CreateParentOf(job.Output)) {
+            status.Error = "failed to create output directory";
+            return;
+        }
+        std::string cacheKey = CompressCache::MakeKey(item.GetInput(), job.Type, job.Level);
+        if (cache->Fetch(cacheKey, job.Output)) {
+            std::error_code sizeEc;
+            status.OutputBytes = std::filesystem::file_size(job.Output, sizeEc);
+            status.CacheHit = true;
+            status.Success = true;
+            return;
+        }
+        claim.emplace(*cache, std::move(cacheKey));
+    }
+
+    TopDec::encode_file_image(job.Type, item.GetInput(), item.Output, job.Level, ec);
+    if (!ec && item.Output.size() - compressed_header_size >= 0x10000) {
+        status.Error = "output too large";
+    } else if (ec) {
+        status.Error = ec.message();
+    }
+    if (!status.Error.empty()) {
+        return;
+    }
+    if (claim) {
+        claim->Store(item.Output);
+    }
+    status.OutputBytes = item.Output.size();
+    status.Success = true;
+}
+
+// Deletes a partially written output. Outputs can be device files, so leave anything that isn't
+// a regular file alone.
+static void RemoveFailedOutput(const std::filesystem::path& path) {
+    std::error_code ec;
+    if (std::filesystem::is_regular_file(std::filesystem::symlink_status(path, ec))) {
+        std::filesystem::remove(path, ec);
+    }
+}
+
+static void WriteOutput(const BatchJob& job,
+                        const PipelineItem& item,
+                        BatchFileStatus& status,
+                        DirectoryCache& directories) {
+    if (!directories.CreateParentOf(job.Output)) {
+        status.Success = false;
+        status.Error = "failed to create output directory";
+        return;
+    }
+    HyoutaUtils::IO::File outfile(job.Output, HyoutaUtils::IO::OpenMode::Write);
+    if (!outfile.IsOpen()) {
+        status.Success = false;
+        status.Error = "failed to open output file";
+        return;
+    }
+    // a failed close fails the file just like a failed write, see the io_uring writer below
+    const bool written =
+        outfile.Write(item.Output.data(), item.Output.size()) == item.Output.size();
+    if (!outfile.Close() || !written) {
+        RemoveFailedOutput(job.Output);
+        status.Success = false;
+        status.Error = "failed to write output file";
+    }
+}
+
+// Inputs up to this size are read into buffers registered with io_uring. Compressed files are below
+// 64 KiB anyway, and uncompressed ones are usually not much larger.
+constexpr size_t uring_registered_buffer_size = 0x20000;
+
+namespace {
+// Fixed-size input buffers registered with the reader's io_uring. Each file that fits is read
+// straight into one of them, and the buffer stays with the file until its codec job is done.
+struct RegisteredBuffers {
+public:
+    bool Init(IoRing& ring, size_t count) {
+        try {
+            Arena.resize(count * uring_registered_buffer_size);
+            Buffers.reserve(count);
+            Free.reserve(count);
+            for (size_t i = 0; i < count; ++i) {
+                Buffers.emplace_back(Arena.data() + i * uring_registered_buffer_size,
+                                     uring_registered_buffer_size);
+                Free.push_back(static_cast<uint16_t>(i));
+            }
+        } catch (const std::bad_alloc&) {
+            return false;
+        }
+        return ring.RegisterBuffers(Buffers);
+    }
+
+    // Only called while holding a codec slot, and there is one buffer per slot, so this never
+    // runs out.
+    uint16_t Take() {
+        std::lock_guard lock(Mutex);
+        const uint16_t index = Free.back();
+        Free.pop_back();
+        return index;
+    }
+
+    void Return(uint16_t index) {
+        std::lock_guard lock(Mutex);
+        Free.push_back(index);
+    }
+
+    std::span<char> Get(uint16_t index) const {
+        return Buffers[index];
+    }
+
+private:
+    std::vector<char> Arena;
+    std::vector<std::span<char>> Buffers;
+    std::mutex Mutex;
+    std::vector<uint16_t> Free;
+};
+
+// A file that one of the io_uring stages is working on. It goes through open, one or more reads or
+// writes, and close, with at most one of these in flight at a time.
+struct RingFile {
+    size_t Index = 0;
+    int Fd = -1;
+    uint64_t Done = 0;
+    bool Closing = false;
+};
+
+// Completions of closes that nobody waits for carry this bit in their tag.
+constexpr uint64_t ring_ignore_tag = uint64_t(1) << 63;
+
+// Reads and writes in io_uring are limited to 32-bit lengths; stay well below that.
+constexpr uint64_t ring_max_transfer = uint64_t(1) << 30;
+
+struct Pipeline {
+public:
+    Pipeline(const std::vector<BatchJob>& jobs,
+             const BatchOptions& options,
+             std::vector<BatchFileStatus>& results,
+             DirectoryCache& directories,
+             size_t threadCount,
+             size_t queueDepth)
+      : Jobs(jobs)
+      , Options(options)
+      , Results(results)
+      , Items(jobs.size())
+      , Directories(directories)
+      , SlotCount(queueDepth + threadCount)
+      , CodecSlots(static_cast<ptrdiff_t>(SlotCount))
+      , WriteQueue(queueDepth)
+      , Buffers(2 * (SlotCount + queueDepth))
+      , Pool(threadCount) {}
+
+    void Run(const std::vector<size_t>& order, const std::vector<uint64_t>& sizes);
+
+private:
+    void StartCodec(size_t index);
+    void FinishRead(size_t index);
+    void FailRead(size_t index);
+    void FinishWrite(size_t index);
+
+    void ReadSync(const std::vector<size_t>& order, size_t start);
+    void ReadRing(const std::vector<size_t>& order, const std::vector<uint64_t>& sizes);
+    void WriteSync(size_t remaining);
+    void WriteRing();
+
+    const std::vector<BatchJob>& Jobs;
+    const BatchOptions& Options;
+    std::vector<BatchFileStatus>& Results;
+    std::vector<PipelineItem> Items;
+    DirectoryCache& Directories;
+
+    // the slots cover files being read and files waiting for or inside the codec stage, the write
+    // queue bounds the ones behind it
+    size_t SlotCount;
+    std::counting_semaphore<> CodecSlots;
+    BoundedQueue<size_t> WriteQueue;
+
+    // at most two buffers for each file in the pipeline
+    BufferPool Buffers;
+
+    IoRing ReadRingInstance;
+    IoRing WriteRingInstance;
+    RegisteredBuffers Registered;
+    bool HasRegisteredBuffers = false;
+    size_t RingFiles = 0;
+
+    // declared last so that it's destroyed first, its jobs reference everything above
+    ThreadPool Pool;
+};
+} // namespace
+
+void Pipeline::StartCodec(size_t index) {
+    Pool.Submit([this, index]() {
+        PipelineItem& item = Items[index];
+        item.Output = Buffers.Take();
+        try {
+            RunCodec(Jobs[index], item, Results[index], Options.Cache, Directories);
+        } catch (const std::bad_alloc&) {
+            Results[index].Success = false;
+            Results[index].Error = "out of memory";
+        }
+        Buffers.Return(std::move(item.Input));
+        if (item.RegisteredSlot >= 0) {
+            Registered.Return(static_cast<uint16_t>(item.RegisteredSlot));
+            item.RegisteredSlot = -1;
+            item.RegisteredInput = std::span<const char>();
+        }
+        WriteQueue.Push(index);
+        CodecSlots.release();
+    });
+}
+
+void Pipeline::FinishRead(size_t index) {
+    Results[index].InputBytes = Items[index].GetInput().size();
+    StartCodec(index);
+}
+
+void Pipeline::FailRead(size_t index) {
+    PipelineItem& item = Items[index];
+    if (item.RegisteredSlot >= 0) {
+        Registered.Return(static_cast<uint16_t>(item.RegisteredSlot));
+    }
+    Buffers.Return(std::move(item.Input));
+    item = PipelineItem();
+    Results[index].Error = "failed to read input file";
+    WriteQueue.Push(index);
+    CodecSlots.release();
+}
+
+void Pipeline::FinishWrite(size_t index) {
+    Buffers.Return(std::move(Items[index].Output));
+    Items[index] = PipelineItem();
+}
+
+void Pipeline::ReadSync(const std::vector<size_t>& order, size_t start) {
+    for (size_t i = start; i < order.size(); ++i) {
+        const size_t index = order[i];
+        CodecSlots.acquire();
+        Items[index].Input = Buffers.Take();
+        bool readSuccess;
+        try {
+            readSuccess = ReadInput(Jobs[index].Input, Items[index].Input);
+        } catch (const std::bad_alloc&) {
+            readSuccess = false;
+        }
+        if (readSuccess) {
+            FinishRead(index);
+        } else {
+            FailRead(index);
+        }
+    }
+}
+
+void Pipeline::WriteSync(size_t remaining) {
+    for (size_t done = 0; done < remaining; ++done) {
+        const size_t index = WriteQueue.Pop();
+        BatchFileStatus& status = Results[index];
+        if (status.Success && !status.CacheHit) {
+            WriteOutput(Jobs[index], Items[index], status, Directories);
+        }
+        FinishWrite(index);
+    }
+}
+
+// Inputs are read with the size they had when the batch was sorted; unlike the synchronous path,
+// this doesn't look at the file size again after opening.
+void Pipeline::ReadRing(const std::vector<size_t>& order, const std::vector<uint64_t>& sizes) {
+    IoRing& ring = ReadRingInstance;
+    std::vector<RingFile> files(RingFiles);
+    std::vector<uint32_t> freeFiles;
+    for (size_t i = RingFiles; i > 0; --i) {
+        freeFiles.push_back(static_cast<uint32_t>(i - 1));
+    }
+
+    const auto readNext = [&](uint32_t id) -> bool {
+        RingFile& file = files[id];
+        PipelineItem& item = Items[file.Index];
+        const uint64_t length = std::min(sizes[file.Index] - file.Done, ring_max_transfer);
+        if (item.RegisteredSlot >= 0) {
+            const uint16_t slot = static_cast<uint16_t>(item.RegisteredSlot);
+            char* buffer = Registered.Get(slot).data() + file.Done;
+            return ring.PrepareReadFixed(
+                file.Fd, buffer, static_cast<uint32_t>(length), file.Done, slot, id);
+        }
+        return ring.PrepareRead(
+            file.Fd, item.Input.data() + file.Done, static_cast<uint32_t>(length), file.Done, id);
+    };
+    const auto closeFile = [&](uint32_t id) {
+        ring.PrepareClose(files[id].Fd, ring_ignore_tag | id);
+        files[id].Fd = -1;
+    };
+
+    size_t next = 0;
+    uint32_t inFlight = 0;
+    while (next < order.size() || inFlight > 0) {
+        while (next < order.size() && !freeFiles.empty()) {
+            if (inFlight == 0) {
+                CodecSlots.acquire();
+            } else if (!CodecSlots.try_acquire()) {
+                break;
+            }
+            const size_t index = order[next++];
+            PipelineItem& item = Items[index];
+            if (HasRegisteredBuffers && sizes[index] <= uring_registered_buffer_size) {
+                const uint16_t slot = Registered.Take();
+                item.RegisteredSlot = slot;
+                item.RegisteredInput = Registered.Get(slot).first(sizes[index]);
+            } else {
+                item.Input = Buffers.Take();
+                try {
+                    item.Input.resize(sizes[index]);
+                } catch (const std::bad_alloc&) {
+                    FailRead(index);
+                    continue;
+                }
+            }
+            const uint32_t id = freeFiles.back();
+            freeFiles.pop_back();
+            files[id] = RingFile{index};
+            ring.PrepareOpen(Jobs[index].Input.c_str(), false, id);
+            ++inFlight;
+        }
+        if (inFlight == 0) {
+            continue;
+        }
+
+        const int submitted = ring.Submit(1);
+        if (submitted < 0 && submitted != -EAGAIN && submitted != -EBUSY) {
+            // The kernel may still be working on the requests we can't account for anymore, so
+            // their buffers can't be reused. This only happens on bugs, so don't try to recover.
+            printf("io_uring_enter failed: %s\n", strerror(-submitted));
+            std::abort();
+        }
+
+        uint64_t tag;
+        int32_t result;
+        while (ring.PopCompletion(tag, result)) {
+            --inFlight;
+            if ((tag & ring_ignore_tag) != 0) {
+                continue;
+            }
+            const uint32_t id = static_cast<uint32_t>(tag);
+            RingFile& file = files[id];
+            PipelineItem& item = Items[file.Index];
+            bool finished = false;
+            bool failed = result < 0;
+            if (!failed && file.Fd == -1) {
+                file.Fd = result;
+                finished = sizes[file.Index] == 0;
+            } else if (!failed && result == 0) {
+                // the file got shorter since it was sized
+                if (item.RegisteredSlot >= 0) {
+                    item.RegisteredInput = item.RegisteredInput.first(file.Done);
+                } else {
+                    item.Input.resize(file.Done);
+                }
+                finished = true;
+            } else if (!failed) {
+                file.Done += static_cast<uint64_t>(result);
+                finished = file.Done == sizes[file.Index];
+            }
+
+            if (!failed && !finished) {
+                readNext(id);
+                ++inFlight;
+                continue;
+            }
+            if (file.Fd != -1) {
+                closeFile(id);
+                ++inFlight;
+            }
+            if (failed) {
+                FailRead(file.Index);
+            } else {
+                FinishRead(file.Index);
+            }
+            freeFiles.push_back(id);
+        }
+    }
+}
+
+void Pipeline::WriteRing() {
+    IoRing& ring = WriteRingInstance;
+    std::vector<RingFile> files(RingFiles);
+    std::vector<uint32_t> freeFiles;
+    for (size_t i = RingFiles; i > 0; --i) {
+        freeFiles.push_back(static_cast<uint32_t>(i - 1));
+    }
+
+    const auto writeNext = [&](uint32_t id) {
+        RingFile& file = files[id];
+        const std::vector<char>& output = Items[file.Index].Output;
+        const uint64_t length = std::min(output.size() - file.Done, ring_max_transfer);
+        ring.PrepareWrite(
+            file.Fd, output.data() + file.Done, static_cast<uint32_t>(length), file.Done, id);
+    };
+
+    size_t done = 0;
+    uint32_t inFlight = 0;
+    while (done < Jobs.size() || inFlight > 0) {
+        while (done < Jobs.size() && !freeFiles.empty()) {
+            std::optional<size_t> next;
+            if (freeFiles.size() == RingFiles) {
+                next = WriteQueue.Pop();
+            } else {
+                next = WriteQueue.TryPop();
+            }
+            if (!next) {
+                break;
+            }
+            const size_t index = *next;
+            BatchFileStatus& status = Results[index];
+            if (!status.Success || status.CacheHit) {
+                FinishWrite(index);
+                ++done;
+                continue;
+            }
+            if (!Directories.CreateParentOf(Jobs[index].Output)) {
+                status.Success = false;
+                status.Error = "failed to create output directory";
+                FinishWrite(index);
+                ++done;
+                continue;
+            }
+            const uint32_t id = freeFiles.back();
+            freeFiles.pop_back();
+            files[id] = RingFile{index};
+            ring.PrepareOpen(Jobs[index].Output.c_str(), true, id);
+            ++inFlight;
+        }
+        if (inFlight == 0) {
+            continue;
+        }
+
+        const int submitted = ring.Submit(1);
+        if (submitted < 0 && submitted != -EAGAIN && submitted != -EBUSY) {
+            printf("io_uring_enter failed: %s\n", strerror(-submitted));
+            std::abort();
+        }
+
+        uint64_t tag;
+        int32_t result;
+        while (ring.PopCompletion(tag, result)) {
+            --inFlight;
+            if ((tag & ring_ignore_tag) != 0) {
+                continue;
+            }
+            const uint32_t id = static_cast<uint32_t>(tag);
+            RingFile& file = files[id];
+            BatchFileStatus& status = Results[file.Index];
+            const size_t outputSize = Items[file.Index].Output.size();
+            if (file.Closing) {
+                // close can report errors of earlier delayed writes, e.g. on network filesystems
+                if (result < 0) {
+                    RemoveFailedOutput(Jobs[file.Index].Output);
+                    status.Success = false;
+                    status.Error = "failed to write output file";
+                }
+                FinishWrite(file.Index);
+                freeFiles.push_back(id);
+                ++done;
+                continue;
+            }
+            if (file.Fd == -1) {
+                if (result < 0) {
+                    status.Success = false;
+                    status.Error = "failed to open output file";
+                    FinishWrite(file.Index);
+                    freeFiles.push_back(id);
+                    ++done;
+                    continue;
+                }
+                file.Fd = result;
+            } else if (result <= 0) {
+                ring.PrepareClose(file.Fd, ring_ignore_tag | id);
+                ++inFlight;
+                RemoveFailedOutput(Jobs[file.Index].Output);
+                status.Success = false;
+                status.Error = "failed to write output file";
+                FinishWrite(file.Index);
+                freeFiles.push_back(id);
+                ++done;
+                continue;
+            } else {
+                file.Done += static_cast<uint64_t>(result);
+            }
+
+            if (file.Done < outputSize) {
+                writeNext(id);
+            } else {
+                file.Closing = true;
+                ring.PrepareClose(file.Fd, id);
+            }
+            ++inFlight;
+        }
+    }
+}
+
+void Pipeline::Run(const std::vector<size_t>& order, const std::vector<uint64_t>& sizes) {
+    // every file in a ring stage has at most one request plus a close in flight
+    RingFiles = std::min(SlotCount, size_t(128));
+    bool useRing = false;
+    if (Options.Io != BatchIo::Sync) {
+        const uint32_t entries = static_cast<uint32_t>(RingFiles * 2);
+        useRing = ReadRingInstance.Open(entries) && WriteRingInstance.Open(entries);
+    }
+    if (useRing) {
+        // there's one registered buffer per codec slot, so a reader holding a slot always finds
+        // a free buffer
+        HasRegisteredBuffers = SlotCount <= 1024 && Registered.Init(ReadRingInstance, SlotCount);
+    }
+
+    std::thread writer([&]() {
+        if (useRing) {
+            WriteRing();
+        } else {
+            WriteSync(Jobs.size());
+        }
+    });
+    if (useRing) {
+        ReadRing(order, sizes);
+    } else {
+        ReadSync(order, 0);
+    }
+    writer.join();
+}
+
+bool parse_batch_io(std::string_view name, BatchIo& io) {
+    if (name == "auto") {
+        io = BatchIo::Auto;
+    } else if (name == "sync") {
+        io = BatchIo::Sync;
+    } else if (name == "uring") {
+        io = BatchIo::Uring;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool batch_io_uring_available() {
+    IoRing ring;
+    return ring.Open(2);
+}
+
+std::vector<BatchFileStatus> run_batch(const std::vector<BatchJob>& jobs,
+                                       const BatchOptions& options) {
+    std::vector<BatchFileStatus> results(jobs.size());
+    if (jobs.empty()) {
+        return results;
+    }
+
+    // largest first: the codec time is roughly proportional to the input size, and starting the
+    // long jobs early keeps them from becoming the tail end of the batch
+    std::vector<uint64_t> sizes(jobs.size());
+    std::vector<size_t> order(jobs.size());
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(jobs[i].Input, ec);
+        sizes[i] = ec ? 0 : static_cast<uint64_t>(size);
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+        return sizes[lhs] > sizes[rhs];
+    });
+
+    const size_t threadCount =
+        options.Threads != 0
+            ? options.Threads
+            : std::max(size_t(1), size_t(std::thread::hardware_concurrency()));
+    const size_t queueDepth = options.QueueDepth != 0 ? options.QueueDepth : threadCount * 2;
+
+    DirectoryCache localDirectories;
+    DirectoryCache& directories = options.Directories ? *options.Directories : localDirectories;
+    Pipeline pipeline(jobs, options, results, directories, threadCount, queueDepth);
+    pipeline.Run(order, sizes);
+    return results;
+}
+
+static void PrintBatchUsage() {
+    printf(
+        "Usage for batch mode:\n"
+        "  topdec batch [options] (path to manifest)\n"
+        "  Every manifest line has the form '(operation) (input path) (output path)', where the\n"
+        "  operation is 'd' to decompress or 'c01', 'c03', 'c81', 'c83' or 'c' (same as 'c83') to\n"
+        "  compress. Separate the fields with tabs if the paths contain spaces. Empty lines and\n"
+        "  lines starting with '#' are ignored.\n"
+        "  Options are:\n"
+        "    --threads N (codec threads, defaults to the number of hardware threads)\n"
+        "    --queue N (files buffered between the pipeline stages, defaults to 2 per thread)\n"
+        "    --level 1-9 (compression level, defaults to 9)\n"
+        "    --io auto/sync/uring (file access method, auto uses io_uring where available)\n"
+        "    --cache-dir (path) (reuse earlier compression results from this directory)\n"
+        "    --cache-size MB (size limit of the cache directory, defaults to 1024)\n"
+        "    --quiet (only print the status of files that failed)\n"
+        "    --json (path) (write the status of every file as JSON to the given file)\n");
+}
+
+static std::vector<std::string_view> SplitManifestLine(std::string_view line) {
+    std::vector<std::string_view> fields;
+    const bool tabs = line.find('\t') != std::string_view::npos;
+    size_t pos = 0;
+    while (pos < line.size()) {
+        if (!tabs) {
+            while (pos < line.size() && line[pos] == ' ') {
+                ++pos;
+            }
+            if (pos == line.size()) {
+                break;
+            }
+        }
+        size_t end = line.find(tabs ? '\t' : ' ', pos);
+        if (end == std::string_view::npos) {
+            end = line.size();
+        }
+        fields.push_back(line.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    return fields;
+}
+
+static bool ParseManifest(std::string_view manifest, int level, std::vector<BatchJob>& jobs) {
+    size_t lineNumber = 0;
+    while (!manifest.empty()) {
+        ++lineNumber;
+        size_t end = manifest.find('\n');
+        std::string_view line = manifest.substr(0, end);
+        manifest = end == std::string_view::npos ? std::string_view() : manifest.substr(end + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty() || line.front() == '#') {
+            continue;
+        }
+
+        const auto fields = SplitManifestLine(line);
+        if (fields.empty()) {
+            continue;
+        }
+        BatchJob& job = jobs.emplace_back();
+        job.Level = level;
+        const std::string_view op = fields[0];
+        if (op == "d") {
+            job.Op = BatchOp::Decompress;
+        } else if (op == "c" || op == "c83") {
+            job.Op = BatchOp::Compress;
+            job.Type = 0x83;
+        } else if (op == "c81") {
+            job.Op = BatchOp::Compress;
+            job.Type = 0x81;
+        } else if (op == "c03") {
+            job.Op = BatchOp::Compress;
+            job.Type = 0x03;
+        } else if (op == "c01") {
+            job.Op = BatchOp::Compress;
+            job.Type = 0x01;
+        } else {
+            printf("manifest line %zu: unknown operation\n", lineNumber);
+            return false;
+        }
+        if (fields.size() != 3) {
+            printf("manifest line %zu: expected an operation, an input and an output\n",
+                   lineNumber);
+            return false;
+        }
+        job.Input = std::filesystem::path(fields[1]);
+        job.Output = std::filesystem::path(fields[2]);
+    }
+    return true;
+}
+
+size_t print_batch_status(const std::vector<BatchJob>& jobs,
+                          const std::vector<BatchFileStatus>& results,
+                          double seconds,
+                          bool quiet) {
+    size_t failed = 0;
+    size_t cacheHits = 0;
+    uint64_t inputBytes = 0;
+    uint64_t outputBytes = 0;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const BatchFileStatus& status = results[i];
+        inputBytes += status.InputBytes;
+        outputBytes += status.OutputBytes;
+        if (!status.Success) {
+            ++failed;
+            printf("FAILED  %s: %s\n", jobs[i].Input.string().c_str(), status.Error.c_str());
+            continue;
+        }
+        if (status.CacheHit) {
+            ++cacheHits;
+        }
+        if (!status.Warning.empty()) {
+            printf("WARNING %s: %s\n", jobs[i].Input.string().c_str(), status.Warning.c_str());
+        } else if (!quiet) {
+            printf("%s %s -> %s\n",
+                   status.CacheHit ? "cached " : "ok     ",
+                   jobs[i].Input.string().c_str(),
+                   jobs[i].Output.string().c_str());
+        }
+    }
+    printf("%zu files, %zu failed, %zu from cache, %llu bytes in, %llu bytes out, %.3f s\n",
+           jobs.size(),
+           failed,
+           cacheHits,
+           static_cast<unsigned long long>(inputBytes),
+           static_cast<unsigned long long>(outputBytes),
+           seconds);
+    return failed;
+}
+
+static void WriteStatusJson(HyoutaUtils::Json::Writer& json,
+                            const std::vector<BatchJob>& jobs,
+                            const std::vector<BatchFileStatus>& results) {
+    json.BeginArray();
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const BatchFileStatus& status = results[i];
+        json.BeginObject();
+        json.Key("input");
+        json.String(jobs[i].Input.string());
+        json.Key("output");
+        json.String(jobs[i].Output.string());
+        json.Key("success");
+        json.Bool(status.Success);
+        json.Key("cacheHit");
+        json.Bool(status.CacheHit);
+        json.Key("inputBytes");
+        json.UInt(status.InputBytes);
+        json.Key("outputBytes");
+        json.UInt(status.OutputBytes);
+        if (!status.Error.empty()) {
+            json.Key("error");
+            json.String(status.Error);
+        }
+        if (!status.Warning.empty()) {
+            json.Key("warning");
+            json.String(status.Warning);
+        }
+        json.EndObject();
+    }
+    json.EndArray();
+}
+
+int BatchMain(int argc, char** argv) {
+    BatchOptions options;
+    int level = compress_default_level;
+    const char* cacheDir = nullptr;
+    uint64_t cacheMegabytes = 1024;
+    bool quiet = false;
+    const char* jsonPath = nullptr;
+    int idx = 2;
+    while (idx < argc) {
+        const bool hasValue = (idx + 1) < argc;
+        if (strcmp("--threads", argv[idx]) == 0 && hasValue) {
+            options.Threads = static_cast<size_t>(strtoull(argv[idx + 1], nullptr, 10));
+            idx += 2;
+            continue;
+        }
+        if (strcmp("--queue", argv[idx]) == 0 && hasValue) {
+            options.QueueDepth = static_cast<size_t>(strtoull(argv[idx + 1], nullptr, 10));
+            idx += 2;
+            continue;
+        }
+        if (strcmp("--level", argv[idx]) == 0 && hasValue) {
+            level = atoi(argv[idx + 1]);
+            if (level < compress_min_level || level > compress_max_level) {
+                printf("Invalid compression level.\n");
+                return -1;
+            }
+            idx += 2;
+            continue;
+        }
+        if (strcmp("--cache-dir", argv[idx]) == 0 && hasValue) {
+            cacheDir = argv[idx + 1];
+            idx += 2;
+            continue;
+        }
+        if (strcmp("--cache-size", argv[idx]) == 0 && hasValue) {
+            cacheMegabytes = strtoull(argv[idx + 1], nullptr, 10);
+            idx += 2;
+            continue;
+        }
+        if (strcmp("--io", argv[idx]) == 0 && hasValue) {
+            if (!parse_batch_io(argv[idx + 1], options.Io)) {
+                printf("Invalid I/O method.\n");
+                return -1;
+            }
+            idx += 2;
+            continue;
+        }
+        if (strcmp("--json", argv[idx]) == 0 && hasValue) {
+            jsonPath = argv[idx + 1];
+            idx += 2;
+            continue;
+        }
+        if (strcmp("--quiet", argv[idx]) == 0) {
+            quiet = true;
+            ++idx;
+            continue;
+        }
+
+        break;
+    }
+    if (argc - idx != 1) {
+        PrintBatchUsage();
+        return -1;
+    }
+
+    if (options.Io == BatchIo::Uring && !batch_io_uring_available()) {
+        printf("io_uring is not available\n");
+        return -1;
+    }
+
+    std::vector<char> manifest;
+    if (!ReadInput(std::filesystem::path(argv[idx]), manifest)) {
+        printf("failed to read manifest\n");
+        return -1;
+    }
+    std::vector<BatchJob> jobs;
+    if (!ParseManifest(std::string_view(manifest.data(), manifest.size()), level, jobs)) {
+        return -1;
+    }
+
+    std::optional<CompressCache> cache;
+    if (cacheDir != nullptr) {
+        cache.emplace(std::filesystem::path(cacheDir), cacheMegabytes * 1024 * 1024);
+        if (!cache->Open()) {
+            printf("failed to open cache directory\n");
+            return -1;
+        }
+        options.Cache = &*cache;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto results = run_batch(jobs, options);
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (cache) {
+        cache->Trim();
+    }
+
+    const size_t failed = print_batch_status(jobs, results, seconds, quiet);
+
+    if (jsonPath != nullptr) {
+        HyoutaUtils::Json::Writer json;
+        WriteStatusJson(json, jobs, results);
+        const std::string& text = json.GetString();
+        HyoutaUtils::IO::File outfile(std::filesystem::path(jsonPath),
+                                      HyoutaUtils::IO::OpenMode::Write);
+        if (!outfile.IsOpen() || outfile.Write(text.data(), text.size()) != text.size()) {
+            printf("failed to write status\n");
+            return -1;
+        }
+    }
+
+    return failed == 0 ? 0 : -1;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "compress.h"
+
+struct CompressCache;
+
+enum class BatchOp : uint8_t {
+    Decompress,
+    Compress,
+};
+
+struct BatchJob {
+    BatchOp Op = BatchOp::Decompress;
+
+    // compression type and level, only used for BatchOp::Compress
+    uint8_t Type = 0x83;
+    int Level = compress_default_level;
+
+    std::filesystem::path Input;
+    std::filesystem::path Output;
+};
+
+struct BatchFileStatus {
+    bool Success = false;
+    bool CacheHit = false;
+    uint64_t InputBytes = 0;
+    uint64_t OutputBytes = 0;
+
+    // set if Success is false
+    std::string Error;
+
+    // set for results that were written but look suspicious, such as a decompressed length that
+    // doesn't match the header
+    std::string Warning;
+};
+
+// Output directories that are known to exist. Batches tend to write many files into the same few
+// directories, so this saves checking the whole chain of parent directories for every file.
+struct DirectoryCache {
+public:
+    // Creates the directory and any missing parents, unless they are already known to exist.
+    bool Create(const std::filesystem::path& directory);
+    bool CreateParentOf(const std::filesystem::path& file);
+
+private:
+    bool CreateLocked(const std::filesystem::path& directory);
+
+    std::mutex Mutex;
+    std::unordered_set<std::filesystem::path::string_type> Known;
+};
+
+enum class BatchIo : uint8_t {
+    // io_uring if the system supports it, synchronous file I/O otherwise
+    Auto,
+    Sync,
+    Uring,
+};
+
+struct BatchOptions {
+    // codec threads; 0 uses the number of hardware threads
+    size_t Threads = 0;
+
+    // Capacity of the queues between the reader, codec and writer stages, in files. This bounds
+    // how many files are held in memory at once. 0 picks two per codec thread.
+    size_t QueueDepth = 0;
+
+    // If set, compression jobs look up and store their results here.
+    CompressCache* Cache = nullptr;
+
+    // How the reader and writer stages access files. With io_uring, each stage keeps many files in
+    // flight at once, and small inputs are read into registered buffers. BatchIo::Uring falls back
+    // to synchronous I/O as well if io_uring turns out to be unavailable; use
+    // batch_io_uring_available() to check beforehand.
+    BatchIo Io = BatchIo::Auto;
+
+    // Directories to create outputs in. If not set, the batch uses its own.
+    DirectoryCache* Directories = nullptr;
+};
+
+// Runs all jobs and returns their status, in the same order as the jobs.
+//
+// The jobs are processed by a three stage pipeline: a reader thread loads input files, a
+// work-stealing thread pool runs the codec, and a writer thread stores the results. The stages are
+// connected by bounded queues, so reading and writing overlap with compression and decompression
+// without ever buffering the whole batch. Jobs are started largest input first, so a few big files
+// don't end up running alone at the end of the batch.
+std::vector<BatchFileStatus> run_batch(const std::vector<BatchJob>& jobs,
+                                       const BatchOptions& options);
+
+// Parses the names used by the --io option: auto, sync or uring.
+bool parse_batch_io(std::string_view name, BatchIo& io);
+bool batch_io_uring_available();
+
+// Prints a line for every failed file and, unless 'quiet' is set, for every other file too,
+// followed by a summary. Returns the number of failed files.
+size_t print_batch_status(const std::vector<BatchJob>& jobs,
+                          const std::vector<BatchFileStatus>& results,
+                          double seconds,
+                          bool quiet);
+
+int BatchMain(int argc, char** argv);
@@ -0,0 +1,529 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "compress.h"
+#include "decompress.h"
+#include "json.h"
+
+#ifdef _MSC_VER
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <sched.h>
+#endif
+
+namespace {
+struct BenchInput {
+    const char* Name;
+    std::vector<char> Data;
+};
+
+struct BenchOptions {
+    size_t InputSize = 0x8000;
+    size_t Warmup = 3;
+    size_t Repetitions = 15;
+    int Cpu = -1;
+    bool Json = false;
+    bool LevelSweep = true;
+};
+
+struct BenchResult {
+    std::string Kernel;
+    std::string Input;
+    size_t UncompressedBytes;
+    size_t CompressedBytes;
+    uint64_t MinNs;
+    uint64_t MedianNs;
+};
+
+struct LevelResult {
+    std::string Kernel;
+    int Level;
+    size_t UncompressedBytes;
+    size_t CompressedBytes;
+    uint64_t Ns;
+    bool Pareto;
+};
+
+using CompressFunc = size_t (*)(const char*, size_t, char*, int);
+using DecompressFunc = int64_t (*)(const char*, size_t, char*, size_t);
+
+struct Kernel {
+    const char* Name;
+    uint8_t Type;
+    CompressFunc Compress;
+    DecompressFunc Decompress;
+};
+
+constexpr std::array<Kernel, 4> Kernels = {{
+    {"01", 0x01, compress_01, decompress_01},
+    {"03", 0x03, compress_03, decompress_03},
+    {"81", 0x81, compress_81, decompress_81},
+    {"83", 0x83, compress_83, decompress_83},
+}};
+
+// The interleaved decoder is compared on this many streams per input, each compressed from an
+// equal share of it.
+constexpr size_t InterleavedChunkCount = 8;
+} // namespace
+
+static std::vector<char> GenerateText(size_t size, std::mt19937& rng) {
+    static constexpr std::array<const char*, 32> words = {
+        "the",   "sword", "of",    "light", "and",   "a",      "journey", "to",
+        "you",   "must",  "find",  "where", "is",    "village", "it",     "was",
+        "hero",  "dark",  "we",    "can't", "never", "forest", "magic",  "ancient",
+        "there", "this",  "will",  "with",  "friend", "I",     "what",   "time"};
+    std::vector<char> data;
+    data.reserve(size);
+    size_t wordsInLine = 0;
+    while (data.size() < size) {
+        const std::string_view word = words[rng() % words.size()];
+        data.insert(data.end(), word.begin(), word.end());
+        ++wordsInLine;
+        const uint32_t r = rng() % 16;
+        if (r == 0) {
+            data.push_back('.');
+        } else if (r == 1) {
+            data.push_back(',');
+        }
+        if (wordsInLine > 8 && (rng() % 4) == 0) {
+            data.push_back('\n');
+            wordsInLine = 0;
+        } else {
+            data.push_back(' ');
+        }
+    }
+    data.resize(size);
+    return data;
+}
+
+static std::vector<char> GenerateTable(size_t size, std::mt19937& rng) {
+    // an array of 32 byte records with ids, small enums, flags and a few distinct float values,
+    // similar to typical game data tables
+    static constexpr std::array<float, 6> floats = {0.0f, 1.0f, 0.5f, 1.5f, 100.0f, 0.25f};
+    std::vector<char> data;
+    data.reserve(size + 32);
+    uint32_t id = 1000;
+    while (data.size() < size) {
+        std::array<char, 32> record{};
+        const uint32_t type = rng() % 5;
+        const uint16_t flags = static_cast<uint16_t>(1u << (rng() % 4));
+        const float f1 = floats[rng() % floats.size()];
+        const float f2 = floats[rng() % floats.size()];
+        const uint32_t value = (rng() % 8) * 50;
+        std::memcpy(record.data() + 0, &id, 4);
+        std::memcpy(record.data() + 4, &type, 4);
+        std::memcpy(record.data() + 8, &flags, 2);
+        std::memcpy(record.data() + 12, &f1, 4);
+        std::memcpy(record.data() + 16, &f2, 4);
+        std::memcpy(record.data() + 20, &value, 4);
+        data.insert(data.end(), record.begin(), record.end());
+        ++id;
+    }
+    data.resize(size);
+    return data;
+}
+
+static std::vector<char> GenerateRepetitive(size_t size, std::mt19937& rng) {
+    std::vector<char> data;
+    data.reserve(size + 300);
+    while (data.size() < size) {
+        if ((rng() % 2) == 0) {
+            data.insert(data.end(), 4 + rng() % 250, static_cast<char>(rng() % 4));
+        } else {
+            const std::array<char, 4> pattern = {'\x12', '\x34', '\x56', '\x78'};
+            const size_t repeats = 2 + rng() % 20;
+            for (size_t i = 0; i < repeats; ++i) {
+                data.insert(data.end(), pattern.begin(), pattern.end());
+            }
+        }
+    }
+    data.resize(size);
+    return data;
+}
+
+static std::vector<char> GenerateRandom(size_t size, std::mt19937& rng) {
+    std::vector<char> data(size);
+    for (char& c : data) {
+        c = static_cast<char>(rng() & 0xff);
+    }
+    return data;
+}
+
+static std::vector<BenchInput> GenerateInputs(size_t size) {
+    std::mt19937 rng(0x70bdec);
+    std::vector<BenchInput> inputs;
+    inputs.push_back(BenchInput{"text", GenerateText(size, rng)});
+    inputs.push_back(BenchInput{"table", GenerateTable(size, rng)});
+    inputs.push_back(BenchInput{"repetitive", GenerateRepetitive(size, rng)});
+    inputs.push_back(BenchInput{"random", GenerateRandom(size, rng)});
+    return inputs;
+}
+
+static bool PinToCpu(int cpu) {
+#ifdef _MSC_VER
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#endif
+}
+
+static uint64_t NowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch())
+                                     .count());
+}
+
+// Runs func warmup + repetitions times and returns the sorted timings of the measured runs.
+template<typename Func>
+static std::vector<uint64_t> Measure(const BenchOptions& options, Func&& func) {
+    for (size_t i = 0; i < options.Warmup; ++i) {
+        func();
+    }
+    std::vector<uint64_t> timings;
+    timings.reserve(options.Repetitions);
+    for (size_t i = 0; i < options.Repetitions; ++i) {
+        const uint64_t start = NowNs();
+        func();
+        timings.push_back(NowNs() - start);
+    }
+    std::sort(timings.begin(), timings.end());
+    return timings;
+}
+
+static double MegabytesPerSecond(size_t bytes, uint64_t ns) {
+    if (ns == 0) {
+        return 0.0;
+    }
+    return (static_cast<double>(bytes) / (1024.0 * 1024.0))
+           / (static_cast<double>(ns) / 1'000'000'000.0);
+}
+
+static double NanosecondsPerByte(size_t bytes, uint64_t ns) {
+    return bytes == 0 ? 0.0 : (static_cast<double>(ns) / static_cast<double>(bytes));
+}
+
+static bool RunKernelBenchmarks(const BenchOptions& options,
+                                const std::vector<BenchInput>& inputs,
+                                std::vector<BenchResult>& results) {
+    std::vector<char> compressed;
+    std::vector<char> uncompressed;
+    for (const auto& input : inputs) {
+        compressed.resize(compress_81_83_bound(input.Data.size()));
+        uncompressed.resize(input.Data.size() + decompress_reserve_extra_bytes());
+        for (const auto& kernel : Kernels) {
+            size_t compressedSize = 0;
+            const auto compressTimings = Measure(options, [&]() {
+                compressedSize = kernel.Compress(input.Data.data(),
+                                                 input.Data.size(),
+                                                 compressed.data(),
+                                                 compress_default_level);
+            });
+            const auto decompressTimings = Measure(options, [&]() {
+                kernel.Decompress(
+                    compressed.data(), compressedSize, uncompressed.data(), input.Data.size());
+            });
+
+            if (std::memcmp(uncompressed.data(), input.Data.data(), input.Data.size()) != 0) {
+                printf("roundtrip mismatch for %s on %s input\n", kernel.Name, input.Name);
+                return false;
+            }
+
+            results.push_back(BenchResult{std::string("compress_") + kernel.Name,
+                                          input.Name,
+                                          input.Data.size(),
+                                          compressedSize,
+                                          compressTimings.front(),
+                                          compressTimings[compressTimings.size() / 2]});
+            results.push_back(BenchResult{std::string("decompress_") + kernel.Name,
+                                          input.Name,
+                                          input.Data.size(),
+                                          compressedSize,
+                                          decompressTimings.front(),
+                                          decompressTimings[decompressTimings.size() / 2]});
+        }
+    }
+    return true;
+}
+
+// Decodes the chunks of every input once one after another and once with
+// decompress_exact_interleaved(), which takes turns on several of them.
+static bool RunInterleavedBenchmarks(const BenchOptions& options,
+                                     const std::vector<BenchInput>& inputs,
+                                     std::vector<BenchResult>& results) {
+    std::vector<std::vector<char>> chunks;
+    std::vector<DecodeStream> streams;
+    std::vector<char> uncompressed;
+    for (const auto& input : inputs) {
+        const size_t chunkSize = (input.Data.size() + InterleavedChunkCount - 1)
+                                 / InterleavedChunkCount;
+        uncompressed.resize(input.Data.size());
+        for (const auto& kernel : Kernels) {
+            chunks.clear();
+            streams.clear();
+            size_t compressedSize = 0;
+            for (size_t offset = 0; offset < input.Data.size(); offset += chunkSize) {
+                const size_t length = std::min(chunkSize, input.Data.size() - offset);
+                auto& chunk = chunks.emplace_back(compress_81_83_bound(length));
+                chunk.resize(kernel.Compress(
+                    input.Data.data() + offset, length, chunk.data(), compress_default_level));
+                compressedSize += chunk.size();
+                streams.push_back(DecodeStream{
+                    nullptr, chunk.size(), uncompressed.data() + offset, length, 0});
+            }
+            for (size_t i = 0; i < streams.size(); ++i) {
+                streams[i].Compressed = chunks[i].data();
+            }
+
+            const auto serialTimings = Measure(options, [&]() {
+                for (auto& stream : streams) {
+                    stream.Result = decompress_exact_type(kernel.Type,
+                                                          stream.Compressed,
+                                                          stream.CompressedLength,
+                                                          stream.Uncompressed,
+                                                          stream.UncompressedLength);
+                }
+            });
+            std::fill(uncompressed.begin(), uncompressed.end(), 0);
+            const auto interleavedTimings = Measure(
+                options, [&]() { decompress_exact_interleaved(kernel.Type, streams); });
+
+            bool matches = std::memcmp(uncompressed.data(), input.Data.data(), input.Data.size())
+                           == 0;
+            for (const auto& stream : streams) {
+                matches = matches
+                          && stream.Result == static_cast<int64_t>(stream.UncompressedLength);
+            }
+            if (!matches) {
+                printf("interleaved mismatch for %s on %s input\n", kernel.Name, input.Name);
+                return false;
+            }
+
+            results.push_back(BenchResult{std::string("chunks_") + kernel.Name,
+                                          input.Name,
+                                          input.Data.size(),
+                                          compressedSize,
+                                          serialTimings.front(),
+                                          serialTimings[serialTimings.size() / 2]});
+            results.push_back(BenchResult{std::string("interleaved_") + kernel.Name,
+                                          input.Name,
+                                          input.Data.size(),
+                                          compressedSize,
+                                          interleavedTimings.front(),
+                                          interleavedTimings[interleavedTimings.size() / 2]});
+        }
+    }
+    return true;
+}
+
+static void RunLevelSweep(const BenchOptions& options,
+                          const std::vector<BenchInput>& inputs,
+                          std::vector<LevelResult>& results) {
+    std::vector<char> compressed;
+    for (const auto& kernel : Kernels) {
+        const size_t first = results.size();
+        for (int level = compress_min_level; level <= compress_max_level; ++level) {
+            LevelResult result{std::string("compress_") + kernel.Name, level, 0, 0, 0, false};
+            for (const auto& input : inputs) {
+                compressed.resize(compress_81_83_bound(input.Data.size()));
+                size_t compressedSize = 0;
+                const auto timings = Measure(options, [&]() {
+                    compressedSize = kernel.Compress(
+                        input.Data.data(), input.Data.size(), compressed.data(), level);
+                });
+                result.UncompressedBytes += input.Data.size();
+                result.CompressedBytes += compressedSize;
+                result.Ns += timings[timings.size() / 2];
+            }
+            results.push_back(std::move(result));
+        }
+
+        // a level is on the Pareto front if no other level is both faster and compresses better
+        for (size_t i = first; i < results.size(); ++i) {
+            bool dominated = false;
+            for (size_t j = first; j < results.size(); ++j) {
+                if (i != j && results[j].Ns <= results[i].Ns
+                    && results[j].CompressedBytes <= results[i].CompressedBytes
+                    && (results[j].Ns < results[i].Ns
+                        || results[j].CompressedBytes < results[i].CompressedBytes)) {
+                    dominated = true;
+                    break;
+                }
+            }
+            results[i].Pareto = !dominated;
+        }
+    }
+}
+
+static void PrintResults(const std::vector<BenchResult>& results,
+                         const std::vector<LevelResult>& levels) {
+    printf("%-14s %-11s %8s %8s %7s %10s %10s %8s\n",
+           "kernel",
+           "input",
+           "bytes",
+           "packed",
+           "ratio",
+           "min MB/s",
+           "med MB/s",
+           "ns/byte");
+    for (const auto& r : results) {
+        printf("%-14s %-11s %8zu %8zu %7.4f %10.2f %10.2f %8.3f\n",
+               r.Kernel.c_str(),
+               r.Input.c_str(),
+               r.UncompressedBytes,
+               r.CompressedBytes,
+               static_cast<double>(r.CompressedBytes) / static_cast<double>(r.UncompressedBytes),
+               MegabytesPerSecond(r.UncompressedBytes, r.MinNs),
+               MegabytesPerSecond(r.UncompressedBytes, r.MedianNs),
+               NanosecondsPerByte(r.UncompressedBytes, r.MedianNs));
+    }
+
+    if (levels.empty()) {
+        return;
+    }
+    printf("\n%-14s %5s %7s %10s %7s\n", "kernel", "level", "ratio", "MB/s", "pareto");
+    for (const auto& l : levels) {
+        printf("%-14s %5d %7.4f %10.2f %7s\n",
+               l.Kernel.c_str(),
+               l.Level,
+               static_cast<double>(l.CompressedBytes) / static_cast<double>(l.UncompressedBytes),
+               MegabytesPerSecond(l.UncompressedBytes, l.Ns),
+               l.Pareto ? "*" : "");
+    }
+}
+
+static void PrintJson(const BenchOptions& options,
+                      const std::vector<BenchResult>& results,
+                      const std::vector<LevelResult>& levels) {
+    HyoutaUtils::Json::Writer json;
+    json.BeginObject();
+    json.Key("input_size");
+    json.UInt(options.InputSize);
+    json.Key("warmup");
+    json.UInt(options.Warmup);
+    json.Key("repetitions");
+    json.UInt(options.Repetitions);
+    json.Key("cpu");
+    json.Int(options.Cpu);
+    json.Key("kernels");
+    json.BeginArray();
+    for (const auto& r : results) {
+        json.BeginObject();
+        json.Key("kernel");
+        json.String(r.Kernel);
+        json.Key("input");
+        json.String(r.Input);
+        json.Key("uncompressed_bytes");
+        json.UInt(r.UncompressedBytes);
+        json.Key("compressed_bytes");
+        json.UInt(r.CompressedBytes);
+        json.Key("min_ns");
+        json.UInt(r.MinNs);
+        json.Key("median_ns");
+        json.UInt(r.MedianNs);
+        json.Key("mb_per_s");
+        json.Double(MegabytesPerSecond(r.UncompressedBytes, r.MedianNs));
+        json.Key("ns_per_byte");
+        json.Double(NanosecondsPerByte(r.UncompressedBytes, r.MedianNs));
+        json.EndObject();
+    }
+    json.EndArray();
+    json.Key("levels");
+    json.BeginArray();
+    for (const auto& l : levels) {
+        json.BeginObject();
+        json.Key("kernel");
+        json.String(l.Kernel);
+        json.Key("level");
+        json.Int(l.Level);
+        json.Key("uncompressed_bytes");
+        json.UInt(l.UncompressedBytes);
+        json.Key("compressed_bytes");
+        json.UInt(l.CompressedBytes);
+        json.Key("median_ns");
+        json.UInt(l.Ns);
+        json.Key("pareto");
+        json.Bool(l.Pareto);
+        json.EndObject();
+    }
+    json.EndArray();
+    json.EndObject();
+    printf("%s\n", json.GetString().c_str());
+}
+
+static void PrintUsage() {
+    printf(
+        "Usage:\n"
+        "  topdec_bench [options]\n"
+        "  Options are:\n"
+        "    --size N (bytes per generated input, defaults to 32768)\n"
+        "    --warmup N (unmeasured runs per kernel, defaults to 3)\n"
+        "    --reps N (measured runs per kernel, defaults to 15)\n"
+        "    --cpu N (pin the benchmark to the given CPU)\n"
+        "    --no-levels (skip the compression level sweep)\n"
+        "    --json (print machine-readable output)\n");
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    for (int idx = 1; idx < argc; ++idx) {
+        const bool hasValue = (idx + 1) < argc;
+        if (strcmp("--size", argv[idx]) == 0 && hasValue) {
+            options.InputSize = static_cast<size_t>(strtoull(argv[++idx], nullptr, 10));
+            if (options.InputSize == 0) {
+                // the ratio and throughput columns would divide by zero
+                PrintUsage();
+                return -1;
+            }
+        } else if (strcmp("--warmup", argv[idx]) == 0 && hasValue) {
+            options.Warmup = static_cast<size_t>(strtoull(argv[++idx], nullptr, 10));
+        } else if (strcmp("--reps", argv[idx]) == 0 && hasValue) {
+            options.Repetitions =
+                std::max(size_t(1), static_cast<size_t>(strtoull(argv[++idx], nullptr, 10)));
+        } else if (strcmp("--cpu", argv[idx]) == 0 && hasValue) {
+            options.Cpu = atoi(argv[++idx]);
+        } else if (strcmp("--no-levels", argv[idx]) == 0) {
+            options.LevelSweep = false;
+        } else if (strcmp("--json", argv[idx]) == 0) {
+            options.Json = true;
+        } else {
+            PrintUsage();
+            return -1;
+        }
+    }
+
+    if (options.Cpu >= 0 && !PinToCpu(options.Cpu)) {
+        printf("failed to pin to CPU %d\n", options.Cpu);
+        return -1;
+    }
+
+    const auto inputs = GenerateInputs(options.InputSize);
+    std::vector<BenchResult> results;
+    if (!RunKernelBenchmarks(options, inputs, results)
+        || !RunInterleavedBenchmarks(options, inputs, results)) {
+        return -1;
+    }
+    std::vector<LevelResult> levels;
+    if (options.LevelSweep) {
+        RunLevelSweep(options, inputs, levels);
+    }
+
+    if (options.Json) {
+        PrintJson(options, results, levels);
+    } else {
+        PrintResults(results, levels);
+    }
+    return 0;
+}
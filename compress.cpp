@@ -1,4 +1,4 @@
-#include "decompress.h"
+#include "compress.h"
 
 #include <cassert>
 #include <cstdint>
@@ -7,10 +7,14 @@ size_t compress_81_83_bound(size_t uncompressedLength) {
     return uncompressedLength + (uncompressedLength / 8) + 1;
 }
 
-size_t compress_81_83(const char* uncompressed,
-                      size_t uncompressedLength,
-                      char* compressed,
-                      bool is83) {
+// The 01/03 formats reference a 4KB ring buffer of the output instead of the output itself, so
+// the same encoder can produce them by translating each backref into its ring buffer position.
+static size_t compress_internal(const char* uncompressed,
+                                size_t uncompressedLength,
+                                char* compressed,
+                                bool is83,
+                                bool hasDict,
+                                int level) {
     size_t compressedLength = 0;
     size_t compressedPosition = 0;
     size_t uncompressedPosition = 0;
@@ -47,12 +51,14 @@ size_t compress_81_83(const char* uncompressed,
         if (count <= 18) {
             compressed[compressedPosition] = uncompressed[uncompressedPosition];
             ++compressedPosition;
-            compressed[compressedPosition] = static_cast<char>(0xf0 | (count - 3));
+            compressed[compressedPosition] = hasDict ? static_cast<char>(0x0f | ((count - 3) << 4))
+                                                     : static_cast<char>(0xf0 | (count - 3));
             ++compressedPosition;
         } else {
             compressed[compressedPosition] = static_cast<char>(count - 19);
             ++compressedPosition;
-            compressed[compressedPosition] = static_cast<char>(0xf0);
+            compressed[compressedPosition] = hasDict ? static_cast<char>(0x0f)
+                                                     : static_cast<char>(0xf0);
             ++compressedPosition;
             compressed[compressedPosition] = uncompressed[uncompressedPosition];
             ++compressedPosition;
@@ -87,17 +93,34 @@ size_t compress_81_83(const char* uncompressed,
     constexpr static size_t minBackrefOffset = 1;
     constexpr static size_t maxBackrefOffset = 4095;
 
+    constexpr static size_t searchDistances[] = {16, 64, 128, 256, 512, 1024, 2048, 3072, 4095};
+    const size_t maxSearchDistance =
+        level < compress_min_level   ? searchDistances[0]
+        : level > compress_max_level ? maxBackrefOffset
+                                     : searchDistances[level - compress_min_level];
+
+    const size_t dictStart = is83 ? 0xfef : 0xfee;
+
     const auto write_backref = [&](size_t length, size_t offset) -> void {
         write_command_bit(0);
 
         assert(length >= minBackrefLength && length <= maxBackrefLength);
         assert(offset >= minBackrefOffset && offset <= maxBackrefOffset);
 
-        compressed[compressedPosition] = static_cast<char>(offset & 0xff);
-        ++compressedPosition;
-        compressed[compressedPosition] =
-            static_cast<char>(((offset >> 8) & 0xf) | ((length - minBackrefLength) << 4));
-        ++compressedPosition;
+        if (hasDict) {
+            const size_t dictPosition = (dictStart + uncompressedPosition - offset) & 0xfff;
+            compressed[compressedPosition] = static_cast<char>(dictPosition & 0xff);
+            ++compressedPosition;
+            compressed[compressedPosition] = static_cast<char>(((dictPosition >> 8) << 4)
+                                                               | (length - minBackrefLength));
+            ++compressedPosition;
+        } else {
+            compressed[compressedPosition] = static_cast<char>(offset & 0xff);
+            ++compressedPosition;
+            compressed[compressedPosition] =
+                static_cast<char>(((offset >> 8) & 0xf) | ((length - minBackrefLength) << 4));
+            ++compressedPosition;
+        }
 
         uncompressedPosition += length;
     };
@@ -110,7 +133,8 @@ size_t compress_81_83(const char* uncompressed,
         }
 
         const size_t firstPossibleBackrefPosition =
-            uncompressedPosition < maxBackrefOffset ? 0 : (uncompressedPosition - maxBackrefOffset);
+            uncompressedPosition < maxSearchDistance ? 0
+                                                     : (uncompressedPosition - maxSearchDistance);
         const size_t lastPossibleBackrefPosition = uncompressedPosition - 1;
         const size_t allowedBackrefLength =
             (uncompressedLength - uncompressedPosition) >= maxBackrefLength
@@ -176,10 +200,38 @@ size_t compress_81_83(const char* uncompressed,
     return compressedPosition;
 }
 
+size_t compress_01(const char* uncompressed, size_t uncompressedLength, char* compressed) {
+    return compress_01(uncompressed, uncompressedLength, compressed, compress_default_level);
+}
+
+size_t compress_03(const char* uncompressed, size_t uncompressedLength, char* compressed) {
+    return compress_03(uncompressed, uncompressedLength, compressed, compress_default_level);
+}
+
 size_t compress_81(const char* uncompressed, size_t uncompressedLength, char* compressed) {
-    return compress_81_83(uncompressed, uncompressedLength, compressed, false);
+    return compress_81(uncompressed, uncompressedLength, compressed, compress_default_level);
 }
 
 size_t compress_83(const char* uncompressed, size_t uncompressedLength, char* compressed) {
-    return compress_81_83(uncompressed, uncompressedLength, compressed, true);
+    return compress_83(uncompressed, uncompressedLength, compressed, compress_default_level);
+}
+
+size_t
+    compress_01(const char* uncompressed, size_t uncompressedLength, char* compressed, int level) {
+    return compress_internal(uncompressed, uncompressedLength, compressed, false, true, level);
+}
+
+size_t
+    compress_03(const char* uncompressed, size_t uncompressedLength, char* compressed, int level) {
+    return compress_internal(uncompressed, uncompressedLength, compressed, true, true, level);
+}
+
+size_t
+    compress_81(const char* uncompressed, size_t uncompressedLength, char* compressed, int level) {
+    return compress_internal(uncompressed, uncompressedLength, compressed, false, false, level);
+}
+
+size_t
+    compress_83(const char* uncompressed, size_t uncompressedLength, char* compressed, int level) {
+    return compress_internal(uncompressed, uncompressedLength, compressed, true, false, level);
 }
@@ -3,6 +3,26 @@
 #include <cstddef>
 #include <cstdint>
 
+// Compression levels trade ratio for speed by limiting how far back the encoder searches for
+// matches. The default level searches the entire window.
+constexpr int compress_min_level = 1;
+constexpr int compress_max_level = 9;
+constexpr int compress_default_level = compress_max_level;
+
+// Identifies the encoder's output for a given input, type and level. Must be increased whenever a
+// change to the encoder changes its output, so that caches of compressed data become invalid.
+constexpr uint32_t compress_encoder_version = 1;
+
 size_t compress_81_83_bound(size_t uncompressedLength);
+size_t compress_01(const char* uncompressed, size_t uncompressedLength, char* compressed);
+size_t compress_03(const char* uncompressed, size_t uncompressedLength, char* compressed);
 size_t compress_81(const char* uncompressed, size_t uncompressedLength, char* compressed);
 size_t compress_83(const char* uncompressed, size_t uncompressedLength, char* compressed);
+size_t
+    compress_01(const char* uncompressed, size_t uncompressedLength, char* compressed, int level);
+size_t
+    compress_03(const char* uncompressed, size_t uncompressedLength, char* compressed, int level);
+size_t
+    compress_81(const char* uncompressed, size_t uncompressedLength, char* compressed, int level);
+size_t
+    compress_83(const char* uncompressed, size_t uncompressedLength, char* compressed, int level);
@@ -0,0 +1,212 @@
+#include "compress_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <random>
+#include <span>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "compress.h"
+#include "file.h"
+#include "hash.h"
+
+// Temporary files older than this were left behind by a run that crashed or was killed during
+// Store(). A live one is renamed into place moments after it was created, so an hour leaves plenty
+// of room for slow disks and other processes sharing the cache.
+constexpr auto cache_temp_grace_period = std::chrono::hours(1);
+
+// Deletes the temporary files in 'directory' that are older than cache_temp_grace_period.
+static void RemoveStaleTempFiles(const std::filesystem::path& directory) {
+    const auto cutoff = std::filesystem::file_time_type::clock::now() - cache_temp_grace_period;
+    std::error_code ec;
+    std::filesystem::directory_iterator file(directory, ec);
+    for (; !ec && file != std::filesystem::directory_iterator(); file.increment(ec)) {
+        std::error_code fileEc;
+        if (!file->is_regular_file(fileEc)) {
+            continue;
+        }
+        const auto lastWrite = file->last_write_time(fileEc);
+        if (!fileEc && lastWrite < cutoff) {
+            std::filesystem::remove(file->path(), fileEc);
+        }
+    }
+}
+
+CompressCache::CompressCache(std::filesystem::path directory, uint64_t maxBytes)
+  : Directory(std::move(directory)), MaxBytes(maxBytes) {
+    std::random_device rd;
+    TempNameSeed = (static_cast<uint64_t>(rd()) << 32) ^ rd();
+}
+
+CompressCache::~CompressCache() = default;
+
+bool CompressCache::Open() {
+    std::error_code ec;
+    std::filesystem::create_directories(Directory / "tmp", ec);
+    return !ec;
+}
+
+std::string CompressCache::MakeKey(std::span<const char> uncompressed, uint8_t type, int level) {
+    // the parameters go into the seed, and two differently seeded hashes make a 128-bit key
+    const uint64_t params = (static_cast<uint64_t>(compress_encoder_version) << 16)
+                            | (static_cast<uint64_t>(type) << 8) | static_cast<uint64_t>(level);
+    const uint64_t a = hash_bytes_64(uncompressed.data(), uncompressed.size(), params);
+    const uint64_t b =
+        hash_bytes_64(uncompressed.data(), uncompressed.size(), ~params * 0x9e3779b97f4a7c15u);
+    char buffer[33];
+    snprintf(buffer,
+             sizeof(buffer),
+             "%016llx%016llx",
+             static_cast<unsigned long long>(a),
+             static_cast<unsigned long long>(b));
+    return std::string(buffer, 32);
+}
+
+std::filesystem::path CompressCache::EntryPath(const std::string& key) const {
+    // fan out into 256 subdirectories to keep directory sizes reasonable
+    return Directory / key.substr(0, 2) / key;
+}
+
+bool CompressCache::Fetch(const std::string& key, const std::filesystem::path& target) {
+    bool deduplicated = false;
+    {
+        std::unique_lock lock(Mutex);
+        KeyReleased.wait(lock, [&]() { return !InFlight.contains(key); });
+        deduplicated = StoredThisRun.contains(key);
+        InFlight.insert(key);
+    }
+
+    const auto entry = EntryPath(key);
+    if (HyoutaUtils::IO::CopyFile(entry, target)) {
+        // the modification time doubles as the last use time for Trim()
+        std::error_code ec;
+        std::filesystem::last_write_time(entry, std::filesystem::file_time_type::clock::now(), ec);
+
+        std::lock_guard lock(Mutex);
+        ++Counters.Hits;
+        if (deduplicated) {
+            ++Counters.Deduplicated;
+        }
+        InFlight.erase(key);
+        KeyReleased.notify_all();
+        return true;
+    }
+
+    std::lock_guard lock(Mutex);
+    ++Counters.Misses;
+    return false;
+}
+
+void CompressCache::Store(const std::string& key, std::span<const char> compressedFile) {
+    uint64_t counter;
+    {
+        std::lock_guard lock(Mutex);
+        counter = TempCounter++;
+    }
+    char tempName[64];
+    snprintf(tempName,
+             sizeof(tempName),
+             "%016llx-%llu.tmp",
+             static_cast<unsigned long long>(TempNameSeed),
+             static_cast<unsigned long long>(counter));
+    const auto tempPath = Directory / "tmp" / tempName;
+    const auto entry = EntryPath(key);
+
+    bool stored = false;
+    std::error_code ec;
+    std::filesystem::create_directories(entry.parent_path(), ec);
+    HyoutaUtils::IO::File file(tempPath, HyoutaUtils::IO::OpenMode::Write);
+    if (file.IsOpen()) {
+        if (file.Write(compressedFile.data(), compressedFile.size()) == compressedFile.size()) {
+            stored = file.Rename(entry);
+        }
+        if (!stored) {
+            file.Delete();
+        }
+    }
+    Release(key, stored);
+}
+
+void CompressCache::Abandon(const std::string& key) {
+    Release(key, false);
+}
+
+void CompressCache::Release(const std::string& key, bool stored) {
+    std::lock_guard lock(Mutex);
+    if (stored) {
+        ++Counters.Stores;
+        StoredThisRun.insert(key);
+    }
+    InFlight.erase(key);
+    KeyReleased.notify_all();
+}
+
+void CompressCache::Trim() {
+    struct CacheEntry {
+        std::filesystem::path Path;
+        std::filesystem::file_time_type LastUse;
+        uint64_t Size;
+    };
+    std::vector<CacheEntry> entries;
+    uint64_t totalBytes = 0;
+
+    // tmp/ holds no entries, only what Store() is writing or a crashed run left behind
+    RemoveStaleTempFiles(Directory / "tmp");
+
+    // Trimming is best effort: whatever can't be read is left alone. The range-for form of the
+    // iterators can't be used, as it throws on errors.
+    std::error_code ec;
+    std::filesystem::directory_iterator subdir(Directory, ec);
+    for (; !ec && subdir != std::filesystem::directory_iterator(); subdir.increment(ec)) {
+        std::error_code entryEc;
+        if (!subdir->is_directory(entryEc) || subdir->path().filename() == "tmp") {
+            continue;
+        }
+        std::filesystem::directory_iterator file(subdir->path(), entryEc);
+        for (; !entryEc && file != std::filesystem::directory_iterator();
+             file.increment(entryEc)) {
+            std::error_code fileEc;
+            if (!file->is_regular_file(fileEc)) {
+                continue;
+            }
+            const auto lastUse = file->last_write_time(fileEc);
+            const uint64_t size = fileEc ? 0 : file->file_size(fileEc);
+            if (fileEc) {
+                continue;
+            }
+            entries.push_back(CacheEntry{file->path(), lastUse, size});
+            totalBytes += size;
+        }
+    }
+    if (totalBytes <= MaxBytes) {
+        return;
+    }
+
+    // evict down to 90% of the limit so that the next run doesn't have to evict right away again
+    const uint64_t targetBytes = MaxBytes - MaxBytes / 10;
+    std::sort(entries.begin(), entries.end(), [](const CacheEntry& lhs, const CacheEntry& rhs) {
+        return lhs.LastUse < rhs.LastUse;
+    });
+    for (const auto& e : entries) {
+        if (totalBytes <= targetBytes) {
+            break;
+        }
+        if (std::filesystem::remove(e.Path, ec)) {
+            totalBytes -= e.Size;
+            std::lock_guard lock(Mutex);
+            ++Counters.Evictions;
+            Counters.EvictedBytes += e.Size;
+        }
+    }
+}
+
+CompressCache::Stats CompressCache::GetStats() const {
+    std::lock_guard lock(Mutex);
+    return Counters;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_set>
+
+// Persistent content-addressed cache of compressed files.
+//
+// Entries are keyed by a hash of the uncompressed input together with the compression type, level
+// and compress_encoder_version, and contain the complete output file including its header. They
+// are written to a temporary file and renamed into place, so a crashed or concurrent run never
+// leaves a partial entry behind. Hits refresh the entry's modification time, and Trim() deletes
+// the least recently used entries once the cache exceeds its size limit.
+//
+// Within a single process, concurrent requests for the same key are deduplicated: the first caller
+// compresses, and everyone else waits for its result instead of compressing the same data again.
+struct CompressCache {
+public:
+    struct Stats {
+        uint64_t Hits = 0;
+        uint64_t Misses = 0;
+        // hits on an entry that another file of the same run just stored
+        uint64_t Deduplicated = 0;
+        uint64_t Stores = 0;
+        uint64_t Evictions = 0;
+        uint64_t EvictedBytes = 0;
+    };
+
+    CompressCache(std::filesystem::path directory, uint64_t maxBytes);
+    CompressCache(const CompressCache& other) = delete;
+    CompressCache& operator=(const CompressCache& other) = delete;
+    ~CompressCache();
+
+    // Creates the cache directory if necessary.
+    bool Open();
+
+    static std::string MakeKey(std::span<const char> uncompressed, uint8_t type, int level);
+
+    // Tries to produce 'target' from the cache, copying or reflinking the cached entry. If another
+    // thread is currently compressing the same key, waits for it first. Returns true on a hit.
+    // On a miss, the caller owns the key and must call either Store() or Abandon() for it.
+    bool Fetch(const std::string& key, const std::filesystem::path& target);
+
+    void Store(const std::string& key, std::span<const char> compressedFile);
+    void Abandon(const std::string& key);
+
+    // Deletes the least recently used entries until the cache fits into its size limit, and
+    // temporary files that a crashed or killed run left behind.
+    void Trim();
+
+    Stats GetStats() const;
+
+private:
+    std::filesystem::path EntryPath(const std::string& key) const;
+    void Release(const std::string& key, bool stored);
+
+    std::filesystem::path Directory;
+    uint64_t MaxBytes;
+    uint64_t TempNameSeed;
+
+    mutable std::mutex Mutex;
+    std::condition_variable KeyReleased;
+    std::unordered_set<std::string> InFlight;
+    std::unordered_set<std::string> StoredThisRun;
+    uint64_t TempCounter = 0;
+    Stats Counters;
+};
@@ -0,0 +1,124 @@
+#include "decode_cache.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "hash.h"
+#include "topdec.h"
+
+namespace TopDec {
+DecodeCache::DecodeCache(size_t byteBudget) : ShardBudget(byteBudget / shard_count) {}
+
+DecodeCache::~DecodeCache() = default;
+
+DecodeCache::Key DecodeCache::MakeKey(std::span<const char> file) {
+    return Key{hash_bytes_64(file.data(), file.size()), static_cast<uint64_t>(file.size())};
+}
+
+DecodeCache::Shard& DecodeCache::GetShard(const Key& key) {
+    // the low bits pick the bucket inside the shard's map, so use the high ones here
+    return Shards[static_cast<size_t>(key.Hash >> 60) % shard_count];
+}
+
+DecodeCache::Buffer DecodeCache::Lookup(const Key& key) {
+    Shard& shard = GetShard(key);
+    std::lock_guard lock(shard.Mutex);
+    auto it = shard.Map.find(key);
+    if (it == shard.Map.end()) {
+        return nullptr;
+    }
+    shard.Lru.splice(shard.Lru.begin(), shard.Lru, it->second);
+    return it->second->Data;
+}
+
+DecodeCache::Buffer DecodeCache::Insert(const Key& key, Buffer data) {
+    const size_t size = data->size();
+    if (size > ShardBudget) {
+        Uncacheable.fetch_add(1);
+        return data;
+    }
+
+    Shard& shard = GetShard(key);
+    std::lock_guard lock(shard.Mutex);
+
+    // another thread may have decoded the same file in the meantime; keep the first result so
+    // everyone shares one buffer
+    auto existing = shard.Map.find(key);
+    if (existing != shard.Map.end()) {
+        shard.Lru.splice(shard.Lru.begin(), shard.Lru, existing->second);
+        return existing->second->Data;
+    }
+
+    while (!shard.Lru.empty() && shard.Bytes + size > ShardBudget) {
+        Entry& victim = shard.Lru.back();
+        shard.Bytes -= victim.Data->size();
+        shard.Map.erase(victim.K);
+        shard.Lru.pop_back();
+        Evictions.fetch_add(1);
+    }
+    shard.Lru.push_front(Entry{key, data});
+    shard.Map.emplace(key, shard.Lru.begin());
+    shard.Bytes += size;
+    Insertions.fetch_add(1);
+    return data;
+}
+
+DecodeCache::Buffer DecodeCache::Find(std::span<const char> file) {
+    Buffer result = Lookup(MakeKey(file));
+    if (result) {
+        Hits.fetch_add(1);
+    } else {
+        Misses.fetch_add(1);
+    }
+    return result;
+}
+
+DecodeCache::Buffer DecodeCache::Decode(std::span<const char> file, std::error_code& ec) {
+    ec.clear();
+    const Key key = MakeKey(file);
+    if (Buffer cached = Lookup(key)) {
+        Hits.fetch_add(1);
+        return cached;
+    }
+    Misses.fetch_add(1);
+
+    // decode outside of the lock so other readers of this shard aren't blocked meanwhile
+    auto data = std::make_shared<std::vector<char>>();
+    decode_file_image(file, *data, ec);
+    if (ec) {
+        return nullptr;
+    }
+    data->shrink_to_fit();
+    return Insert(key, std::move(data));
+}
+
+void DecodeCache::Clear() {
+    for (Shard& shard : Shards) {
+        std::lock_guard lock(shard.Mutex);
+        shard.Map.clear();
+        shard.Lru.clear();
+        shard.Bytes = 0;
+    }
+}
+
+DecodeCacheStats DecodeCache::GetStats() const {
+    DecodeCacheStats stats;
+    stats.Hits = Hits.load();
+    stats.Misses = Misses.load();
+    stats.Insertions = Insertions.load();
+    stats.Evictions = Evictions.load();
+    stats.Uncacheable = Uncacheable.load();
+    stats.Capacity = static_cast<uint64_t>(ShardBudget) * shard_count;
+    for (const Shard& shard : Shards) {
+        std::lock_guard lock(shard.Mutex);
+        stats.Entries += shard.Map.size();
+        stats.Bytes += shard.Bytes;
+    }
+    return stats;
+}
+} // namespace TopDec
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "topdec_c.h"
+
+namespace TopDec {
+struct DecodeCacheStats {
+    uint64_t Hits = 0;
+    uint64_t Misses = 0;
+    uint64_t Insertions = 0;
+    uint64_t Evictions = 0;
+    // results that were not cached because they alone exceed the budget of their shard
+    uint64_t Uncacheable = 0;
+    uint64_t Entries = 0;
+    uint64_t Bytes = 0;
+    uint64_t Capacity = 0;
+};
+
+// Cache of decoded file images, keyed by a hash of the compressed file. The cache is split into
+// independently locked shards so concurrent readers rarely contend, and each shard evicts its
+// least recently used entries once it exceeds its share of the byte budget.
+//
+// Results are handed out as shared immutable buffers: an evicted entry stays valid for as long as
+// someone holds on to it.
+//
+// Keys are the 64-bit hash and the length of the compressed file. The full input is not compared,
+// so two different files with the same hash and length would alias.
+class TOPDEC_API DecodeCache {
+public:
+    using Buffer = std::shared_ptr<const std::vector<char>>;
+
+    static constexpr size_t shard_count = 16;
+
+    explicit DecodeCache(size_t byteBudget);
+    DecodeCache(const DecodeCache& other) = delete;
+    DecodeCache(DecodeCache&& other) = delete;
+    DecodeCache& operator=(const DecodeCache& other) = delete;
+    DecodeCache& operator=(DecodeCache&& other) = delete;
+    ~DecodeCache();
+
+    // Returns the cached result for the given compressed file, or nullptr.
+    Buffer Find(std::span<const char> file);
+
+    // Returns the cached result for the given compressed file, or decodes and caches it. Failed
+    // decodes are not cached; ec receives the error and the return value is nullptr.
+    Buffer Decode(std::span<const char> file, std::error_code& ec);
+
+    void Clear();
+    DecodeCacheStats GetStats() const;
+
+private:
+    struct Key {
+        uint64_t Hash;
+        uint64_t Length;
+
+        bool operator==(const Key& other) const = default;
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const noexcept {
+            return static_cast<size_t>(key.Hash ^ (key.Length * 0x9e3779b97f4a7c15u));
+        }
+    };
+    struct Entry {
+        Key K;
+        Buffer Data;
+    };
+    struct Shard {
+        mutable std::mutex Mutex;
+        // most recently used entry first
+        std::list<Entry> Lru;
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> Map;
+        size_t Bytes = 0;
+    };
+
+    static Key MakeKey(std::span<const char> file);
+    Shard& GetShard(const Key& key);
+    Buffer Lookup(const Key& key);
+    Buffer Insert(const Key& key, Buffer data);
+
+    size_t ShardBudget;
+    std::array<Shard, shard_count> Shards;
+    std::atomic<uint64_t> Hits = 0;
+    std::atomic<uint64_t> Misses = 0;
+    std::atomic<uint64_t> Insertions = 0;
+    std::atomic<uint64_t> Evictions = 0;
+    std::atomic<uint64_t> Uncacheable = 0;
+};
+} // namespace TopDec
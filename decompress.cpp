@@ -1,220 +1,331 @@
 #include "decompress.h"
 
+#include <algorithm>
 #include <array>
-#include <cassert>
+#include <cstddef>
 #include <cstdint>
-#include <cstdio>
-
-static void InitializeDictionary(char* dict) {
-    size_t offset = 0;
-    for (size_t i = 0; i < 0x100; ++i) {
-        dict[offset++] = static_cast<char>(i);
-        dict[offset++] = static_cast<char>(0);
-        dict[offset++] = static_cast<char>(i);
-        dict[offset++] = static_cast<char>(0);
-        dict[offset++] = static_cast<char>(i);
-        dict[offset++] = static_cast<char>(0);
-        dict[offset++] = static_cast<char>(i);
-        dict[offset++] = static_cast<char>(0);
-    }
-    for (size_t i = 0; i < 0x100; ++i) {
-        dict[offset++] = static_cast<char>(i);
-        dict[offset++] = static_cast<char>(0xff);
-        dict[offset++] = static_cast<char>(i);
-        dict[offset++] = static_cast<char>(0xff);
-        dict[offset++] = static_cast<char>(i);
-        dict[offset++] = static_cast<char>(0xff);
-        dict[offset++] = static_cast<char>(i);
-    }
-    for (size_t i = 0; i < 0x100; ++i) {
-        dict[offset++] = 0;
-    }
-    assert(offset == 0x1000);
-}
+#include <span>
+
+#include "decompress_observed.h"
 
 size_t decompress_reserve_extra_bytes() {
     return 273;
 }
 
-template<bool HasDict, bool HasMultiByte, bool DoLogging>
-static int64_t decompress_internal(const char* compressed,
-                                   size_t compressedLength,
-                                   char* uncompressed,
-                                   size_t uncompressedLength) {
-    std::array<char, HasDict ? 0x1000 : 0> dict;
-    size_t in = 0;
-    size_t out = 0;
-    size_t dictpos = 0;
-
-    if constexpr (HasDict) {
-        InitializeDictionary(dict.data());
-        dictpos = HasMultiByte ? 0xfef : 0xfee;
+int64_t decompress_81(const char* compressed,
+                      size_t compressedLength,
+                      char* uncompressed,
+                      size_t uncompressedLength) {
+    NullDecodeObserver observer;
+    return decompress_internal<false, false>(
+        compressed, compressedLength, uncompressed, uncompressedLength, observer);
+}
+
+int64_t decompress_83(const char* compressed,
+                      size_t compressedLength,
+                      char* uncompressed,
+                      size_t uncompressedLength) {
+    NullDecodeObserver observer;
+    return decompress_internal<false, true>(
+        compressed, compressedLength, uncompressed, uncompressedLength, observer);
+}
+
+int64_t decompress_01(const char* compressed,
+                      size_t compressedLength,
+                      char* uncompressed,
+                      size_t uncompressedLength) {
+    NullDecodeObserver observer;
+    return decompress_internal<true, false>(
+        compressed, compressedLength, uncompressed, uncompressedLength, observer);
+}
+
+int64_t decompress_03(const char* compressed,
+                      size_t compressedLength,
+                      char* uncompressed,
+                      size_t uncompressedLength) {
+    NullDecodeObserver observer;
+    return decompress_internal<true, true>(
+        compressed, compressedLength, uncompressed, uncompressedLength, observer);
+}
+
+int64_t decompress_type(uint8_t type,
+                        const char* compressed,
+                        size_t compressedLength,
+                        char* uncompressed,
+                        size_t uncompressedLength) {
+    switch (type) {
+        case 0x01:
+            return decompress_01(compressed, compressedLength, uncompressed, uncompressedLength);
+        case 0x03:
+            return decompress_03(compressed, compressedLength, uncompressed, uncompressedLength);
+        case 0x81:
+            return decompress_81(compressed, compressedLength, uncompressed, uncompressedLength);
+        case 0x83:
+            return decompress_83(compressed, compressedLength, uncompressed, uncompressedLength);
+        default: return -2;
     }
+}
 
-    int literalBits = 0;
-    while (true) {
-        if (out >= uncompressedLength) {
-            return out;
-        }
-        if (in >= compressedLength) {
-            return -1;
-        }
+int64_t decompress_exact_81(const char* compressed,
+                            size_t compressedLength,
+                            char* uncompressed,
+                            size_t uncompressedLength) {
+    NullDecodeObserver observer;
+    return decompress_internal<false, false, NullDecodeObserver, true>(
+        compressed, compressedLength, uncompressed, uncompressedLength, observer);
+}
 
-        int isLiteralByte = (literalBits & 1);
-        literalBits = (literalBits >> 1);
-        if (literalBits == 0) {
-            literalBits = static_cast<uint8_t>(compressed[in]);
-            ++in;
-            isLiteralByte = (literalBits & 1);
-            literalBits = (0x80 | (literalBits >> 1));
-        }
-        if (isLiteralByte) {
-            const char c = compressed[in];
-            if constexpr (DoLogging) {
-                printf("literal byte 0x%02x\n", static_cast<uint8_t>(c));
-            }
-            uncompressed[out] = c;
-            if constexpr (HasDict) {
-                dict[dictpos] = c;
-                dictpos = (dictpos + 1u) & 0xfffu;
-            }
-            ++in;
-            ++out;
-            continue;
-        }
+int64_t decompress_exact_83(const char* compressed,
+                            size_t compressedLength,
+                            char* uncompressed,
+                            size_t uncompressedLength) {
+    NullDecodeObserver observer;
+    return decompress_internal<false, true, NullDecodeObserver, true>(
+        compressed, compressedLength, uncompressed, uncompressedLength, observer);
+}
 
-        if ((in + 1) >= compressedLength) {
-            return -1;
+int64_t decompress_exact_01(const char* compressed,
+                            size_t compressedLength,
+                            char* uncompressed,
+                            size_t uncompressedLength) {
+    NullDecodeObserver observer;
+    return decompress_internal<true, false, NullDecodeObserver, true>(
+        compressed, compressedLength, uncompressed, uncompressedLength, observer);
+}
+
+int64_t decompress_exact_03(const char* compressed,
+                            size_t compressedLength,
+                            char* uncompressed,
+                            size_t uncompressedLength) {
+    NullDecodeObserver observer;
+    return decompress_internal<true, true, NullDecodeObserver, true>(
+        compressed, compressedLength, uncompressed, uncompressedLength, observer);
+}
+
+int64_t decompress_exact_type(uint8_t type,
+                              const char* compressed,
+                              size_t compressedLength,
+                              char* uncompressed,
+                              size_t uncompressedLength) {
+    switch (type) {
+        case 0x01:
+            return decompress_exact_01(
+                compressed, compressedLength, uncompressed, uncompressedLength);
+        case 0x03:
+            return decompress_exact_03(
+                compressed, compressedLength, uncompressed, uncompressedLength);
+        case 0x81:
+            return decompress_exact_81(
+                compressed, compressedLength, uncompressed, uncompressedLength);
+        case 0x83:
+            return decompress_exact_83(
+                compressed, compressedLength, uncompressed, uncompressedLength);
+        default: return -2;
+    }
+}
+
+// Enough streams in flight to fill the gaps in a single stream's dependency chain, while their
+// state still fits into the registers and the store buffer alongside each other.
+static constexpr size_t interleaved_lanes = 4;
+
+// One stream of decompress_exact_interleaved(). This is the token loop of decompress_internal()
+// with ExactBound set, cut into groups of tokens. It's deliberately a copy rather than shared with
+// decompress_internal(): sharing the loop body changed the generated code of the serial decoders,
+// which every other caller depends on.
+template<bool HasDict, bool HasMultiByte>
+struct InterleavedLane {
+public:
+    InterleavedLane() = default;
+    InterleavedLane(const InterleavedLane& other) = delete;
+    InterleavedLane(InterleavedLane&& other) = delete;
+    InterleavedLane& operator=(const InterleavedLane& other) = delete;
+    InterleavedLane& operator=(InterleavedLane&& other) = delete;
+    ~InterleavedLane() = default;
+
+    void Start(DecodeStream& stream) {
+        Stream = &stream;
+        In = 0;
+        Out = 0;
+        DictPos = 0;
+        LiteralBits = 0;
+        if constexpr (HasDict) {
+            InitializeDictionary(Dict.data());
+            DictPos = HasMultiByte ? 0xfef : 0xfee;
         }
+    }
 
-        const uint8_t b = static_cast<uint8_t>(compressed[in + 1]);
-        const uint8_t blow = static_cast<uint8_t>(b & 0xf);
-        const uint8_t bhigh = static_cast<uint8_t>((b & 0xf0) >> 4);
-        const uint8_t nibble1 = HasDict ? blow : bhigh;
-        const uint8_t nibble2 = HasDict ? bhigh : blow;
-        if (HasMultiByte && (nibble1 == 0xf)) {
-            // multiple copies of the same byte
-
-            if (nibble2 == 0) {
-                if ((in + 2) >= compressedLength) {
-                    return -1;
-                }
+    bool IsActive() const {
+        return Stream != nullptr;
+    }
 
-                // 19 to 274 bytes
-                const size_t count = static_cast<size_t>(static_cast<uint8_t>(compressed[in])) + 19;
-                const char c = compressed[in + 2];
-                if constexpr (DoLogging) {
-                    printf("multi byte 0x%02x x%d\n",
-                           static_cast<uint8_t>(c),
-                           static_cast<int>(count));
-                }
-                for (size_t i = 0; i < count; ++i) {
-                    uncompressed[out] = c;
-                    if constexpr (HasDict) {
-                        dict[dictpos] = c;
-                        dictpos = (dictpos + 1u) & 0xfffu;
-                    }
-                    ++out;
-                }
-                in += 3;
-            } else {
-                // 4 to 18 bytes
-                const size_t count = static_cast<size_t>(nibble2) + 3;
-                const char c = compressed[in];
-                if constexpr (DoLogging) {
-                    printf("multi byte 0x%02x x%d\n",
-                           static_cast<uint8_t>(c),
-                           static_cast<int>(count));
-                }
-                for (size_t i = 0; i < count; ++i) {
-                    uncompressed[out] = c;
-                    if constexpr (HasDict) {
-                        dict[dictpos] = c;
-                        dictpos = (dictpos + 1u) & 0xfffu;
-                    }
-                    ++out;
-                }
-                in += 2;
+    // Decodes the tokens up to the next flag byte, so the state is saved and reloaded once per
+    // group of up to eight tokens rather than once per token. Returns false once the stream has
+    // ended, after storing the result in it. The state is copied into locals meanwhile, since the
+    // stores to the output could otherwise alias it and force it to be reloaded after every byte.
+    bool Step() {
+        const char* const compressed = Stream->Compressed;
+        const size_t compressedLength = Stream->CompressedLength;
+        char* const uncompressed = Stream->Uncompressed;
+        const size_t uncompressedLength = Stream->UncompressedLength;
+        size_t in = In;
+        size_t out = Out;
+        size_t dictpos = DictPos;
+        int literalBits = LiteralBits;
+
+        do {
+            if (out >= uncompressedLength) {
+                return Finish(static_cast<int64_t>(out));
             }
-        } else {
-            const uint16_t offset = static_cast<uint16_t>(static_cast<uint8_t>(compressed[in]))
-                                    | (static_cast<uint16_t>(nibble2) << 8);
-            const size_t count = static_cast<uint16_t>(nibble1) + 3;
-
-            if constexpr (HasDict) {
-                // reference into dictionary
-                if constexpr (DoLogging) {
-                    printf("dictref @0x%03x for %d\n",
-                           static_cast<int>(offset),
-                           static_cast<int>(count));
-                }
-                for (size_t i = 0; i < count; ++i) {
-                    const char c = dict[(offset + i) & 0xfffu];
-                    uncompressed[out] = c;
-                    dict[dictpos] = c;
+            if (in >= compressedLength) {
+                return Finish(-1);
+            }
+
+            int isLiteralByte = (literalBits & 1);
+            literalBits = (literalBits >> 1);
+            if (literalBits == 0) {
+                literalBits = static_cast<uint8_t>(compressed[in]);
+                ++in;
+                isLiteralByte = (literalBits & 1);
+                literalBits = (0x80 | (literalBits >> 1));
+            }
+            if (isLiteralByte) {
+                const char c = compressed[in];
+                uncompressed[out] = c;
+                if constexpr (HasDict) {
+                    Dict[dictpos] = c;
                     dictpos = (dictpos + 1u) & 0xfffu;
-                    ++out;
                 }
+                ++in;
+                ++out;
             } else {
-                // backref into decompressed data
-                if (offset == 0) {
-                    // the game just reads the unwritten output buffer and copies it over itself in
-                    // this case... while I suppose one *could* use this behavior in a really
-                    // creative way by pre-initializing the output buffer to something known, I
-                    // doubt it actually does that. so consider this a corrupted data stream.
-                    return -1;
-                }
-                if (out < offset) {
-                    // backref to before start of uncompressed data. this is invalid.
-                    return -1;
+                if ((in + 1) >= compressedLength) {
+                    return Finish(-1);
                 }
 
-                if constexpr (DoLogging) {
-                    printf("backref @%d for %d\n",
-                           static_cast<int>(out - offset),
-                           static_cast<int>(count));
-                }
-                for (size_t i = 0; i < count; ++i) {
-                    uncompressed[out] = uncompressed[out - offset];
-                    ++out;
+                const uint8_t b = static_cast<uint8_t>(compressed[in + 1]);
+                const uint8_t blow = static_cast<uint8_t>(b & 0xf);
+                const uint8_t bhigh = static_cast<uint8_t>((b & 0xf0) >> 4);
+                const uint8_t nibble1 = HasDict ? blow : bhigh;
+                const uint8_t nibble2 = HasDict ? bhigh : blow;
+                if (HasMultiByte && (nibble1 == 0xf)) {
+                    // multiple copies of the same byte, 19 to 274 with a count byte or 4 to 18
+                    // without
+                    size_t count;
+                    char c;
+                    if (nibble2 == 0) {
+                        if ((in + 2) >= compressedLength) {
+                            return Finish(-1);
+                        }
+                        count = static_cast<size_t>(static_cast<uint8_t>(compressed[in])) + 19;
+                        c = compressed[in + 2];
+                        in += 3;
+                    } else {
+                        count = static_cast<size_t>(nibble2) + 3;
+                        c = compressed[in];
+                        in += 2;
+                    }
+                    const size_t writable = std::min(count, uncompressedLength - out);
+                    for (size_t i = 0; i < writable; ++i) {
+                        uncompressed[out] = c;
+                        if constexpr (HasDict) {
+                            Dict[dictpos] = c;
+                            dictpos = (dictpos + 1u) & 0xfffu;
+                        }
+                        ++out;
+                    }
+                    out += count - writable;
+                } else {
+                    const uint16_t offset =
+                        static_cast<uint16_t>(static_cast<uint8_t>(compressed[in]))
+                        | (static_cast<uint16_t>(nibble2) << 8);
+                    const size_t count = static_cast<uint16_t>(nibble1) + 3;
+                    const size_t writable = std::min(count, uncompressedLength - out);
+                    if constexpr (HasDict) {
+                        // reference into dictionary
+                        for (size_t i = 0; i < writable; ++i) {
+                            const char c = Dict[(offset + i) & 0xfffu];
+                            uncompressed[out] = c;
+                            Dict[dictpos] = c;
+                            dictpos = (dictpos + 1u) & 0xfffu;
+                            ++out;
+                        }
+                    } else {
+                        // backref into decompressed data, see decompress_internal() for why
+                        // offset 0 is corrupt
+                        if (offset == 0 || out < offset) {
+                            return Finish(-1);
+                        }
+                        for (size_t i = 0; i < writable; ++i) {
+                            uncompressed[out] = uncompressed[out - offset];
+                            ++out;
+                        }
+                    }
+                    out += count - writable;
+                    in += 2;
                 }
             }
+        } while ((literalBits >> 1) != 0);
 
-            in += 2;
-        }
+        In = in;
+        Out = out;
+        DictPos = dictpos;
+        LiteralBits = literalBits;
+        return true;
     }
-}
 
-static constexpr bool EnableLogging = false;
+private:
+    bool Finish(int64_t result) {
+        Stream->Result = result;
+        Stream = nullptr;
+        return false;
+    }
 
-int64_t decompress_81(const char* compressed,
-                      size_t compressedLength,
-                      char* uncompressed,
-                      size_t uncompressedLength) {
-    return decompress_internal<false, false, EnableLogging>(
-        compressed, compressedLength, uncompressed, uncompressedLength);
-}
+    DecodeStream* Stream = nullptr;
+    size_t In = 0;
+    size_t Out = 0;
+    size_t DictPos = 0;
+    int LiteralBits = 0;
+    std::array<char, HasDict ? 0x1000 : 0> Dict;
+};
 
-int64_t decompress_83(const char* compressed,
-                      size_t compressedLength,
-                      char* uncompressed,
-                      size_t uncompressedLength) {
-    return decompress_internal<false, true, EnableLogging>(
-        compressed, compressedLength, uncompressed, uncompressedLength);
-}
+template<bool HasDict, bool HasMultiByte>
+static void DecompressInterleaved(std::span<DecodeStream> streams) {
+    std::array<InterleavedLane<HasDict, HasMultiByte>, interleaved_lanes> lanes;
 
-int64_t decompress_01(const char* compressed,
-                      size_t compressedLength,
-                      char* uncompressed,
-                      size_t uncompressedLength) {
-    return decompress_internal<true, false, EnableLogging>(
-        compressed, compressedLength, uncompressed, uncompressedLength);
+    // A lane whose stream has ended picks up the next one right away, so uneven lengths don't
+    // leave lanes idle until the end.
+    size_t next = 0;
+    size_t active = 0;
+    for (auto& lane : lanes) {
+        if (next < streams.size()) {
+            lane.Start(streams[next++]);
+            ++active;
+        }
+    }
+    while (active > 0) {
+        for (auto& lane : lanes) {
+            if (!lane.IsActive() || lane.Step()) {
+                continue;
+            }
+            if (next < streams.size()) {
+                lane.Start(streams[next++]);
+            } else {
+                --active;
+            }
+        }
+    }
 }
 
-int64_t decompress_03(const char* compressed,
-                      size_t compressedLength,
-                      char* uncompressed,
-                      size_t uncompressedLength) {
-    return decompress_internal<true, true, EnableLogging>(
-        compressed, compressedLength, uncompressed, uncompressedLength);
+void decompress_exact_interleaved(uint8_t type, std::span<DecodeStream> streams) {
+    switch (type) {
+        case 0x01: DecompressInterleaved<true, false>(streams); return;
+        case 0x03: DecompressInterleaved<true, true>(streams); return;
+        case 0x81: DecompressInterleaved<false, false>(streams); return;
+        case 0x83: DecompressInterleaved<false, true>(streams); return;
+        default:
+            for (DecodeStream& stream : streams) {
+                stream.Result = -2;
+            }
+            return;
+    }
 }
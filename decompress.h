@@ -2,6 +2,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <span>
 
 // amount of bytes that should be reserved in addition to the uncompressedLength in case the
 // compressed data produces more data than what is listed in the header
@@ -23,3 +24,53 @@ int64_t decompress_83(const char* compressed,
                       size_t compressedLength,
                       char* uncompressed,
                       size_t uncompressedLength);
+
+// Variants that never write past uncompressedLength, so 'uncompressed' only needs to be
+// uncompressedLength bytes. If the stream produces more data than that, the rest is dropped and the
+// return value is the length the stream would have decoded to.
+int64_t decompress_exact_01(const char* compressed,
+                            size_t compressedLength,
+                            char* uncompressed,
+                            size_t uncompressedLength);
+int64_t decompress_exact_03(const char* compressed,
+                            size_t compressedLength,
+                            char* uncompressed,
+                            size_t uncompressedLength);
+int64_t decompress_exact_81(const char* compressed,
+                            size_t compressedLength,
+                            char* uncompressed,
+                            size_t uncompressedLength);
+int64_t decompress_exact_83(const char* compressed,
+                            size_t compressedLength,
+                            char* uncompressed,
+                            size_t uncompressedLength);
+
+// Dispatches to one of the above depending on the compression type byte from the file header.
+// Returns -2 if the type is not a supported compressed format.
+int64_t decompress_type(uint8_t type,
+                        const char* compressed,
+                        size_t compressedLength,
+                        char* uncompressed,
+                        size_t uncompressedLength);
+int64_t decompress_exact_type(uint8_t type,
+                              const char* compressed,
+                              size_t compressedLength,
+                              char* uncompressed,
+                              size_t uncompressedLength);
+
+struct DecodeStream {
+    const char* Compressed = nullptr;
+    size_t CompressedLength = 0;
+    char* Uncompressed = nullptr;
+    size_t UncompressedLength = 0;
+
+    // set to what decompress_exact_type() returns for this stream
+    int64_t Result = 0;
+};
+
+// Decodes independent streams of the same compression type, with the same results as calling
+// decompress_exact_type() on each of them. Decoding a stream is one long serial chain of flag
+// bits, tokens and copies, so instead of running the streams one after another this advances a
+// few of them in lockstep, a token at a time, letting the out-of-order core overlap their chains.
+// Only worth it for many small streams; see topdec_bench for how it compares on this machine.
+void decompress_exact_interleaved(uint8_t type, std::span<DecodeStream> streams);
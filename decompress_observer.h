@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Observers receive one callback per token that the decoder processes. They are passed as a
+// template parameter to decompress_internal, so an observer with empty inline callbacks costs
+// nothing at all.
+//
+// For every callback, 'in' is the offset of the token in the compressed stream and 'out' is the
+// offset in the uncompressed stream the token starts writing to. Tokens are reported before their
+// bytes are written to the output.
+
+struct NullDecodeObserver {
+    void OnFlagByte(size_t /*in*/) {}
+    void OnLiteral(size_t /*in*/, size_t /*out*/, char /*c*/) {}
+    void OnRun(size_t /*in*/, size_t /*out*/, char /*c*/, size_t /*count*/) {}
+    void OnBackref(size_t /*in*/, size_t /*out*/, size_t /*offset*/, size_t /*count*/) {}
+    void OnDictRef(size_t /*in*/, size_t /*out*/, size_t /*dictOffset*/, size_t /*count*/) {}
+};
+
+// Counts tokens and the amount of uncompressed bytes each token type produced.
+struct CountingDecodeObserver {
+    uint64_t FlagBytes = 0;
+    uint64_t Literals = 0;
+    uint64_t Runs = 0;
+    uint64_t RunBytes = 0;
+    uint64_t Backrefs = 0;
+    uint64_t BackrefBytes = 0;
+    uint64_t DictRefs = 0;
+    uint64_t DictRefBytes = 0;
+
+    void OnFlagByte(size_t /*in*/) {
+        ++FlagBytes;
+    }
+    void OnLiteral(size_t /*in*/, size_t /*out*/, char /*c*/) {
+        ++Literals;
+    }
+    void OnRun(size_t /*in*/, size_t /*out*/, char /*c*/, size_t count) {
+        ++Runs;
+        RunBytes += count;
+    }
+    void OnBackref(size_t /*in*/, size_t /*out*/, size_t /*offset*/, size_t count) {
+        ++Backrefs;
+        BackrefBytes += count;
+    }
+    void OnDictRef(size_t /*in*/, size_t /*out*/, size_t /*dictOffset*/, size_t count) {
+        ++DictRefs;
+        DictRefBytes += count;
+    }
+};
+
+enum class DecodeTraceEventType : uint8_t {
+    FlagByte,
+    Literal,
+    Run,
+    Backref,
+    DictRef,
+};
+
+// Fixed-size record as stored by TraceDecodeObserver. 'Offset' is the backref distance or the
+// dictionary position, 'Value' the byte of literals and runs.
+struct DecodeTraceEvent {
+    DecodeTraceEventType Type;
+    uint8_t Value;
+    uint16_t Count;
+    uint32_t In;
+    uint32_t Out;
+    uint32_t Offset;
+};
+static_assert(sizeof(DecodeTraceEvent) == 16);
+
+// Records every token into a flat buffer for later inspection.
+struct TraceDecodeObserver {
+    std::vector<DecodeTraceEvent> Events;
+
+    void OnFlagByte(size_t in) {
+        Events.push_back(DecodeTraceEvent{
+            DecodeTraceEventType::FlagByte, 0, 0, static_cast<uint32_t>(in), 0, 0});
+    }
+    void OnLiteral(size_t in, size_t out, char c) {
+        Events.push_back(DecodeTraceEvent{DecodeTraceEventType::Literal,
+                                          static_cast<uint8_t>(c),
+                                          1,
+                                          static_cast<uint32_t>(in),
+                                          static_cast<uint32_t>(out),
+                                          0});
+    }
+    void OnRun(size_t in, size_t out, char c, size_t count) {
+        Events.push_back(DecodeTraceEvent{DecodeTraceEventType::Run,
+                                          static_cast<uint8_t>(c),
+                                          static_cast<uint16_t>(count),
+                                          static_cast<uint32_t>(in),
+                                          static_cast<uint32_t>(out),
+                                          0});
+    }
+    void OnBackref(size_t in, size_t out, size_t offset, size_t count) {
+        Events.push_back(DecodeTraceEvent{DecodeTraceEventType::Backref,
+                                          0,
+                                          static_cast<uint16_t>(count),
+                                          static_cast<uint32_t>(in),
+                                          static_cast<uint32_t>(out),
+                                          static_cast<uint32_t>(offset)});
+    }
+    void OnDictRef(size_t in, size_t out, size_t dictOffset, size_t count) {
+        Events.push_back(DecodeTraceEvent{DecodeTraceEventType::DictRef,
+                                          0,
+                                          static_cast<uint16_t>(count),
+                                          static_cast<uint32_t>(in),
+                                          static_cast<uint32_t>(out),
+                                          static_cast<uint32_t>(dictOffset)});
+    }
+};
+
+// Prints a human-readable line per token.
+struct TextDumpDecodeObserver {
+    FILE* Stream = stdout;
+
+    void OnFlagByte(size_t /*in*/) {}
+    void OnLiteral(size_t /*in*/, size_t /*out*/, char c) {
+        fprintf(Stream, "literal byte 0x%02x\n", static_cast<uint8_t>(c));
+    }
+    void OnRun(size_t /*in*/, size_t /*out*/, char c, size_t count) {
+        fprintf(Stream,
+                "multi byte 0x%02x x%d\n",
+                static_cast<uint8_t>(c),
+                static_cast<int>(count));
+    }
+    void OnBackref(size_t /*in*/, size_t out, size_t offset, size_t count) {
+        fprintf(Stream,
+                "backref @%d for %d\n",
+                static_cast<int>(out - offset),
+                static_cast<int>(count));
+    }
+    void OnDictRef(size_t /*in*/, size_t /*out*/, size_t dictOffset, size_t count) {
+        fprintf(Stream,
+                "dictref @0x%03x for %d\n",
+                static_cast<int>(dictOffset),
+                static_cast<int>(count));
+    }
+};
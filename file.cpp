@@ -4,6 +4,7 @@
 
 #include "file.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <memory>
@@ -21,17 +22,54 @@
 #include <Windows.h>
 
 #undef CreateDirectory
+#undef CopyFile
 #else
+#include <cerrno>
 #include <cstdio>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-#define INVALID_HANDLE_VALUE nullptr
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/sendfile.h>
+#endif
+
+// the file descriptor is stored in the handle itself
+#define INVALID_HANDLE_VALUE reinterpret_cast<void*>(static_cast<intptr_t>(-1))
 #define DWORD unsigned int
 #endif
 
 namespace HyoutaUtils::IO {
+#ifndef _MSC_VER
+static void* FdToHandle(int fd) noexcept {
+    return reinterpret_cast<void*>(static_cast<intptr_t>(fd));
+}
+
+static int HandleToFd(void* handle) noexcept {
+    return static_cast<int>(reinterpret_cast<intptr_t>(handle));
+}
+
+static int OpenFd(const char* path, OpenMode mode) noexcept {
+    int flags = O_CLOEXEC;
+    switch (mode) {
+        case OpenMode::Read: flags |= O_RDONLY; break;
+        case OpenMode::Write: flags |= O_WRONLY | O_CREAT | O_TRUNC; break;
+        case OpenMode::ReadWrite: flags |= O_RDWR | O_CREAT | O_TRUNC; break;
+        default: return -1;
+    }
+    while (true) {
+        const int fd = open(path, flags, 0666);
+        if (fd >= 0 || errno != EINTR) {
+            return fd;
+        }
+    }
+}
+#endif
+
 File::File() noexcept : Filehandle(INVALID_HANDLE_VALUE) {}
 
 File::File(std::string_view p, OpenMode mode) noexcept : Filehandle(INVALID_HANDLE_VALUE) {
@@ -94,21 +132,25 @@ bool File::Open(std::string_view p, OpenMode mode) noexcept {
                                      nullptr);
 #else
             std::string s(p);
-            Filehandle = fopen(s.c_str(), "rb");
+            Filehandle = FdToHandle(OpenFd(s.c_str(), mode));
             if (Filehandle != INVALID_HANDLE_VALUE) {
                 Path = std::move(s);
             }
 #endif
             return Filehandle != INVALID_HANDLE_VALUE;
         }
-        case OpenMode::Write: {
+        case OpenMode::Write:
+        case OpenMode::ReadWrite: {
 #ifdef _MSC_VER
             auto s = HyoutaUtils::TextUtils::Utf8ToWString(p.data(), p.size());
             if (!s) {
                 return false;
             }
+            const DWORD access = mode == OpenMode::ReadWrite
+                                     ? (GENERIC_READ | GENERIC_WRITE | DELETE)
+                                     : (GENERIC_WRITE | DELETE);
             Filehandle = CreateFileW(s->c_str(),
-                                     GENERIC_WRITE | DELETE,
+                                     access,
                                      0,
                                      nullptr,
                                      CREATE_ALWAYS,
@@ -116,7 +158,7 @@ bool File::Open(std::string_view p, OpenMode mode) noexcept {
                                      nullptr);
 #else
             std::string s(p);
-            Filehandle = fopen(s.c_str(), "wb");
+            Filehandle = FdToHandle(OpenFd(s.c_str(), mode));
             if (Filehandle != INVALID_HANDLE_VALUE) {
                 Path = std::move(s);
             }
@@ -142,17 +184,21 @@ bool File::Open(const std::filesystem::path& p, OpenMode mode) noexcept {
                                      nullptr);
 #else
             std::string s(p);
-            Filehandle = fopen(s.c_str(), "rb");
+            Filehandle = FdToHandle(OpenFd(s.c_str(), mode));
             if (Filehandle != INVALID_HANDLE_VALUE) {
                 Path = std::move(s);
             }
 #endif
             return Filehandle != INVALID_HANDLE_VALUE;
         }
-        case OpenMode::Write: {
+        case OpenMode::Write:
+        case OpenMode::ReadWrite: {
 #ifdef _MSC_VER
+            const DWORD access = mode == OpenMode::ReadWrite
+                                     ? (GENERIC_READ | GENERIC_WRITE | DELETE)
+                                     : (GENERIC_WRITE | DELETE);
             Filehandle = CreateFileW(p.c_str(),
-                                     GENERIC_WRITE | DELETE,
+                                     access,
                                      0,
                                      nullptr,
                                      CREATE_ALWAYS,
@@ -160,7 +206,7 @@ bool File::Open(const std::filesystem::path& p, OpenMode mode) noexcept {
                                      nullptr);
 #else
             std::string s(p);
-            Filehandle = fopen(s.c_str(), "wb");
+            Filehandle = FdToHandle(OpenFd(s.c_str(), mode));
             if (Filehandle != INVALID_HANDLE_VALUE) {
                 Path = std::move(s);
             }
@@ -176,18 +222,20 @@ bool File::IsOpen() const noexcept {
     return Filehandle != INVALID_HANDLE_VALUE;
 }
 
-void File::Close() noexcept {
+bool File::Close() noexcept {
+    bool success = true;
     if (IsOpen()) {
 #ifdef _MSC_VER
-        CloseHandle(Filehandle);
+        success = CloseHandle(Filehandle) != 0;
 #else
-        fclose((FILE*)Filehandle);
+        success = close(HandleToFd(Filehandle)) == 0;
 #endif
         Filehandle = INVALID_HANDLE_VALUE;
 #ifndef _MSC_VER
         Path.clear();
 #endif
     }
+    return success;
 }
 
 std::optional<uint64_t> File::GetPosition() noexcept {
@@ -200,7 +248,7 @@ std::optional<uint64_t> File::GetPosition() noexcept {
         return static_cast<uint64_t>(position.QuadPart);
     }
 #else
-    off_t offset = ftello((FILE*)Filehandle);
+    off_t offset = lseek(HandleToFd(Filehandle), 0, SEEK_CUR);
     if (offset >= 0) {
         return static_cast<uint64_t>(offset);
     }
@@ -238,8 +286,8 @@ bool File::SetPosition(int64_t position, SetPositionMode mode) noexcept {
         case SetPositionMode::End: origin = SEEK_END; break;
         default: return false;
     }
-    int result = fseeko((FILE*)Filehandle, (off_t)position, origin);
-    if (result == 0) {
+    off_t result = lseek(HandleToFd(Filehandle), (off_t)position, origin);
+    if (result >= 0) {
         return true;
     }
 #endif
@@ -254,6 +302,15 @@ std::optional<uint64_t> File::GetLength() noexcept {
         return static_cast<uint64_t>(size.QuadPart);
     }
 #else
+    struct stat buf {};
+    if (fstat(HandleToFd(Filehandle), &buf) != 0) {
+        return std::nullopt;
+    }
+    if (S_ISREG(buf.st_mode)) {
+        return static_cast<uint64_t>(buf.st_size);
+    }
+
+    // block devices report no size in fstat(), but can seek to their end; pipes can't do either
     auto oldPos = GetPosition();
     if (!oldPos) {
         return std::nullopt;
@@ -285,7 +342,14 @@ size_t File::Read(void* data, size_t length) noexcept {
             return totalRead;
         }
 #else
-        blockRead = (DWORD)fread(buffer, 1, blockSize, (FILE*)Filehandle);
+        const ssize_t result = read(HandleToFd(Filehandle), buffer, blockSize);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return totalRead;
+        }
+        blockRead = static_cast<DWORD>(result);
 #endif
         if (blockRead == 0) {
             return totalRead;
@@ -312,7 +376,14 @@ size_t File::Write(const void* data, size_t length) noexcept {
             return totalWritten;
         }
 #else
-        blockWritten = (DWORD)fwrite(buffer, 1, blockSize, (FILE*)Filehandle);
+        const ssize_t result = write(HandleToFd(Filehandle), buffer, blockSize);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return totalWritten;
+        }
+        blockWritten = static_cast<DWORD>(result);
 #endif
         if (blockWritten == 0) {
             return totalWritten;
@@ -325,6 +396,158 @@ size_t File::Write(const void* data, size_t length) noexcept {
     return totalWritten;
 }
 
+size_t File::ReadAt(void* data, size_t length, uint64_t offset) noexcept {
+    assert(IsOpen());
+
+    char* buffer = static_cast<char*>(data);
+    size_t totalRead = 0;
+    size_t rest = length;
+    while (rest > 0) {
+        DWORD blockSize = rest > 0xffff'0000 ? 0xffff'0000 : static_cast<DWORD>(rest);
+        DWORD blockRead = 0;
+#ifdef _MSC_VER
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset & 0xffff'ffffu);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        if (ReadFile(Filehandle, buffer, blockSize, &blockRead, &overlapped) == 0) {
+            return totalRead;
+        }
+#else
+        const ssize_t result =
+            pread(HandleToFd(Filehandle), buffer, blockSize, static_cast<off_t>(offset));
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return totalRead;
+        }
+        blockRead = static_cast<DWORD>(result);
+#endif
+        if (blockRead == 0) {
+            return totalRead;
+        }
+
+        rest -= blockRead;
+        totalRead += blockRead;
+        buffer += blockRead;
+        offset += blockRead;
+    }
+    return totalRead;
+}
+
+size_t File::WriteAt(const void* data, size_t length, uint64_t offset) noexcept {
+    assert(IsOpen());
+
+    const char* buffer = static_cast<const char*>(data);
+    size_t totalWritten = 0;
+    size_t rest = length;
+    while (rest > 0) {
+        DWORD blockSize = rest > 0xffff'0000 ? 0xffff'0000 : static_cast<DWORD>(rest);
+        DWORD blockWritten = 0;
+#ifdef _MSC_VER
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset & 0xffff'ffffu);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        if (WriteFile(Filehandle, buffer, blockSize, &blockWritten, &overlapped) == 0) {
+            return totalWritten;
+        }
+#else
+        const ssize_t result =
+            pwrite(HandleToFd(Filehandle), buffer, blockSize, static_cast<off_t>(offset));
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return totalWritten;
+        }
+        blockWritten = static_cast<DWORD>(result);
+#endif
+        if (blockWritten == 0) {
+            return totalWritten;
+        }
+
+        rest -= blockWritten;
+        totalWritten += blockWritten;
+        buffer += blockWritten;
+        offset += blockWritten;
+    }
+    return totalWritten;
+}
+
+void File::Advise(AccessHint hint) noexcept {
+    assert(IsOpen());
+
+#ifdef _MSC_VER
+    // Windows only takes access hints when the file is opened
+    (void)hint;
+#else
+    const int fd = HandleToFd(Filehandle);
+    if (hint == AccessHint::Sequential) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    } else {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+    }
+#endif
+}
+
+uint64_t File::CopyFrom(File& source, uint64_t offset, uint64_t length) noexcept {
+    assert(IsOpen());
+    assert(source.IsOpen());
+
+    uint64_t totalCopied = 0;
+#ifdef __linux__
+    const int in = HandleToFd(source.Filehandle);
+    const int out = HandleToFd(Filehandle);
+    off_t inOffset = static_cast<off_t>(offset);
+
+    // copy_file_range() only works between regular files, and before Linux 5.19 only within one
+    // filesystem; sendfile() handles most other cases, such as writing to a pipe
+    bool useCopyFileRange = true;
+    while (totalCopied < length) {
+        const size_t blockSize =
+            static_cast<size_t>(std::min<uint64_t>(length - totalCopied, 1 << 30));
+        const ssize_t copied = useCopyFileRange
+                                   ? copy_file_range(in, &inOffset, out, nullptr, blockSize, 0)
+                                   : sendfile(out, in, &inOffset, blockSize);
+        if (copied < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (useCopyFileRange && totalCopied == 0
+                && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+                useCopyFileRange = false;
+                continue;
+            }
+            break;
+        }
+        if (copied == 0) {
+            break;
+        }
+        totalCopied += static_cast<uint64_t>(copied);
+    }
+    if (totalCopied != 0 || length == 0) {
+        return totalCopied;
+    }
+#endif
+
+    // plain read/write fallback
+    char buffer[64 * 1024];
+    while (totalCopied < length) {
+        const size_t blockSize =
+            static_cast<size_t>(std::min<uint64_t>(length - totalCopied, sizeof(buffer)));
+        const size_t read = source.ReadAt(buffer, blockSize, offset + totalCopied);
+        if (read == 0) {
+            break;
+        }
+        if (Write(buffer, read) != read) {
+            break;
+        }
+        totalCopied += read;
+    }
+    return totalCopied;
+}
+
 bool File::Delete() noexcept {
     assert(IsOpen());
 
@@ -419,6 +642,195 @@ void* File::ReleaseHandle() noexcept {
     return h;
 }
 
+std::optional<FileView> File::Map(AccessHint hint) noexcept {
+    assert(IsOpen());
+
+    FileView view;
+#ifdef _MSC_VER
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(Filehandle, &size) == 0) {
+        return std::nullopt;
+    }
+    if (static_cast<uint64_t>(size.QuadPart) > SIZE_MAX) {
+        return std::nullopt;
+    }
+    view.Length = static_cast<size_t>(size.QuadPart);
+    if (view.Length == 0) {
+        // mapping an empty file is an error on Windows
+        return view;
+    }
+    view.MappingHandle = CreateFileMappingW(Filehandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (view.MappingHandle == nullptr) {
+        return std::nullopt;
+    }
+    view.Address = static_cast<char*>(MapViewOfFile(view.MappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (view.Address == nullptr) {
+        return std::nullopt;
+    }
+    // the hint is only a performance hint; Windows reads ahead on sequential faults by itself
+    (void)hint;
+#else
+    const int fd = HandleToFd(Filehandle);
+    struct stat buf {};
+    if (fstat(fd, &buf) != 0 || !S_ISREG(buf.st_mode)) {
+        return std::nullopt;
+    }
+    if (static_cast<uint64_t>(buf.st_size) > SIZE_MAX) {
+        return std::nullopt;
+    }
+    view.Length = static_cast<size_t>(buf.st_size);
+    if (view.Length == 0) {
+        // mmap() rejects a length of 0
+        return view;
+    }
+    void* address = mmap(nullptr, view.Length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+        return std::nullopt;
+    }
+    view.Address = static_cast<char*>(address);
+    if (hint == AccessHint::Sequential) {
+        madvise(address, view.Length, MADV_SEQUENTIAL);
+        madvise(address, view.Length, MADV_WILLNEED);
+    } else {
+        madvise(address, view.Length, MADV_RANDOM);
+    }
+#endif
+    return view;
+}
+
+std::optional<FileView> File::MapWritable(uint64_t length) noexcept {
+    assert(IsOpen());
+
+    if (length > SIZE_MAX) {
+        return std::nullopt;
+    }
+    FileView view;
+#ifdef _MSC_VER
+    LARGE_INTEGER size;
+    size.QuadPart = static_cast<LONGLONG>(length);
+    if (SetFilePointerEx(Filehandle, size, nullptr, FILE_BEGIN) == 0
+        || SetEndOfFile(Filehandle) == 0) {
+        return std::nullopt;
+    }
+    view.Length = static_cast<size_t>(length);
+    if (view.Length == 0) {
+        return view;
+    }
+    view.MappingHandle = CreateFileMappingW(Filehandle,
+                                            nullptr,
+                                            PAGE_READWRITE,
+                                            static_cast<DWORD>(length >> 32),
+                                            static_cast<DWORD>(length & 0xffff'ffffu),
+                                            nullptr);
+    if (view.MappingHandle == nullptr) {
+        return std::nullopt;
+    }
+    view.Address = static_cast<char*>(MapViewOfFile(view.MappingHandle, FILE_MAP_WRITE, 0, 0, 0));
+    if (view.Address == nullptr) {
+        return std::nullopt;
+    }
+#else
+    const int fd = HandleToFd(Filehandle);
+    struct stat buf {};
+    if (fstat(fd, &buf) != 0 || !S_ISREG(buf.st_mode)) {
+        return std::nullopt;
+    }
+    // Reserve the blocks now: running out of disk space while writing through a mapping raises
+    // SIGBUS instead of returning an error.
+#ifdef __linux__
+    if (length > 0 && fallocate(fd, 0, 0, static_cast<off_t>(length)) != 0) {
+        if (errno != EOPNOTSUPP || ftruncate(fd, static_cast<off_t>(length)) != 0) {
+            return std::nullopt;
+        }
+    }
+#else
+    if (ftruncate(fd, static_cast<off_t>(length)) != 0) {
+        return std::nullopt;
+    }
+#endif
+    view.Length = static_cast<size_t>(length);
+    if (view.Length == 0) {
+        return view;
+    }
+    void* address = mmap(nullptr, view.Length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+        return std::nullopt;
+    }
+    view.Address = static_cast<char*>(address);
+#endif
+    return view;
+}
+
+FileView::FileView() noexcept
+  : Address(nullptr)
+  , Length(0)
+#ifdef _MSC_VER
+  , MappingHandle(nullptr)
+#endif
+{
+}
+
+FileView::FileView(FileView&& other) noexcept
+  : Address(other.Address)
+  , Length(other.Length)
+#ifdef _MSC_VER
+  , MappingHandle(other.MappingHandle)
+#endif
+{
+    other.Address = nullptr;
+    other.Length = 0;
+#ifdef _MSC_VER
+    other.MappingHandle = nullptr;
+#endif
+}
+
+FileView& FileView::operator=(FileView&& other) noexcept {
+    Unmap();
+    Address = other.Address;
+    Length = other.Length;
+    other.Address = nullptr;
+    other.Length = 0;
+#ifdef _MSC_VER
+    MappingHandle = other.MappingHandle;
+    other.MappingHandle = nullptr;
+#endif
+    return *this;
+}
+
+FileView::~FileView() noexcept {
+    Unmap();
+}
+
+const char* FileView::Data() const noexcept {
+    return Address;
+}
+
+size_t FileView::Size() const noexcept {
+    return Length;
+}
+
+char* FileView::WritableData() const noexcept {
+    return Address;
+}
+
+void FileView::Unmap() noexcept {
+#ifdef _MSC_VER
+    if (Address != nullptr) {
+        UnmapViewOfFile(Address);
+    }
+    if (MappingHandle != nullptr) {
+        CloseHandle(MappingHandle);
+        MappingHandle = nullptr;
+    }
+#else
+    if (Address != nullptr) {
+        munmap(Address, Length);
+    }
+#endif
+    Address = nullptr;
+    Length = 0;
+}
+
 #ifdef _MSC_VER
 static bool FileExistsWindows(const wchar_t* path) {
     const auto attributes = GetFileAttributesW(path);
@@ -509,18 +921,24 @@ bool DirectoryExists(const std::filesystem::path& p) noexcept {
 
 #ifdef _MSC_VER
 static bool CreateDirectoryWindows(const wchar_t* path) {
-    return CreateDirectoryW(path, nullptr);
+    // Same as on Linux, an existing directory counts as success. Drive roots fail with
+    // ERROR_ACCESS_DENIED rather than ERROR_ALREADY_EXISTS, so check for the directory on both.
+    if (CreateDirectoryW(path, nullptr)) {
+        return true;
+    }
+    const DWORD error = GetLastError();
+    return (error == ERROR_ALREADY_EXISTS || error == ERROR_ACCESS_DENIED)
+           && DirectoryExistsWindows(path);
 }
 #else
 static bool CreateDirectoryLinux(const char* path) {
-    if (DirectoryExistsLinux(path)) {
-        return true;
-    }
+    // creating first saves the stat() for new directories; only if something is already there do
+    // we need to check whether it's a directory
     int result = mkdir(path, S_IRWXU | S_IRWXG | S_IRWXO);
     if (result == 0) {
         return true;
     }
-    return false;
+    return errno == EEXIST && DirectoryExistsLinux(path);
 }
 #endif
 
@@ -547,4 +965,116 @@ bool CreateDirectory(const std::filesystem::path& p) noexcept {
 }
 #endif
 
+#ifdef _MSC_VER
+static bool CopyFileWindows(const wchar_t* source, const wchar_t* target) {
+    return CopyFileW(source, target, FALSE) != 0;
+}
+#else
+static bool CopyFileLinux(const char* source, const char* target) {
+    const int in = open(source, O_RDONLY | O_CLOEXEC);
+    if (in == -1) {
+        return false;
+    }
+    struct stat buf {};
+    if (fstat(in, &buf) != 0) {
+        close(in);
+        return false;
+    }
+    const int out = open(target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (out == -1) {
+        close(in);
+        return false;
+    }
+
+    bool success = false;
+    off_t remaining = buf.st_size;
+#ifdef __linux__
+    if (ioctl(out, FICLONE, in) == 0) {
+        success = true;
+    } else {
+        // not a reflink-capable filesystem (or across filesystems), let the kernel copy instead
+        while (remaining > 0) {
+            const ssize_t copied =
+                copy_file_range(in, nullptr, out, nullptr, static_cast<size_t>(remaining), 0);
+            if (copied <= 0) {
+                break;
+            }
+            remaining -= copied;
+        }
+        success = remaining == 0;
+        if (!success) {
+            if (lseek(in, 0, SEEK_SET) != 0 || lseek(out, 0, SEEK_SET) != 0
+                || ftruncate(out, 0) != 0) {
+                close(in);
+                close(out);
+                return false;
+            }
+            remaining = buf.st_size;
+        }
+    }
+#endif
+
+    // plain read/write fallback
+    if (!success) {
+        char buffer[64 * 1024];
+        while (remaining > 0) {
+            const ssize_t r = read(in, buffer, sizeof(buffer));
+            if (r < 0 && errno == EINTR) {
+                continue;
+            }
+            if (r <= 0) {
+                break;
+            }
+            ssize_t written = 0;
+            while (written < r) {
+                const ssize_t w = write(out, buffer + written, static_cast<size_t>(r - written));
+                if (w < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (w <= 0) {
+                    break;
+                }
+                written += w;
+            }
+            if (written != r) {
+                break;
+            }
+            remaining -= r;
+        }
+        success = remaining == 0;
+    }
+
+    close(in);
+    if (close(out) != 0) {
+        success = false;
+    }
+    return success;
+}
+#endif
+
+bool CopyFile(std::string_view source, std::string_view target) noexcept {
+#ifdef _MSC_VER
+    auto wsource = HyoutaUtils::TextUtils::Utf8ToWString(source.data(), source.size());
+    auto wtarget = HyoutaUtils::TextUtils::Utf8ToWString(target.data(), target.size());
+    if (!wsource || !wtarget) {
+        return false;
+    }
+    return CopyFileWindows(wsource->data(), wtarget->data());
+#else
+    std::string s(source);
+    std::string t(target);
+    return CopyFileLinux(s.c_str(), t.c_str());
+#endif
+}
+
+#ifdef FILE_WRAPPER_WITH_STD_FILESYSTEM
+bool CopyFile(const std::filesystem::path& source, const std::filesystem::path& target) noexcept {
+#ifdef _MSC_VER
+    return CopyFileWindows(source.native().data(), target.native().data());
+#else
+    return CopyFileLinux(source.c_str(), target.c_str());
+#endif
+}
+#endif
+
 } // namespace HyoutaUtils::IO
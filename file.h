@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <optional>
 #include <string_view>
@@ -16,6 +17,8 @@ namespace HyoutaUtils::IO {
 enum class OpenMode {
     Read,
     Write,
+    // Like Write, but the file can also be read back, which File::MapWritable() needs.
+    ReadWrite,
 };
 enum class SetPositionMode {
     Begin = 0,
@@ -23,6 +26,43 @@ enum class SetPositionMode {
     End = 2,
 };
 
+enum class AccessHint {
+    // The data will be read once from front to back: read ahead aggressively, and start reading in
+    // the whole file right away.
+    Sequential,
+    // Scattered accesses, such as looking up entries in an archive: don't read ahead.
+    Random,
+};
+
+// View of a file's contents mapped into memory, see File::Map() and File::MapWritable(). Stays
+// valid after the File it was created from is closed.
+struct FileView {
+public:
+    FileView() noexcept;
+    FileView(const FileView& other) = delete;
+    FileView(FileView&& other) noexcept;
+    FileView& operator=(const FileView& other) = delete;
+    FileView& operator=(FileView&& other) noexcept;
+    ~FileView() noexcept;
+
+    const char* Data() const noexcept;
+    size_t Size() const noexcept;
+
+    // Only for views created by MapWritable(); writes through this go straight to the file.
+    char* WritableData() const noexcept;
+
+    void Unmap() noexcept;
+
+private:
+    friend struct File;
+
+    char* Address;
+    size_t Length;
+#ifdef _MSC_VER
+    void* MappingHandle;
+#endif
+};
+
 struct File {
 public:
     File() noexcept;
@@ -35,16 +75,42 @@ public:
 
     bool Open(std::string_view p, OpenMode mode) noexcept;
     bool IsOpen() const noexcept;
-    void Close() noexcept;
+
+    // Returns false if the system reports an error on closing. For a file that was written to,
+    // that can be a write error it had deferred until now, eg. running out of space.
+    bool Close() noexcept;
     std::optional<uint64_t> GetPosition() noexcept;
     bool SetPosition(uint64_t position) noexcept;
     bool SetPosition(int64_t position, SetPositionMode mode) noexcept;
     std::optional<uint64_t> GetLength() noexcept;
     size_t Read(void* data, size_t length) noexcept;
     size_t Write(const void* data, size_t length) noexcept;
+
+    // Positional I/O that neither uses nor moves the current position on POSIX systems, so
+    // multiple threads can read or write different parts of the same File concurrently. On Windows
+    // the position is moved, but each call is still independent of it.
+    size_t ReadAt(void* data, size_t length, uint64_t offset) noexcept;
+    size_t WriteAt(const void* data, size_t length, uint64_t offset) noexcept;
+
+    // Copies 'length' bytes from 'source', starting at 'offset', to the current position of this
+    // file. On Linux the kernel copies the data directly, without it passing through this process.
+    // Returns the amount of bytes copied.
+    uint64_t CopyFrom(File& source, uint64_t offset, uint64_t length) noexcept;
+
+    // Tells the system how the file is going to be accessed, so it can tune its read-ahead.
+    void Advise(AccessHint hint) noexcept;
     bool Delete() noexcept;
     bool Rename(std::string_view p) noexcept;
 
+    // Maps the whole file read-only, so it can be processed without copying it into a buffer first.
+    // Fails for files that can't be mapped, such as pipes; fall back to Read() for those.
+    std::optional<FileView> Map(AccessHint hint = AccessHint::Sequential) noexcept;
+
+    // Sets the length of the file to 'length', allocating its disk space up front where the
+    // filesystem supports that, and maps it writable. The file has to be opened with
+    // OpenMode::ReadWrite. Don't mix writes through the view with Write().
+    std::optional<FileView> MapWritable(uint64_t length) noexcept;
+
     void* ReleaseHandle() noexcept;
 
 #ifdef FILE_WRAPPER_WITH_STD_FILESYSTEM
@@ -64,6 +130,7 @@ private:
     explicit File(void* handle) noexcept;
 #endif
 
+    // a HANDLE on Windows, the file descriptor cast to a pointer elsewhere
     void* Filehandle;
 
 #ifndef _MSC_VER
@@ -75,9 +142,15 @@ bool FileExists(std::string_view p) noexcept;
 bool DirectoryExists(std::string_view p) noexcept;
 bool CreateDirectory(std::string_view p) noexcept;
 
+// Copies the file at 'source' to 'target', replacing 'target' if it exists. Where the filesystem
+// supports it the copy shares its data blocks with the source (reflink) instead of duplicating
+// them, otherwise the data is copied in the kernel if possible.
+bool CopyFile(std::string_view source, std::string_view target) noexcept;
+
 #ifdef FILE_WRAPPER_WITH_STD_FILESYSTEM
 bool FileExists(const std::filesystem::path& p) noexcept;
 bool DirectoryExists(const std::filesystem::path& p) noexcept;
-bool CreateDirectory(std::string_view p) noexcept;
+bool CreateDirectory(const std::filesystem::path& p) noexcept;
+bool CopyFile(const std::filesystem::path& source, const std::filesystem::path& target) noexcept;
 #endif
 } // namespace HyoutaUtils::IO
@@ -0,0 +1,420 @@
+#include "gen_corpus.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file.h"
+#include "header.h"
+#include "json.h"
+
+static void AddHistogram(std::vector<CorpusProfile::Bucket>& buckets,
+                         const HyoutaUtils::Json::Value* histogram,
+                         uint32_t minValue,
+                         uint32_t maxValue) {
+    if (histogram == nullptr || !histogram->IsArray()) {
+        return;
+    }
+    for (const auto& entry : histogram->GetArray()) {
+        if (!entry.IsArray() || entry.GetArray().size() != 3) {
+            continue;
+        }
+        const auto& e = entry.GetArray();
+        const double low = std::clamp(e[0].GetNumber(), double(minValue), double(maxValue));
+        const double high = std::clamp(e[1].GetNumber(), low, double(maxValue));
+        const double weight = e[2].GetNumber();
+        if (weight > 0.0) {
+            buckets.push_back(CorpusProfile::Bucket{
+                static_cast<uint32_t>(low), static_cast<uint32_t>(high), weight});
+        }
+    }
+}
+
+static double TokenCount(const HyoutaUtils::Json::Value& stats, std::string_view name) {
+    const auto* type = stats.Find(name);
+    if (type == nullptr) {
+        return 0.0;
+    }
+    return type->GetNumber("count", 0.0);
+}
+
+std::optional<CorpusProfile> parse_corpus_profile(const HyoutaUtils::Json::Value& root) {
+    // accept both the full 'topdec stats --json' output and just its 'total' object
+    const HyoutaUtils::Json::Value* stats = root.Find("total");
+    if (stats == nullptr) {
+        stats = &root;
+    }
+    if (!stats->IsObject()) {
+        return std::nullopt;
+    }
+
+    CorpusProfile profile;
+    profile.LiteralWeight = TokenCount(*stats, "literals");
+    profile.RunWeight = TokenCount(*stats, "runs");
+    profile.MatchWeight = TokenCount(*stats, "backrefs") + TokenCount(*stats, "dictrefs");
+    if (profile.LiteralWeight + profile.RunWeight + profile.MatchWeight <= 0.0) {
+        return std::nullopt;
+    }
+
+    AddHistogram(profile.MatchLengths, stats->Find("backref_lengths"), 3, 18);
+    AddHistogram(profile.MatchLengths, stats->Find("dictref_lengths"), 3, 18);
+    AddHistogram(profile.MatchOffsets, stats->Find("backref_offsets"), 1, 4095);
+    AddHistogram(profile.MatchOffsets, stats->Find("dictref_distances"), 1, 4095);
+    AddHistogram(profile.RunLengths, stats->Find("run_lengths"), 4, 274);
+    if (profile.MatchLengths.empty()) {
+        profile.MatchLengths.push_back(CorpusProfile::Bucket{3, 18, 1.0});
+    }
+    if (profile.MatchOffsets.empty()) {
+        profile.MatchOffsets.push_back(CorpusProfile::Bucket{1, 4095, 1.0});
+    }
+    if (profile.RunLengths.empty()) {
+        profile.RunLengths.push_back(CorpusProfile::Bucket{4, 18, 1.0});
+    }
+
+    profile.ShiftJisFraction = std::clamp(stats->GetNumber("sjis_fraction", 0.0), 0.0, 1.0);
+    const double files = stats->GetNumber("files", 0.0);
+    const double bytes = stats->GetNumber("uncompressed_bytes", 0.0);
+    if (files > 0.0 && bytes > 0.0) {
+        profile.AverageFileSize = static_cast<uint64_t>(bytes / files);
+    }
+    return profile;
+}
+
+namespace {
+struct BucketSampler {
+    const std::vector<CorpusProfile::Bucket>& Buckets;
+    std::discrete_distribution<size_t> Distribution;
+
+    explicit BucketSampler(const std::vector<CorpusProfile::Bucket>& buckets)
+      : Buckets(buckets), Distribution(MakeDistribution(buckets)) {}
+
+    static std::discrete_distribution<size_t>
+        MakeDistribution(const std::vector<CorpusProfile::Bucket>& buckets) {
+        std::vector<double> weights;
+        for (const auto& b : buckets) {
+            weights.push_back(b.Weight);
+        }
+        return std::discrete_distribution<size_t>(weights.begin(), weights.end());
+    }
+
+    uint32_t Sample(std::mt19937_64& rng) {
+        const auto& b = Buckets[Distribution(rng)];
+        return std::uniform_int_distribution<uint32_t>(b.Low, b.High)(rng);
+    }
+};
+} // namespace
+
+static void AppendLiteralCharacter(double shiftJisFraction,
+                                   size_t size,
+                                   std::mt19937_64& rng,
+                                   std::vector<char>& uncompressed,
+                                   std::vector<CorpusToken>& tokens) {
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    if (uncompressed.size() + 2 <= size && chance(rng) < shiftJisFraction) {
+        // mostly hiragana, with some kanji mixed in
+        uint8_t lead;
+        uint8_t trail;
+        if (chance(rng) < 0.6) {
+            lead = 0x82;
+            trail = static_cast<uint8_t>(std::uniform_int_distribution<int>(0x9f, 0xf1)(rng));
+        } else {
+            lead = static_cast<uint8_t>(std::uniform_int_distribution<int>(0x88, 0x9f)(rng));
+            trail = static_cast<uint8_t>(std::uniform_int_distribution<int>(0x40, 0xfc)(rng));
+            if (trail == 0x7f) {
+                trail = 0x80;
+            }
+        }
+        uncompressed.push_back(static_cast<char>(lead));
+        uncompressed.push_back(static_cast<char>(trail));
+        tokens.push_back(CorpusToken{CorpusTokenKind::Literal, 1, 0});
+        tokens.push_back(CorpusToken{CorpusTokenKind::Literal, 1, 0});
+        return;
+    }
+
+    const int c = chance(rng) < 0.95 ? std::uniform_int_distribution<int>(0x20, 0x7e)(rng)
+                                     : std::uniform_int_distribution<int>(0, 0xff)(rng);
+    uncompressed.push_back(static_cast<char>(c));
+    tokens.push_back(CorpusToken{CorpusTokenKind::Literal, 1, 0});
+}
+
+void generate_corpus_file(const CorpusProfile& profile,
+                          size_t size,
+                          std::mt19937_64& rng,
+                          std::vector<char>& uncompressed,
+                          std::vector<CorpusToken>& tokens) {
+    uncompressed.clear();
+    tokens.clear();
+    uncompressed.reserve(size);
+
+    std::discrete_distribution<int> kinds(
+        {profile.LiteralWeight, profile.RunWeight, profile.MatchWeight});
+    BucketSampler matchLengths(profile.MatchLengths);
+    BucketSampler matchOffsets(profile.MatchOffsets);
+    BucketSampler runLengths(profile.RunLengths);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    while (uncompressed.size() < size) {
+        const size_t remaining = size - uncompressed.size();
+        const auto kind = static_cast<CorpusTokenKind>(kinds(rng));
+        if (kind == CorpusTokenKind::Run) {
+            const size_t count = std::min<size_t>(runLengths.Sample(rng), remaining);
+            if (count >= 4) {
+                const int c =
+                    chance(rng) < 0.5 ? 0 : std::uniform_int_distribution<int>(0, 0xff)(rng);
+                uncompressed.insert(uncompressed.end(), count, static_cast<char>(c));
+                tokens.push_back(
+                    CorpusToken{CorpusTokenKind::Run, static_cast<uint16_t>(count), 0});
+                continue;
+            }
+        } else if (kind == CorpusTokenKind::Match && !uncompressed.empty()) {
+            const size_t count = std::min<size_t>(matchLengths.Sample(rng), remaining);
+            const size_t maxOffset = std::min<size_t>(uncompressed.size(), 4095);
+            size_t offset = matchOffsets.Sample(rng);
+            if (offset > maxOffset) {
+                offset = std::uniform_int_distribution<size_t>(1, maxOffset)(rng);
+            }
+            if (count >= 3) {
+                // byte by byte, since the source may overlap with what's being written
+                const size_t start = uncompressed.size() - offset;
+                for (size_t i = 0; i < count; ++i) {
+                    uncompressed.push_back(uncompressed[start + i]);
+                }
+                tokens.push_back(CorpusToken{CorpusTokenKind::Match,
+                                             static_cast<uint16_t>(count),
+                                             static_cast<uint16_t>(offset)});
+                continue;
+            }
+        }
+
+        AppendLiteralCharacter(profile.ShiftJisFraction, size, rng, uncompressed, tokens);
+    }
+}
+
+size_t encode_corpus_tokens_bound(size_t uncompressedLength) {
+    // worst case is a literal per byte plus one flag byte per 8 tokens
+    return uncompressedLength + (uncompressedLength / 8) + 1;
+}
+
+size_t encode_corpus_tokens(const std::vector<CorpusToken>& tokens,
+                            const char* uncompressed,
+                            uint8_t type,
+                            char* compressed) {
+    const bool hasDict = (type & 0x80) == 0;
+    const bool hasMultiByte = (type & 0x02) != 0;
+    const size_t maxMatchLength = hasMultiByte ? 17 : 18;
+    const size_t dictStart = hasMultiByte ? 0xfef : 0xfee;
+
+    size_t in = 0;
+    size_t out = 0;
+    int bitsWritten = 0;
+    size_t flagPosition = 0;
+
+    const auto write_flag = [&](int isLiteral) -> void {
+        if (bitsWritten == 0) {
+            compressed[in] = 0;
+            flagPosition = in;
+            ++in;
+        }
+        compressed[flagPosition] |= static_cast<char>(isLiteral << bitsWritten);
+        bitsWritten = (bitsWritten + 1) & 7;
+    };
+    const auto write_literal = [&]() -> void {
+        write_flag(1);
+        compressed[in] = uncompressed[out];
+        ++in;
+        ++out;
+    };
+    const auto write_match = [&](size_t count, size_t offset) -> void {
+        write_flag(0);
+        if (hasDict) {
+            const size_t dictPosition = (dictStart + out - offset) & 0xfff;
+            compressed[in] = static_cast<char>(dictPosition & 0xff);
+            compressed[in + 1] = static_cast<char>(((dictPosition >> 8) << 4) | (count - 3));
+        } else {
+            compressed[in] = static_cast<char>(offset & 0xff);
+            compressed[in + 1] = static_cast<char>(((offset >> 8) & 0xf) | ((count - 3) << 4));
+        }
+        in += 2;
+        out += count;
+    };
+    const auto write_split_match = [&](size_t count, size_t offset) -> void {
+        while (count >= 3) {
+            const size_t length = std::min(count, maxMatchLength);
+            write_match(length, offset);
+            count -= length;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            write_literal();
+        }
+    };
+
+    for (const auto& token : tokens) {
+        switch (token.Kind) {
+            case CorpusTokenKind::Literal: write_literal(); break;
+            case CorpusTokenKind::Match: write_split_match(token.Count, token.Offset); break;
+            case CorpusTokenKind::Run: {
+                if (!hasMultiByte) {
+                    // a literal followed by copies of itself
+                    write_literal();
+                    write_split_match(token.Count - 1u, 1);
+                    break;
+                }
+                write_flag(0);
+                const char c = uncompressed[out];
+                if (token.Count <= 18) {
+                    compressed[in] = c;
+                    compressed[in + 1] = static_cast<char>(
+                        hasDict ? (0x0f | ((token.Count - 3) << 4)) : (0xf0 | (token.Count - 3)));
+                    in += 2;
+                } else {
+                    compressed[in] = static_cast<char>(token.Count - 19);
+                    compressed[in + 1] = static_cast<char>(hasDict ? 0x0f : 0xf0);
+                    compressed[in + 2] = c;
+                    in += 3;
+                }
+                out += token.Count;
+                break;
+            }
+        }
+    }
+
+    return in;
+}
+
+static bool ReadFile(const std::filesystem::path& path, std::vector<char>& data) {
+    HyoutaUtils::IO::File infile(path, HyoutaUtils::IO::OpenMode::Read);
+    if (!infile.IsOpen()) {
+        return false;
+    }
+    const auto length = infile.GetLength();
+    if (!length) {
+        return false;
+    }
+    data.resize(*length);
+    return infile.Read(data.data(), data.size()) == data.size();
+}
+
+static bool WriteFile(const std::filesystem::path& path, const char* data, size_t length) {
+    HyoutaUtils::IO::File outfile(path, HyoutaUtils::IO::OpenMode::Write);
+    if (!outfile.IsOpen()) {
+        return false;
+    }
+    return outfile.Write(data, length) == length;
+}
+
+static void PrintGenCorpusUsage() {
+    printf(
+        "Usage for synthetic corpus generation:\n"
+        "  topdec gen-corpus [options] (path to 'topdec stats --json' output) (output directory)\n"
+        "  Writes NNNNN.bin with the uncompressed data and NNNNN.01/.03/.81/.83 with the\n"
+        "  matching compressed files.\n"
+        "  Options are:\n"
+        "    --files N (defaults to 16)\n"
+        "    --size N (uncompressed bytes per file, defaults to the average in the profile)\n"
+        "    --seed N (defaults to 0)\n");
+}
+
+int GenCorpusMain(int argc, char** argv) {
+    size_t fileCount = 16;
+    size_t fileSize = 0;
+    uint64_t seed = 0;
+    int idx = 2;
+    while (idx < argc) {
+        const bool hasValue = (idx + 1) < argc;
+        if (strcmp("--files", argv[idx]) == 0 && hasValue) {
+            fileCount = static_cast<size_t>(strtoull(argv[idx + 1], nullptr, 10));
+            idx += 2;
+            continue;
+        }
+        if (strcmp("--size", argv[idx]) == 0 && hasValue) {
+            fileSize = static_cast<size_t>(strtoull(argv[idx + 1], nullptr, 10));
+            idx += 2;
+            continue;
+        }
+        if (strcmp("--seed", argv[idx]) == 0 && hasValue) {
+            seed = strtoull(argv[idx + 1], nullptr, 10);
+            idx += 2;
+            continue;
+        }
+
+        break;
+    }
+    if (argc - idx != 2) {
+        PrintGenCorpusUsage();
+        return -1;
+    }
+
+    std::vector<char> profileData;
+    if (!ReadFile(std::filesystem::path(argv[idx]), profileData)) {
+        printf("failed to read profile\n");
+        return -1;
+    }
+    const auto json =
+        HyoutaUtils::Json::Parse(std::string_view(profileData.data(), profileData.size()));
+    if (!json) {
+        printf("failed to parse profile\n");
+        return -1;
+    }
+    const auto profile = parse_corpus_profile(*json);
+    if (!profile) {
+        printf("profile contains no token statistics\n");
+        return -1;
+    }
+    if (fileSize == 0) {
+        fileSize = std::clamp<size_t>(profile->AverageFileSize, 1, 0x100000);
+    }
+
+    const std::filesystem::path outputDirectory(argv[idx + 1]);
+    if (!HyoutaUtils::IO::CreateDirectory(outputDirectory)) {
+        printf("failed to create output directory\n");
+        return -1;
+    }
+
+    std::mt19937_64 rng(seed);
+    std::vector<char> uncompressed;
+    std::vector<CorpusToken> tokens;
+    std::vector<char> compressed;
+    for (size_t i = 0; i < fileCount; ++i) {
+        generate_corpus_file(*profile, fileSize, rng, uncompressed, tokens);
+
+        // room for any size_t: 20 digits and the terminator
+        char name[21];
+        snprintf(name, sizeof(name), "%05zu", i);
+        if (!WriteFile(outputDirectory / (std::string(name) + ".bin"),
+                       uncompressed.data(),
+                       uncompressed.size())) {
+            printf("failed to write output file\n");
+            return -1;
+        }
+
+        for (uint8_t type : {uint8_t(0x01), uint8_t(0x03), uint8_t(0x81), uint8_t(0x83)}) {
+            compressed.resize(compressed_header_size
+                              + encode_corpus_tokens_bound(uncompressed.size()));
+            const size_t compressedSize = encode_corpus_tokens(
+                tokens, uncompressed.data(), type, compressed.data() + compressed_header_size);
+            write_compressed_header(compressed.data(),
+                                    CompressedHeader{type,
+                                                     static_cast<uint32_t>(compressedSize),
+                                                     static_cast<uint32_t>(uncompressed.size())});
+
+            char extension[8];
+            snprintf(extension, sizeof(extension), ".%02x", static_cast<int>(type));
+            if (!WriteFile(outputDirectory / (std::string(name) + extension),
+                           compressed.data(),
+                           compressedSize + compressed_header_size)) {
+                printf("failed to write output file\n");
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
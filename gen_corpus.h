@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "json.h"
+
+// Statistical shape of a set of compressed files, as read from the output of 'topdec stats --json'.
+struct CorpusProfile {
+    struct Bucket {
+        uint32_t Low;
+        uint32_t High;
+        double Weight;
+    };
+
+    double LiteralWeight = 1.0;
+    double RunWeight = 0.0;
+    double MatchWeight = 0.0;
+    std::vector<Bucket> MatchLengths;
+    std::vector<Bucket> MatchOffsets;
+    std::vector<Bucket> RunLengths;
+    double ShiftJisFraction = 0.0;
+    uint64_t AverageFileSize = 0x4000;
+};
+
+enum class CorpusTokenKind : uint8_t {
+    Literal,
+    Run,
+    Match,
+};
+
+// A token as generated, before it is encoded into any specific format. Matches always use the
+// distance back from the current output position, runs their full length.
+struct CorpusToken {
+    CorpusTokenKind Kind;
+    uint16_t Count;
+    uint16_t Offset;
+};
+
+std::optional<CorpusProfile> parse_corpus_profile(const HyoutaUtils::Json::Value& stats);
+
+void generate_corpus_file(const CorpusProfile& profile,
+                          size_t size,
+                          std::mt19937_64& rng,
+                          std::vector<char>& uncompressed,
+                          std::vector<CorpusToken>& tokens);
+
+// Upper bound for the output of encode_corpus_tokens().
+size_t encode_corpus_tokens_bound(size_t uncompressedLength);
+
+// Encodes the tokens into the given compression type (0x01, 0x03, 0x81 or 0x83) without header.
+// Tokens that the format cannot express, such as runs in 01/81, are split into equivalent
+// literals and matches, so every format decodes to the same data.
+size_t encode_corpus_tokens(const std::vector<CorpusToken>& tokens,
+                            const char* uncompressed,
+                            uint8_t type,
+                            char* compressed);
+
+int GenCorpusMain(int argc, char** argv);
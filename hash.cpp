@@ -0,0 +1,95 @@
+#include "hash.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+static constexpr uint64_t Prime1 = 0x9e3779b185ebca87u;
+static constexpr uint64_t Prime2 = 0xc2b2ae3d27d4eb4fu;
+static constexpr uint64_t Prime3 = 0x165667b19e3779f9u;
+static constexpr uint64_t Prime4 = 0x85ebca77c2b2ae63u;
+static constexpr uint64_t Prime5 = 0x27d4eb2f165667c5u;
+
+static uint64_t Read64(const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    if constexpr (std::endian::native == std::endian::big) {
+        v = ((v & 0x00000000000000ffu) << 56) | ((v & 0x000000000000ff00u) << 40)
+            | ((v & 0x0000000000ff0000u) << 24) | ((v & 0x00000000ff000000u) << 8)
+            | ((v & 0x000000ff00000000u) >> 8) | ((v & 0x0000ff0000000000u) >> 24)
+            | ((v & 0x00ff000000000000u) >> 40) | ((v & 0xff00000000000000u) >> 56);
+    }
+    return v;
+}
+
+static uint64_t Read32(const char* p) {
+    return static_cast<uint64_t>(static_cast<uint8_t>(p[0]))
+           | (static_cast<uint64_t>(static_cast<uint8_t>(p[1])) << 8)
+           | (static_cast<uint64_t>(static_cast<uint8_t>(p[2])) << 16)
+           | (static_cast<uint64_t>(static_cast<uint8_t>(p[3])) << 24);
+}
+
+static uint64_t Round(uint64_t acc, uint64_t input) {
+    acc += input * Prime2;
+    acc = std::rotl(acc, 31);
+    return acc * Prime1;
+}
+
+static uint64_t MergeRound(uint64_t acc, uint64_t val) {
+    acc ^= Round(0, val);
+    return acc * Prime1 + Prime4;
+}
+
+uint64_t hash_bytes_64(const char* data, size_t length, uint64_t seed) {
+    const char* p = data;
+    const char* const end = data + length;
+    uint64_t h;
+
+    if (length >= 32) {
+        uint64_t v1 = seed + Prime1 + Prime2;
+        uint64_t v2 = seed + Prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - Prime1;
+        const char* const limit = end - 32;
+        do {
+            v1 = Round(v1, Read64(p));
+            v2 = Round(v2, Read64(p + 8));
+            v3 = Round(v3, Read64(p + 16));
+            v4 = Round(v4, Read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+        h = MergeRound(h, v1);
+        h = MergeRound(h, v2);
+        h = MergeRound(h, v3);
+        h = MergeRound(h, v4);
+    } else {
+        h = seed + Prime5;
+    }
+
+    h += static_cast<uint64_t>(length);
+
+    while (p + 8 <= end) {
+        h ^= Round(0, Read64(p));
+        h = std::rotl(h, 27) * Prime1 + Prime4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= Read32(p) * Prime1;
+        h = std::rotl(h, 23) * Prime2 + Prime3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= static_cast<uint64_t>(static_cast<uint8_t>(*p)) * Prime5;
+        h = std::rotl(h, 11) * Prime1;
+        ++p;
+    }
+
+    h ^= h >> 33;
+    h *= Prime2;
+    h ^= h >> 29;
+    h *= Prime3;
+    h ^= h >> 32;
+    return h;
+}
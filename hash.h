@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Fast non-cryptographic 64-bit hash (XXH64). Good for cache keys and deduplication; not suitable
+// where an attacker could choose colliding inputs.
+uint64_t hash_bytes_64(const char* data, size_t length, uint64_t seed = 0);
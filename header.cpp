@@ -0,0 +1,36 @@
+#include "header.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+static uint32_t ReadUInt32LE(const char* data) {
+    return static_cast<uint32_t>(static_cast<uint8_t>(data[0]))
+           | (static_cast<uint32_t>(static_cast<uint8_t>(data[1])) << 8)
+           | (static_cast<uint32_t>(static_cast<uint8_t>(data[2])) << 16)
+           | (static_cast<uint32_t>(static_cast<uint8_t>(data[3])) << 24);
+}
+
+static void WriteUInt32LE(char* data, uint32_t value) {
+    data[0] = static_cast<char>(value & 0xff);
+    data[1] = static_cast<char>((value >> 8) & 0xff);
+    data[2] = static_cast<char>((value >> 16) & 0xff);
+    data[3] = static_cast<char>((value >> 24) & 0xff);
+}
+
+std::optional<CompressedHeader> parse_compressed_header(const char* data, size_t length) {
+    if (length < compressed_header_size) {
+        return std::nullopt;
+    }
+    CompressedHeader header;
+    header.Type = static_cast<uint8_t>(data[0]);
+    header.CompressedLength = ReadUInt32LE(data + 1);
+    header.UncompressedLength = ReadUInt32LE(data + 5);
+    return header;
+}
+
+void write_compressed_header(char* data, const CompressedHeader& header) {
+    data[0] = static_cast<char>(header.Type);
+    WriteUInt32LE(data + 1, header.CompressedLength);
+    WriteUInt32LE(data + 5, header.UncompressedLength);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// Every compressed file starts with a 9 byte header: the compression type, followed by the
+// compressed and the uncompressed length as 32-bit little endian integers.
+constexpr size_t compressed_header_size = 9;
+
+struct CompressedHeader {
+    uint8_t Type;
+    uint32_t CompressedLength;
+    uint32_t UncompressedLength;
+};
+
+std::optional<CompressedHeader> parse_compressed_header(const char* data, size_t length);
+void write_compressed_header(char* data, const CompressedHeader& header);
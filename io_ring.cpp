@@ -0,0 +1,341 @@
+#include "io_ring.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#ifdef __linux__
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+IoRing::IoRing() noexcept = default;
+
+IoRing::~IoRing() noexcept {
+    Close();
+}
+
+bool IoRing::IsOpen() const noexcept {
+    return RingFd != -1;
+}
+
+#ifdef __linux__
+// The ring indices are shared with the kernel; the kernel's side of them has to be read with
+// acquire and our side published with release semantics.
+static uint32_t LoadAcquire(uint32_t* p) noexcept {
+    return std::atomic_ref<uint32_t>(*p).load(std::memory_order_acquire);
+}
+
+static void StoreRelease(uint32_t* p, uint32_t value) noexcept {
+    std::atomic_ref<uint32_t>(*p).store(value, std::memory_order_release);
+}
+
+template<typename T>
+static T* RingPointer(void* ring, uint32_t offset) noexcept {
+    return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+bool IoRing::Open(uint32_t entries) noexcept {
+    Close();
+
+    io_uring_params params{};
+    const int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+        return false;
+    }
+    RingFd = fd;
+    Entries = params.sq_entries;
+
+    SqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    CqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap) {
+        SqRingSize = CqRingSize = std::max(SqRingSize, CqRingSize);
+    }
+    SqRing = mmap(nullptr,
+                  SqRingSize,
+                  PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE,
+                  RingFd,
+                  IORING_OFF_SQ_RING);
+    if (SqRing == MAP_FAILED) {
+        SqRing = nullptr;
+        Close();
+        return false;
+    }
+    if (singleMmap) {
+        CqRing = SqRing;
+    } else {
+        CqRing = mmap(nullptr,
+                      CqRingSize,
+                      PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE,
+                      RingFd,
+                      IORING_OFF_CQ_RING);
+        if (CqRing == MAP_FAILED) {
+            CqRing = nullptr;
+            Close();
+            return false;
+        }
+    }
+    SqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    Sqes = mmap(nullptr,
+                SqesSize,
+                PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE,
+                RingFd,
+                IORING_OFF_SQES);
+    if (Sqes == MAP_FAILED) {
+        Sqes = nullptr;
+        Close();
+        return false;
+    }
+
+    SqHead = RingPointer<uint32_t>(SqRing, params.sq_off.head);
+    SqTail = RingPointer<uint32_t>(SqRing, params.sq_off.tail);
+    SqMask = *RingPointer<uint32_t>(SqRing, params.sq_off.ring_mask);
+    SqArray = RingPointer<uint32_t>(SqRing, params.sq_off.array);
+    CqHead = RingPointer<uint32_t>(CqRing, params.cq_off.head);
+    CqTail = RingPointer<uint32_t>(CqRing, params.cq_off.tail);
+    CqMask = *RingPointer<uint32_t>(CqRing, params.cq_off.ring_mask);
+    Cqes = RingPointer<void>(CqRing, params.cq_off.cqes);
+    LocalTail = *SqTail;
+    return true;
+}
+
+void IoRing::Close() noexcept {
+    if (Sqes != nullptr) {
+        munmap(Sqes, SqesSize);
+        Sqes = nullptr;
+    }
+    if (CqRing != nullptr && CqRing != SqRing) {
+        munmap(CqRing, CqRingSize);
+    }
+    CqRing = nullptr;
+    if (SqRing != nullptr) {
+        munmap(SqRing, SqRingSize);
+        SqRing = nullptr;
+    }
+    if (RingFd != -1) {
+        close(RingFd);
+        RingFd = -1;
+    }
+}
+
+bool IoRing::RegisterBuffers(std::span<const std::span<char>> buffers) noexcept {
+    if (RingFd == -1) {
+        return false;
+    }
+    std::vector<iovec> iovecs;
+    try {
+        iovecs.reserve(buffers.size());
+    } catch (...) {
+        return false;
+    }
+    for (const auto& buffer : buffers) {
+        iovecs.push_back(iovec{buffer.data(), buffer.size()});
+    }
+    const long result = syscall(__NR_io_uring_register,
+                                RingFd,
+                                IORING_REGISTER_BUFFERS,
+                                iovecs.data(),
+                                static_cast<unsigned>(iovecs.size()));
+    return result == 0;
+}
+
+void* IoRing::PrepareEntry() noexcept {
+    if (RingFd == -1 || LocalTail - LoadAcquire(SqHead) >= Entries) {
+        return nullptr;
+    }
+    const uint32_t index = LocalTail & SqMask;
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(Sqes) + index;
+    std::memset(sqe, 0, sizeof(io_uring_sqe));
+    SqArray[index] = index;
+    ++LocalTail;
+    return sqe;
+}
+
+bool IoRing::PrepareOpen(const char* path, bool write, uint64_t tag) noexcept {
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(PrepareEntry());
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uintptr_t>(path);
+    sqe->len = write ? 0666 : 0;
+    sqe->open_flags = write ? (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC);
+    sqe->user_data = tag;
+    return true;
+}
+
+bool IoRing::PrepareRead(int fd,
+                         void* buffer,
+                         uint32_t length,
+                         uint64_t offset,
+                         uint64_t tag) noexcept {
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(PrepareEntry());
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(buffer);
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = tag;
+    return true;
+}
+
+bool IoRing::PrepareReadFixed(int fd,
+                              void* buffer,
+                              uint32_t length,
+                              uint64_t offset,
+                              uint16_t bufferIndex,
+                              uint64_t tag) noexcept {
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(PrepareEntry());
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(buffer);
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->buf_index = bufferIndex;
+    sqe->user_data = tag;
+    return true;
+}
+
+bool IoRing::PrepareWrite(int fd,
+                          const void* buffer,
+                          uint32_t length,
+                          uint64_t offset,
+                          uint64_t tag) noexcept {
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(PrepareEntry());
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uintptr_t>(buffer);
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = tag;
+    return true;
+}
+
+bool IoRing::PrepareClose(int fd, uint64_t tag) noexcept {
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(PrepareEntry());
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = tag;
+    return true;
+}
+
+int IoRing::Submit(uint32_t waitFor) noexcept {
+    if (RingFd == -1) {
+        return -EBADF;
+    }
+    StoreRelease(SqTail, LocalTail);
+    const uint32_t toSubmit = LocalTail - LoadAcquire(SqHead);
+    while (true) {
+        const long result = syscall(__NR_io_uring_enter,
+                                    RingFd,
+                                    toSubmit,
+                                    waitFor,
+                                    waitFor != 0 ? IORING_ENTER_GETEVENTS : 0,
+                                    nullptr,
+                                    0);
+        if (result >= 0) {
+            return static_cast<int>(result);
+        }
+        if (errno != EINTR) {
+            return -errno;
+        }
+    }
+}
+
+bool IoRing::PopCompletion(uint64_t& tag, int32_t& result) noexcept {
+    if (RingFd == -1) {
+        return false;
+    }
+    const uint32_t head = *CqHead;
+    if (head == LoadAcquire(CqTail)) {
+        return false;
+    }
+    const io_uring_cqe& cqe = static_cast<const io_uring_cqe*>(Cqes)[head & CqMask];
+    tag = cqe.user_data;
+    result = cqe.res;
+    StoreRelease(CqHead, head + 1);
+    return true;
+}
+#else
+bool IoRing::Open(uint32_t /*entries*/) noexcept {
+    return false;
+}
+
+void IoRing::Close() noexcept {}
+
+bool IoRing::RegisterBuffers(std::span<const std::span<char>> /*buffers*/) noexcept {
+    return false;
+}
+
+void* IoRing::PrepareEntry() noexcept {
+    return nullptr;
+}
+
+bool IoRing::PrepareOpen(const char* /*path*/, bool /*write*/, uint64_t /*tag*/) noexcept {
+    return false;
+}
+
+bool IoRing::PrepareRead(int /*fd*/,
+                         void* /*buffer*/,
+                         uint32_t /*length*/,
+                         uint64_t /*offset*/,
+                         uint64_t /*tag*/) noexcept {
+    return false;
+}
+
+bool IoRing::PrepareReadFixed(int /*fd*/,
+                              void* /*buffer*/,
+                              uint32_t /*length*/,
+                              uint64_t /*offset*/,
+                              uint16_t /*bufferIndex*/,
+                              uint64_t /*tag*/) noexcept {
+    return false;
+}
+
+bool IoRing::PrepareWrite(int /*fd*/,
+                          const void* /*buffer*/,
+                          uint32_t /*length*/,
+                          uint64_t /*offset*/,
+                          uint64_t /*tag*/) noexcept {
+    return false;
+}
+
+bool IoRing::PrepareClose(int /*fd*/, uint64_t /*tag*/) noexcept {
+    return false;
+}
+
+int IoRing::Submit(uint32_t /*waitFor*/) noexcept {
+    return -1;
+}
+
+bool IoRing::PopCompletion(uint64_t& /*tag*/, int32_t& /*result*/) noexcept {
+    return false;
+}
+#endif
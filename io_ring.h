@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Minimal io_uring wrapper on top of the raw system calls, so no liburing is needed.
+//
+// A ring belongs to a single thread: entries are prepared with the Prepare functions, handed to the
+// kernel with Submit(), and their results collected with PopCompletion(). Every entry carries a
+// caller-chosen 64-bit tag that comes back with its completion.
+//
+// Open() fails if io_uring is unavailable, whether because this isn't Linux, the kernel is too old
+// or a seccomp filter blocks it, so callers always need a fallback.
+struct IoRing {
+public:
+    IoRing() noexcept;
+    IoRing(const IoRing& other) = delete;
+    IoRing(IoRing&& other) = delete;
+    IoRing& operator=(const IoRing& other) = delete;
+    IoRing& operator=(IoRing&& other) = delete;
+    ~IoRing() noexcept;
+
+    bool Open(uint32_t entries) noexcept;
+    bool IsOpen() const noexcept;
+    void Close() noexcept;
+
+    // Registers the given buffers with the kernel so reads into them with PrepareReadFixed() skip
+    // pinning the pages on every request.
+    bool RegisterBuffers(std::span<const std::span<char>> buffers) noexcept;
+
+    // These return false if the submission queue is full; Submit() and reap completions first.
+    //
+    // PrepareOpen() opens the file read-only, or if 'write' is set, creates or truncates it for
+    // writing. The path has to stay valid until the open has completed.
+    bool PrepareOpen(const char* path, bool write, uint64_t tag) noexcept;
+    bool PrepareRead(int fd, void* buffer, uint32_t length, uint64_t offset, uint64_t tag) noexcept;
+    bool PrepareReadFixed(int fd,
+                          void* buffer,
+                          uint32_t length,
+                          uint64_t offset,
+                          uint16_t bufferIndex,
+                          uint64_t tag) noexcept;
+    bool PrepareWrite(int fd,
+                      const void* buffer,
+                      uint32_t length,
+                      uint64_t offset,
+                      uint64_t tag) noexcept;
+    bool PrepareClose(int fd, uint64_t tag) noexcept;
+
+    // Hands all prepared entries to the kernel and waits until at least 'waitFor' completions are
+    // available. Returns the number of submitted entries, or a negative errno. -EAGAIN and -EBUSY
+    // mean the kernel is short on resources; reap completions and try again.
+    int Submit(uint32_t waitFor) noexcept;
+
+    // Takes the next completion, if any. 'result' is the return value of the operation, or a
+    // negative errno.
+    bool PopCompletion(uint64_t& tag, int32_t& result) noexcept;
+
+private:
+    void* PrepareEntry() noexcept;
+
+    int RingFd = -1;
+    uint32_t Entries = 0;
+
+    void* SqRing = nullptr;
+    size_t SqRingSize = 0;
+    void* CqRing = nullptr;
+    size_t CqRingSize = 0;
+    void* Sqes = nullptr;
+    size_t SqesSize = 0;
+
+    uint32_t* SqHead = nullptr;
+    uint32_t* SqTail = nullptr;
+    uint32_t SqMask = 0;
+    uint32_t* SqArray = nullptr;
+    uint32_t* CqHead = nullptr;
+    uint32_t* CqTail = nullptr;
+    uint32_t CqMask = 0;
+    void* Cqes = nullptr;
+
+    // entries prepared but not yet made visible to the kernel
+    uint32_t LocalTail = 0;
+};
@@ -0,0 +1,435 @@
+#include "json.h"
+
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace HyoutaUtils::Json {
+Writer::Writer() noexcept = default;
+
+void Writer::BeforeValue() {
+    if (AfterKey) {
+        AfterKey = false;
+        return;
+    }
+    if (!HasElements.empty()) {
+        if (HasElements.back()) {
+            Output += ',';
+        }
+        HasElements.back() = true;
+    }
+}
+
+void Writer::BeginObject() {
+    BeforeValue();
+    Output += '{';
+    HasElements.push_back(false);
+}
+
+void Writer::EndObject() {
+    HasElements.pop_back();
+    Output += '}';
+}
+
+void Writer::BeginArray() {
+    BeforeValue();
+    Output += '[';
+    HasElements.push_back(false);
+}
+
+void Writer::EndArray() {
+    HasElements.pop_back();
+    Output += ']';
+}
+
+static void AppendEscaped(std::string& out, std::string_view s) {
+    static constexpr char hex[] = "0123456789abcdef";
+    out += '"';
+    for (char c : s) {
+        const uint8_t u = static_cast<uint8_t>(c);
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (u < 0x20) {
+                    out += "\\u00";
+                    out += hex[u >> 4];
+                    out += hex[u & 0xf];
+                } else {
+                    out += c;
+                }
+                break;
+        }
+    }
+    out += '"';
+}
+
+void Writer::Key(std::string_view key) {
+    BeforeValue();
+    AppendEscaped(Output, key);
+    Output += ':';
+    AfterKey = true;
+}
+
+void Writer::String(std::string_view value) {
+    BeforeValue();
+    AppendEscaped(Output, value);
+}
+
+void Writer::UInt(uint64_t value) {
+    BeforeValue();
+    std::array<char, 24> str;
+    auto [ptr, ec] = std::to_chars(str.data(), str.data() + str.size(), value);
+    Output.append(str.data(), ptr);
+}
+
+void Writer::Int(int64_t value) {
+    BeforeValue();
+    std::array<char, 24> str;
+    auto [ptr, ec] = std::to_chars(str.data(), str.data() + str.size(), value);
+    Output.append(str.data(), ptr);
+}
+
+void Writer::Double(double value) {
+    if (!std::isfinite(value)) {
+        Null();
+        return;
+    }
+    BeforeValue();
+    std::array<char, 32> str;
+    auto [ptr, ec] = std::to_chars(str.data(), str.data() + str.size(), value);
+    Output.append(str.data(), ptr);
+}
+
+void Writer::Bool(bool value) {
+    BeforeValue();
+    Output += value ? "true" : "false";
+}
+
+void Writer::Null() {
+    BeforeValue();
+    Output += "null";
+}
+
+const std::string& Writer::GetString() const noexcept {
+    return Output;
+}
+
+std::string Writer::ReleaseString() noexcept {
+    return std::move(Output);
+}
+
+Value::Type Value::GetType() const noexcept {
+    return ValueType;
+}
+
+bool Value::IsNull() const noexcept {
+    return ValueType == Type::Null;
+}
+
+bool Value::IsBool() const noexcept {
+    return ValueType == Type::Bool;
+}
+
+bool Value::IsNumber() const noexcept {
+    return ValueType == Type::Number;
+}
+
+bool Value::IsString() const noexcept {
+    return ValueType == Type::String;
+}
+
+bool Value::IsArray() const noexcept {
+    return ValueType == Type::Array;
+}
+
+bool Value::IsObject() const noexcept {
+    return ValueType == Type::Object;
+}
+
+bool Value::GetBool() const noexcept {
+    return BoolValue;
+}
+
+double Value::GetNumber() const noexcept {
+    return NumberValue;
+}
+
+const std::string& Value::GetString() const noexcept {
+    return StringValue;
+}
+
+const std::vector<Value>& Value::GetArray() const noexcept {
+    return ArrayValue;
+}
+
+const std::vector<std::pair<std::string, Value>>& Value::GetObject() const noexcept {
+    return ObjectValue;
+}
+
+const Value* Value::Find(std::string_view key) const noexcept {
+    for (const auto& member : ObjectValue) {
+        if (member.first == key) {
+            return &member.second;
+        }
+    }
+    return nullptr;
+}
+
+double Value::GetNumber(std::string_view key, double defaultValue) const noexcept {
+    const Value* v = Find(key);
+    if (v == nullptr || !v->IsNumber()) {
+        return defaultValue;
+    }
+    return v->NumberValue;
+}
+
+struct Parser {
+    std::string_view Rest;
+    size_t Depth = 0;
+
+    void SkipWhitespace() {
+        while (!Rest.empty()
+               && (Rest.front() == ' ' || Rest.front() == '\t' || Rest.front() == '\n'
+                   || Rest.front() == '\r')) {
+            Rest.remove_prefix(1);
+        }
+    }
+
+    bool Consume(std::string_view token) {
+        if (!Rest.starts_with(token)) {
+            return false;
+        }
+        Rest.remove_prefix(token.size());
+        return true;
+    }
+
+    static void AppendUtf8(std::string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xc0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xe0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        } else {
+            out += static_cast<char>(0xf0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+            out += static_cast<char>(0x80 | (cp & 0x3f));
+        }
+    }
+
+    bool ParseHex4(uint32_t& value) {
+        if (Rest.size() < 4) {
+            return false;
+        }
+        value = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            const char c = Rest[i];
+            value <<= 4;
+            if (c >= '0' && c <= '9') {
+                value |= static_cast<uint32_t>(c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                value |= static_cast<uint32_t>(c - 'a' + 10);
+            } else if (c >= 'A' && c <= 'F') {
+                value |= static_cast<uint32_t>(c - 'A' + 10);
+            } else {
+                return false;
+            }
+        }
+        Rest.remove_prefix(4);
+        return true;
+    }
+
+    bool ParseString(std::string& out) {
+        if (!Consume("\"")) {
+            return false;
+        }
+        while (!Rest.empty()) {
+            const char c = Rest.front();
+            Rest.remove_prefix(1);
+            if (c == '"') {
+                return true;
+            }
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (Rest.empty()) {
+                return false;
+            }
+            const char e = Rest.front();
+            Rest.remove_prefix(1);
+            switch (e) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!ParseHex4(cp)) {
+                        return false;
+                    }
+                    if (cp >= 0xd800 && cp < 0xdc00) {
+                        uint32_t low;
+                        if (!Consume("\\u") || !ParseHex4(low) || low < 0xdc00 || low >= 0xe000) {
+                            return false;
+                        }
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    AppendUtf8(out, cp);
+                    break;
+                }
+                default: return false;
+            }
+        }
+        return false;
+    }
+
+    bool ParseNumber(double& out) {
+        size_t length = 0;
+        while (length < Rest.size()) {
+            const char c = Rest[length];
+            if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e'
+                || c == 'E') {
+                ++length;
+            } else {
+                break;
+            }
+        }
+        if (length == 0) {
+            return false;
+        }
+        const std::string s(Rest.substr(0, length));
+        char* end = nullptr;
+        out = strtod(s.c_str(), &end);
+        if (end != s.c_str() + s.size()) {
+            return false;
+        }
+        Rest.remove_prefix(length);
+        return true;
+    }
+
+    bool ParseValue(Value& value) {
+        if (Depth > 256) {
+            return false;
+        }
+        SkipWhitespace();
+        if (Rest.empty()) {
+            return false;
+        }
+        const char c = Rest.front();
+        if (c == '{') {
+            Rest.remove_prefix(1);
+            ++Depth;
+            value.ValueType = Value::Type::Object;
+            SkipWhitespace();
+            if (Consume("}")) {
+                --Depth;
+                return true;
+            }
+            while (true) {
+                SkipWhitespace();
+                std::string key;
+                if (!ParseString(key)) {
+                    return false;
+                }
+                SkipWhitespace();
+                if (!Consume(":")) {
+                    return false;
+                }
+                Value member;
+                if (!ParseValue(member)) {
+                    return false;
+                }
+                value.ObjectValue.emplace_back(std::move(key), std::move(member));
+                SkipWhitespace();
+                if (Consume(",")) {
+                    continue;
+                }
+                if (Consume("}")) {
+                    --Depth;
+                    return true;
+                }
+                return false;
+            }
+        }
+        if (c == '[') {
+            Rest.remove_prefix(1);
+            ++Depth;
+            value.ValueType = Value::Type::Array;
+            SkipWhitespace();
+            if (Consume("]")) {
+                --Depth;
+                return true;
+            }
+            while (true) {
+                Value element;
+                if (!ParseValue(element)) {
+                    return false;
+                }
+                value.ArrayValue.push_back(std::move(element));
+                SkipWhitespace();
+                if (Consume(",")) {
+                    continue;
+                }
+                if (Consume("]")) {
+                    --Depth;
+                    return true;
+                }
+                return false;
+            }
+        }
+        if (c == '"') {
+            value.ValueType = Value::Type::String;
+            return ParseString(value.StringValue);
+        }
+        if (Consume("true")) {
+            value.ValueType = Value::Type::Bool;
+            value.BoolValue = true;
+            return true;
+        }
+        if (Consume("false")) {
+            value.ValueType = Value::Type::Bool;
+            value.BoolValue = false;
+            return true;
+        }
+        if (Consume("null")) {
+            value.ValueType = Value::Type::Null;
+            return true;
+        }
+        value.ValueType = Value::Type::Number;
+        return ParseNumber(value.NumberValue);
+    }
+};
+
+std::optional<Value> Parse(std::string_view json) {
+    Parser parser{json};
+    Value value;
+    if (!parser.ParseValue(value)) {
+        return std::nullopt;
+    }
+    parser.SkipWhitespace();
+    if (!parser.Rest.empty()) {
+        return std::nullopt;
+    }
+    return value;
+}
+} // namespace HyoutaUtils::Json
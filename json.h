@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace HyoutaUtils::Json {
+// Minimal streaming JSON writer. Commas and escaping are handled automatically; the caller is
+// responsible for balancing Begin/End calls and for emitting a Key() before every value that is
+// written inside an object.
+struct Writer {
+public:
+    Writer() noexcept;
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    void Key(std::string_view key);
+    void String(std::string_view value);
+    void UInt(uint64_t value);
+    void Int(int64_t value);
+    void Double(double value);
+    void Bool(bool value);
+    void Null();
+
+    const std::string& GetString() const noexcept;
+    std::string ReleaseString() noexcept;
+
+private:
+    void BeforeValue();
+
+    std::string Output;
+    std::vector<bool> HasElements;
+    bool AfterKey = false;
+};
+
+// Parsed JSON document. Numbers are stored as double.
+struct Value {
+public:
+    enum class Type {
+        Null,
+        Bool,
+        Number,
+        String,
+        Array,
+        Object,
+    };
+
+    Type GetType() const noexcept;
+    bool IsNull() const noexcept;
+    bool IsBool() const noexcept;
+    bool IsNumber() const noexcept;
+    bool IsString() const noexcept;
+    bool IsArray() const noexcept;
+    bool IsObject() const noexcept;
+
+    bool GetBool() const noexcept;
+    double GetNumber() const noexcept;
+    const std::string& GetString() const noexcept;
+    const std::vector<Value>& GetArray() const noexcept;
+    const std::vector<std::pair<std::string, Value>>& GetObject() const noexcept;
+
+    // returns nullptr if this is not an object or has no member with the given key
+    const Value* Find(std::string_view key) const noexcept;
+
+    // returns the member as number, or the given default if it's missing or not a number
+    double GetNumber(std::string_view key, double defaultValue) const noexcept;
+
+private:
+    friend struct Parser;
+
+    Type ValueType = Type::Null;
+    bool BoolValue = false;
+    double NumberValue = 0.0;
+    std::string StringValue;
+    std::vector<Value> ArrayValue;
+    std::vector<std::pair<std::string, Value>> ObjectValue;
+};
+
+std::optional<Value> Parse(std::string_view json);
+} // namespace HyoutaUtils::Json
@@ -1,139 +1,629 @@
+#include <array>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <filesystem>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <utility>
 #include <vector>
 
+#include "batch.h"
 #include "compress.h"
-#include "decompress.h"
+#include "compress_cache.h"
+#include "decompress_observed.h"
 #include "file.h"
+#include "gen_corpus.h"
+#include "header.h"
+#include "mirror.h"
+#include "perf_counters.h"
+#include "profile.h"
+#include "scan.h"
+#include "serve.h"
+#include "stats.h"
+#include "text_scan.h"
+#include "topdec.h"
+#include "watch.h"
 
 static void PrintUsage() {
     printf(
         "Usage for decompression:\n"
-        "  topdec d (path to compressed input) [path to uncompressed output]\n"
+        "  topdec d [options] (path to compressed input) [path to uncompressed output]\n"
+        "  Options are:\n"
+        "    --dump-tokens (print every decoded token to stdout)\n"
+        "    --profile (print time spent in each phase)\n"
+        "    --profile-json (path) (write the profile as JSON to the given file)\n"
+        "    --perf (print hardware performance counters of the codec call)\n"
+        "    --perf-json (path) (write the performance counters as JSON to the given file)\n"
         "Output will be input file + '.dec' if not given.\n"
+        "  topdec d -r [options] (input directory) (output directory)\n"
+        "  Options for -r are:\n"
+        "    --include (glob) (only process matching files, may be given more than once)\n"
+        "    --exclude (glob) (skip matching files and directories, may be given more than once)\n"
+        "    --skip-if-newer (skip files whose output is not older than the input)\n"
+        "    --threads N (defaults to the number of hardware threads)\n"
+        "    --io auto/sync/uring (file access method, auto uses io_uring where available)\n"
+        "  Globs match paths relative to the input directory; '*' stays within a directory,\n"
+        "  '**' crosses directories, and a glob without '/' only matches the file name.\n"
         "\n"
         "Usage for compression:\n"
         "  topdec c [options] (path to decompressed input) [path to compressed output]\n"
         "  Options are:\n"
-        "    --type 81/83 (defaults to 83)\n"
-        "Output will be input file + '.comp' if not given.\n");
+        "    --type 01/03/81/83 (defaults to 83)\n"
+        "    --level 1-9 (defaults to 9, lower levels search less for matches)\n"
+        "    --cache-dir (path) (reuse earlier results for identical inputs from this directory)\n"
+        "    --cache-size MB (size limit of the cache directory, defaults to 1024)\n"
+        "    --profile (print time spent in each phase)\n"
+        "    --profile-json (path) (write the profile as JSON to the given file)\n"
+        "    --perf (print hardware performance counters of the codec call)\n"
+        "    --perf-json (path) (write the performance counters as JSON to the given file)\n"
+        "Output will be input file + '.comp' if not given.\n"
+        "  topdec c -r [options] (input directory) (output directory)\n"
+        "  Takes --type, --level, --cache-dir, --cache-size and the options of 'topdec d -r'.\n"
+        "\n"
+        "Usage for token statistics:\n"
+        "  topdec stats [options] (path to compressed file or directory)...\n"
+        "  Run 'topdec stats' for the list of options.\n"
+        "\n"
+        "Usage for synthetic corpus generation:\n"
+        "  topdec gen-corpus [options] (path to 'topdec stats --json' output) (output directory)\n"
+        "  Run 'topdec gen-corpus' for the list of options.\n"
+        "\n"
+        "Usage for daemon mode:\n"
+        "  topdec serve [options] --socket (path)\n"
+        "  Run 'topdec serve' for the list of options.\n"
+        "\n"
+        "Usage for batch mode:\n"
+        "  topdec batch [options] (path to manifest)\n"
+        "  Run 'topdec batch' for the list of options.\n"
+        "\n"
+        "Usage for finding embedded compressed files:\n"
+        "  topdec scan [options] (path to image or archive)\n"
+        "  Run 'topdec scan' for the list of options.\n"
+        "\n"
+        "Usage for finding text:\n"
+        "  topdec strings [options] (path to compressed file or directory)...\n"
+        "  Run 'topdec strings' for the list of options.\n"
+        "\n"
+        "Usage for keeping a compressed copy of a directory up to date:\n"
+        "  topdec watch [options] (input directory) (output directory)\n"
+        "  Run 'topdec watch' for the list of options.\n");
+}
+
+static bool ReportPerf(const PerfReport& report, const char* jsonPath) {
+    if (jsonPath == nullptr) {
+        report.Print();
+        return true;
+    }
+    if (!report.WriteJsonFile(jsonPath)) {
+        printf("failed to write performance counters\n");
+        return false;
+    }
+    return true;
+}
+
+static int ReportProfile(ProfileReport& report,
+                         ProfileSample sample,
+                         bool print,
+                         const char* jsonPath) {
+    report.Add(std::move(sample));
+    report.Finish();
+    if (print) {
+        report.Print();
+    }
+    if (jsonPath != nullptr && !report.WriteJsonFile(jsonPath)) {
+        printf("failed to write profile\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Parses the options that only apply to recursive mode. Returns 1 if argv[idx] was one of them, 0
+// if it wasn't, and -1 if its value was missing or invalid.
+static int ParseRecursiveOption(int argc,
+                                char** argv,
+                                int& idx,
+                                bool& recursive,
+                                MirrorOptions& mirror) {
+    if (strcmp("-r", argv[idx]) == 0) {
+        recursive = true;
+        ++idx;
+        return 1;
+    }
+    if (strcmp("--skip-if-newer", argv[idx]) == 0) {
+        mirror.SkipIfNewer = true;
+        ++idx;
+        return 1;
+    }
+    const bool include = strcmp("--include", argv[idx]) == 0;
+    const bool exclude = strcmp("--exclude", argv[idx]) == 0;
+    const bool threads = strcmp("--threads", argv[idx]) == 0;
+    const bool io = strcmp("--io", argv[idx]) == 0;
+    if (!include && !exclude && !threads && !io) {
+        return 0;
+    }
+    ++idx;
+    if (idx >= argc) {
+        return -1;
+    }
+    if (include) {
+        mirror.Include.emplace_back(argv[idx]);
+    } else if (exclude) {
+        mirror.Exclude.emplace_back(argv[idx]);
+    } else if (threads) {
+        mirror.Batch.Threads = static_cast<size_t>(strtoull(argv[idx], nullptr, 10));
+    } else if (!parse_batch_io(argv[idx], mirror.Batch.Io)) {
+        return -1;
+    }
+    ++idx;
+    return 1;
+}
+
+// Maps the input file, or if that isn't possible, such as for a pipe, reads it into 'buffer'.
+// 'view' and 'buffer' have to outlive the returned span.
+static std::optional<std::span<const char>> LoadInputFile(HyoutaUtils::IO::File& infile,
+                                                          HyoutaUtils::IO::FileView& view,
+                                                          std::vector<char>& buffer) {
+    if (auto mapped = infile.Map(HyoutaUtils::IO::AccessHint::Sequential)) {
+        view = std::move(*mapped);
+        return std::span<const char>(view.Data(), view.Size());
+    }
+    const auto length = infile.GetLength();
+    if (!length) {
+        return std::nullopt;
+    }
+    buffer.resize(*length);
+    if (infile.Read(buffer.data(), buffer.size()) != buffer.size()) {
+        return std::nullopt;
+    }
+    return std::span<const char>(buffer);
 }
 
 int main(int argc, char** argv) {
+    if (argc >= 2 && strcmp("stats", argv[1]) == 0) {
+        return StatsMain(argc, argv);
+    }
+    if (argc >= 2 && strcmp("gen-corpus", argv[1]) == 0) {
+        return GenCorpusMain(argc, argv);
+    }
+    if (argc >= 2 && strcmp("serve", argv[1]) == 0) {
+        return ServeMain(argc, argv);
+    }
+    if (argc >= 2 && strcmp("batch", argv[1]) == 0) {
+        return BatchMain(argc, argv);
+    }
+    if (argc >= 2 && strcmp("scan", argv[1]) == 0) {
+        return ScanMain(argc, argv);
+    }
+    if (argc >= 2 && strcmp("strings", argv[1]) == 0) {
+        return StringsMain(argc, argv);
+    }
+    if (argc >= 2 && strcmp("watch", argv[1]) == 0) {
+        return WatchMain(argc, argv);
+    }
+
     if (argc < 3) {
         PrintUsage();
         return -1;
     }
 
     if (strcmp("d", argv[1]) == 0) {
-        std::string_view source(argv[2]);
+        bool dumpTokens = false;
+        bool profile = false;
+        const char* profileJsonPath = nullptr;
+        bool perf = false;
+        const char* perfJsonPath = nullptr;
+        bool recursive = false;
+        MirrorOptions mirror;
+        int idx = 2;
+        while (idx < argc) {
+            const int recursiveOption = ParseRecursiveOption(argc, argv, idx, recursive, mirror);
+            if (recursiveOption < 0) {
+                PrintUsage();
+                return -1;
+            }
+            if (recursiveOption > 0) {
+                continue;
+            }
+            if (strcmp("--perf", argv[idx]) == 0) {
+                perf = true;
+                ++idx;
+                continue;
+            }
+            if (strcmp("--perf-json", argv[idx]) == 0) {
+                ++idx;
+                if (idx >= argc) {
+                    PrintUsage();
+                    return -1;
+                }
+                perf = true;
+                perfJsonPath = argv[idx];
+                ++idx;
+                continue;
+            }
+            if (strcmp("--dump-tokens", argv[idx]) == 0) {
+                dumpTokens = true;
+                ++idx;
+                continue;
+            }
+            if (strcmp("--profile", argv[idx]) == 0) {
+                profile = true;
+                ++idx;
+                continue;
+            }
+            if (strcmp("--profile-json", argv[idx]) == 0) {
+                ++idx;
+                if (idx >= argc) {
+                    PrintUsage();
+                    return -1;
+                }
+                profileJsonPath = argv[idx];
+                ++idx;
+                continue;
+            }
+
+            break;
+        }
+        if (idx >= argc) {
+            PrintUsage();
+            return -1;
+        }
+
+        if (recursive) {
+            if (argc - idx != 2) {
+                PrintUsage();
+                return -1;
+            }
+            if (dumpTokens || profile || profileJsonPath || perf) {
+                printf("--dump-tokens, --profile and --perf can't be used with -r\n");
+                return -1;
+            }
+            mirror.Op = BatchOp::Decompress;
+            return run_mirror(std::filesystem::path(argv[idx]),
+                              std::filesystem::path(argv[idx + 1]),
+                              mirror);
+        }
+
+        std::string_view source(argv[idx]);
         std::string_view target;
         std::string tmp;
-        if (argc < 4) {
+        if (argc - 2 < idx) {
             tmp = std::string(source);
             tmp += ".dec";
             target = tmp;
         } else {
-            target = std::string_view(argv[3]);
+            target = std::string_view(argv[idx + 1]);
         }
 
 
+        PerfCounterGroup perfCounters;
+        PerfReport perfReport;
+        if (perf && !perfCounters.Open()) {
+            printf("performance counters are not available\n");
+            return -1;
+        }
+
+        ProfileReport report;
+        ProfileSample sample;
+        sample.Path = std::string(source);
+        PhaseTimer timer(sample.Times);
+
         HyoutaUtils::IO::File infile(std::filesystem::path(source),
                                      HyoutaUtils::IO::OpenMode::Read);
         if (!infile.IsOpen()) {
             printf("failed to open input file\n");
             return -1;
         }
-        std::vector<char> compressed;
-        const auto infileLength = infile.GetLength();
-        if (!infileLength) {
-            printf("failed to get size of input file\n");
-            return -1;
+
+        // Stored entries need no decoding, so let the kernel copy them to the output; the data
+        // never has to pass through this process. Like the mapped decode below, this writes
+        // straight into the target, so it's only done when there is no file there yet; a failed
+        // copy then just deletes the new file again. Existing targets take the buffered path,
+        // which only replaces them once the data is complete. The performance counters only see
+        // user space, where the kernel copy barely shows up, so with --perf stored entries are
+        // decoded like any other format instead.
+        std::error_code storedTargetEc;
+        if (!dumpTokens && !perf
+            && std::filesystem::symlink_status(std::filesystem::path(target), storedTargetEc).type()
+                   == std::filesystem::file_type::not_found) {
+            std::array<char, compressed_header_size> headerBytes;
+            const auto storedHeader =
+                infile.ReadAt(headerBytes.data(), headerBytes.size(), 0) == headerBytes.size()
+                    ? parse_compressed_header(headerBytes.data(), headerBytes.size())
+                    : std::nullopt;
+            if (storedHeader && storedHeader->Type == 0x00) {
+                const auto infileLength = infile.GetLength();
+                if (!infileLength) {
+                    printf("failed to get size of input file\n");
+                    return -1;
+                }
+                const uint64_t length = storedHeader->CompressedLength;
+                if (*infileLength - compressed_header_size < length) {
+                    printf("%s\n", make_error_code(TopDec::Error::TruncatedData).message().c_str());
+                    return -1;
+                }
+                if (length != storedHeader->UncompressedLength) {
+                    printf("decompression failure: %s\n",
+                           make_error_code(TopDec::Error::CorruptData).message().c_str());
+                    return -1;
+                }
+                sample.InputBytes = *infileLength;
+                timer.Next(ProfilePhase::Read);
+
+                HyoutaUtils::IO::File outfile(std::filesystem::path(target),
+                                              HyoutaUtils::IO::OpenMode::Write);
+                if (!outfile.IsOpen()) {
+                    printf("failed to open output file\n");
+                    return -1;
+                }
+                timer.Next(ProfilePhase::Allocate);
+
+                // the copy takes the place of decoding, so that's what gets timed
+                const uint64_t copied = outfile.CopyFrom(infile, compressed_header_size, length);
+                if (copied != length) {
+                    outfile.Delete();
+                    outfile.Close();
+                    printf("failed to write output file\n");
+                    return -1;
+                }
+                timer.Next(ProfilePhase::Codec);
+                outfile.Close();
+                infile.Close();
+                timer.Next(ProfilePhase::Write);
+                return ReportProfile(report, std::move(sample), profile, profileJsonPath);
+            }
         }
-        compressed.resize(*infileLength);
-        if (infile.Read(compressed.data(), compressed.size()) != compressed.size()) {
+
+        HyoutaUtils::IO::FileView inputView;
+        std::vector<char> inputBuffer;
+        const auto input = LoadInputFile(infile, inputView, inputBuffer);
+        if (!input) {
             printf("failed to read input file\n");
             return -1;
         }
+        const std::span<const char> compressed = *input;
 
-        if (compressed.size() < 9) {
-            printf("input file too small\n");
+        infile.Close();
+        sample.InputBytes = compressed.size();
+        timer.Next(ProfilePhase::Read);
+
+        std::error_code ec;
+        const auto header = TopDec::parse_file_image_header(compressed, ec);
+        if (!header) {
+            printf("%s\n", ec.message().c_str());
+            return -1;
+        }
+        if (header->Type != 0x00 && header->Type != 0x01 && header->Type != 0x03
+            && header->Type != 0x81 && header->Type != 0x83) {
+            printf("unsupported compression format\n");
             return -1;
         }
 
-        uint8_t compressionType = static_cast<uint8_t>(compressed[0]);
-        uint32_t compressedLength =
-            static_cast<uint32_t>(static_cast<uint8_t>(compressed[1]))
-            | (static_cast<uint32_t>(static_cast<uint8_t>(compressed[2])) << 8)
-            | (static_cast<uint32_t>(static_cast<uint8_t>(compressed[3])) << 16)
-            | (static_cast<uint32_t>(static_cast<uint8_t>(compressed[4])) << 24);
-        uint32_t uncompressedLength =
-            static_cast<uint32_t>(static_cast<uint8_t>(compressed[5]))
-            | (static_cast<uint32_t>(static_cast<uint8_t>(compressed[6])) << 8)
-            | (static_cast<uint32_t>(static_cast<uint8_t>(compressed[7])) << 16)
-            | (static_cast<uint32_t>(static_cast<uint8_t>(compressed[8])) << 24);
-
+        // Decode straight into the output file if it can be mapped at its final size. This skips
+        // zero-filling a buffer and copying it into the file afterwards. The file has to be
+        // created for that before decoding, so only do it when there is no file yet: a failed
+        // decode then just deletes the new file again, while an existing one is only replaced
+        // once decoding has succeeded.
+        HyoutaUtils::IO::File outfile;
+        std::optional<HyoutaUtils::IO::FileView> outputView;
         std::vector<char> uncompressed;
-        uncompressed.resize(uncompressedLength + decompress_reserve_extra_bytes());
-
-        int64_t decompressResult = -2;
-        if (compressionType == 0x00 && compressedLength == uncompressedLength) {
-            std::memcpy(uncompressed.data(), compressed.data() + 9, compressedLength);
-            decompressResult = compressedLength;
-        } else if (compressionType == 0x01) {
-            decompressResult = decompress_01(
-                compressed.data() + 9, compressedLength, uncompressed.data(), uncompressedLength);
-        } else if (compressionType == 0x03) {
-            decompressResult = decompress_03(
-                compressed.data() + 9, compressedLength, uncompressed.data(), uncompressedLength);
-        } else if (compressionType == 0x81) {
-            decompressResult = decompress_81(
-                compressed.data() + 9, compressedLength, uncompressed.data(), uncompressedLength);
-        } else if (compressionType == 0x83) {
-            decompressResult = decompress_83(
-                compressed.data() + 9, compressedLength, uncompressed.data(), uncompressedLength);
+        std::error_code targetEc;
+        if (!dumpTokens
+            && std::filesystem::symlink_status(std::filesystem::path(target), targetEc).type()
+                   == std::filesystem::file_type::not_found) {
+            if (!outfile.Open(std::filesystem::path(target),
+                              HyoutaUtils::IO::OpenMode::ReadWrite)) {
+                printf("failed to open output file\n");
+                return -1;
+            }
+            outputView = outfile.MapWritable(header->UncompressedLength);
+            if (!outputView) {
+                outfile.Delete();
+                outfile.Close();
+            }
+        }
+        if (!outputView) {
+            uncompressed.resize(TopDec::decompress_bound(header->UncompressedLength));
+        }
+        timer.Next(ProfilePhase::Allocate);
+
+        size_t decompressedSize = 0;
+        if (dumpTokens && header->Type != 0x00) {
+            TextDumpDecodeObserver observer;
+            const char* data = compressed.data() + compressed_header_size;
+            const size_t compressedLength = header->CompressedLength;
+            const size_t uncompressedLength = header->UncompressedLength;
+            char* out = uncompressed.data();
+            int64_t decompressResult;
+            if (header->Type == 0x01) {
+                decompressResult =
+                    decompress_01(data, compressedLength, out, uncompressedLength, observer);
+            } else if (header->Type == 0x03) {
+                decompressResult =
+                    decompress_03(data, compressedLength, out, uncompressedLength, observer);
+            } else if (header->Type == 0x81) {
+                decompressResult =
+                    decompress_81(data, compressedLength, out, uncompressedLength, observer);
+            } else if (header->Type == 0x83) {
+                decompressResult =
+                    decompress_83(data, compressedLength, out, uncompressedLength, observer);
+            } else {
+                printf("unsupported compression format\n");
+                return -1;
+            }
+            if (decompressResult < 0) {
+                ec = TopDec::Error::CorruptData;
+            } else {
+                decompressedSize = static_cast<size_t>(decompressResult);
+                if (decompressedSize != uncompressedLength) {
+                    ec = TopDec::Error::LengthMismatch;
+                }
+            }
         } else {
-            printf("unsupported compression format\n");
-            return -1;
+            if (perf) {
+                perfCounters.Start();
+            }
+            if (outputView) {
+                decompressedSize = TopDec::decode_file_image_exact(
+                    compressed,
+                    std::span<char>(outputView->WritableData(), outputView->Size()),
+                    ec);
+            } else {
+                decompressedSize =
+                    TopDec::decode_file_image(compressed, std::span<char>(uncompressed), ec);
+            }
+            if (perf) {
+                perfReport.Add(
+                    perf_format_name(header->Type, false), compressed.size(), perfCounters.Stop());
+            }
         }
 
-        if (decompressResult < 0) {
-            printf("decompression failure\n");
-            return -1;
+        if (outputView && ec) {
+            outputView.reset();
+            outfile.Delete();
+            outfile.Close();
+            if (ec == TopDec::Error::LengthMismatch) {
+                // The exact decoder has cut off the output at the length from the header. Decode
+                // again with room to spare, so the output is the same as without the mapping.
+                uncompressed.resize(TopDec::decompress_bound(header->UncompressedLength));
+                decompressedSize =
+                    TopDec::decode_file_image(compressed, std::span<char>(uncompressed), ec);
+            }
         }
 
-        if (static_cast<size_t>(decompressResult) != uncompressedLength) {
+        timer.Next(ProfilePhase::Codec);
+
+        if (ec == TopDec::Error::LengthMismatch) {
             printf("WARNING: Header specified 0x%zx bytes but decompression produced 0x%zx bytes\n",
-                   static_cast<size_t>(uncompressedLength),
-                   static_cast<size_t>(decompressResult));
+                   static_cast<size_t>(header->UncompressedLength),
+                   decompressedSize);
+        } else if (ec == TopDec::Error::UnsupportedType) {
+            printf("unsupported compression format\n");
+            return -1;
+        } else if (ec) {
+            printf("decompression failure: %s\n", ec.message().c_str());
+            return -1;
         }
 
-        HyoutaUtils::IO::File outfile(std::filesystem::path(target),
-                                      HyoutaUtils::IO::OpenMode::Write);
-        if (!outfile.IsOpen()) {
-            printf("failed to open output file\n");
-            return -1;
+        if (outputView) {
+            // the data is already in the file's page cache, unmapping just hands it over
+            outputView.reset();
+        } else {
+            if (!outfile.Open(std::filesystem::path(target), HyoutaUtils::IO::OpenMode::Write)) {
+                printf("failed to open output file\n");
+                return -1;
+            }
+            if (outfile.Write(uncompressed.data(), decompressedSize) != decompressedSize) {
+                printf("failed to write output file\n");
+                return -1;
+            }
         }
-        if (outfile.Write(uncompressed.data(), static_cast<size_t>(decompressResult))
-            != static_cast<size_t>(decompressResult)) {
-            printf("failed to write output file\n");
+        outfile.Close();
+        timer.Next(ProfilePhase::Write);
+
+        if (perf && !ReportPerf(perfReport, perfJsonPath)) {
             return -1;
         }
-
-        return 0;
+        return ReportProfile(report, std::move(sample), profile, profileJsonPath);
     }
 
     if (strcmp("c", argv[1]) == 0) {
         int compressionType = 0x83;
+        int level = compress_default_level;
+        bool profile = false;
+        const char* profileJsonPath = nullptr;
+        bool perf = false;
+        const char* perfJsonPath = nullptr;
+        const char* cacheDir = nullptr;
+        uint64_t cacheMegabytes = 1024;
+        bool recursive = false;
+        MirrorOptions mirror;
         int idx = 2;
         while (idx < argc) {
+            const int recursiveOption = ParseRecursiveOption(argc, argv, idx, recursive, mirror);
+            if (recursiveOption < 0) {
+                PrintUsage();
+                return -1;
+            }
+            if (recursiveOption > 0) {
+                continue;
+            }
+            if (strcmp("--perf", argv[idx]) == 0) {
+                perf = true;
+                ++idx;
+                continue;
+            }
+            if (strcmp("--perf-json", argv[idx]) == 0) {
+                ++idx;
+                if (idx >= argc) {
+                    PrintUsage();
+                    return -1;
+                }
+                perf = true;
+                perfJsonPath = argv[idx];
+                ++idx;
+                continue;
+            }
+            if (strcmp("--cache-dir", argv[idx]) == 0) {
+                ++idx;
+                if (idx >= argc) {
+                    PrintUsage();
+                    return -1;
+                }
+                cacheDir = argv[idx];
+                ++idx;
+                continue;
+            }
+            if (strcmp("--cache-size", argv[idx]) == 0) {
+                ++idx;
+                if (idx >= argc) {
+                    PrintUsage();
+                    return -1;
+                }
+                cacheMegabytes = strtoull(argv[idx], nullptr, 10);
+                ++idx;
+                continue;
+            }
+            if (strcmp("--profile", argv[idx]) == 0) {
+                profile = true;
+                ++idx;
+                continue;
+            }
+            if (strcmp("--profile-json", argv[idx]) == 0) {
+                ++idx;
+                if (idx >= argc) {
+                    PrintUsage();
+                    return -1;
+                }
+                profileJsonPath = argv[idx];
+                ++idx;
+                continue;
+            }
+            if (strcmp("--level", argv[idx]) == 0) {
+                ++idx;
+                if (idx >= argc) {
+                    PrintUsage();
+                    return -1;
+                }
+                level = atoi(argv[idx]);
+                if (level < compress_min_level || level > compress_max_level) {
+                    printf("Invalid compression level.\n");
+                    return -1;
+                }
+                ++idx;
+                continue;
+            }
             if (strcmp("--type", argv[idx]) == 0) {
                 ++idx;
                 if (idx < argc) {
-                    if (strcmp("81", argv[idx]) == 0) {
+                    if (strcmp("01", argv[idx]) == 0) {
+                        compressionType = 0x01;
+                    } else if (strcmp("03", argv[idx]) == 0) {
+                        compressionType = 0x03;
+                    } else if (strcmp("81", argv[idx]) == 0) {
                         compressionType = 0x81;
                     } else if (strcmp("83", argv[idx]) == 0) {
                         compressionType = 0x83;
@@ -152,6 +642,36 @@ int main(int argc, char** argv) {
             break;
         }
 
+        if (recursive) {
+            if (argc - idx != 2) {
+                PrintUsage();
+                return -1;
+            }
+            if (profile || profileJsonPath || perf) {
+                printf("--profile and --perf can't be used with -r\n");
+                return -1;
+            }
+            std::optional<CompressCache> cache;
+            if (cacheDir != nullptr) {
+                cache.emplace(std::filesystem::path(cacheDir), cacheMegabytes * 1024 * 1024);
+                if (!cache->Open()) {
+                    printf("failed to open cache directory\n");
+                    return -1;
+                }
+                mirror.Batch.Cache = &*cache;
+            }
+            mirror.Op = BatchOp::Compress;
+            mirror.Type = static_cast<uint8_t>(compressionType);
+            mirror.Level = level;
+            const int result = run_mirror(std::filesystem::path(argv[idx]),
+                                          std::filesystem::path(argv[idx + 1]),
+                                          mirror);
+            if (cache) {
+                cache->Trim();
+            }
+            return result;
+        }
+
         std::string_view source(argv[idx]);
         std::string_view target;
         std::string tmp;
@@ -164,13 +684,24 @@ int main(int argc, char** argv) {
         }
 
 
+        PerfCounterGroup perfCounters;
+        PerfReport perfReport;
+        if (perf && !perfCounters.Open()) {
+            printf("performance counters are not available\n");
+            return -1;
+        }
+
+        ProfileReport report;
+        ProfileSample sample;
+        sample.Path = std::string(source);
+        PhaseTimer timer(sample.Times);
+
         HyoutaUtils::IO::File infile(std::filesystem::path(source),
                                      HyoutaUtils::IO::OpenMode::Read);
         if (!infile.IsOpen()) {
             printf("failed to open input file\n");
             return -1;
         }
-        std::vector<char> uncompressed;
         const auto infileLength = infile.GetLength();
         if (!infileLength) {
             printf("failed to get size of input file\n");
@@ -180,42 +711,71 @@ int main(int argc, char** argv) {
             printf("input too large\n");
             return -1;
         }
-        uncompressed.resize(*infileLength);
-        if (infile.Read(uncompressed.data(), uncompressed.size()) != uncompressed.size()) {
+        HyoutaUtils::IO::FileView inputView;
+        std::vector<char> inputBuffer;
+        const auto input = LoadInputFile(infile, inputView, inputBuffer);
+        if (!input || input->size() != *infileLength) {
             printf("failed to read input file\n");
             return -1;
         }
+        const std::span<const char> uncompressed = *input;
+        infile.Close();
+        sample.InputBytes = uncompressed.size();
+        timer.Next(ProfilePhase::Read);
+
+        std::optional<CompressCache> cache;
+        std::string cacheKey;
+        if (cacheDir != nullptr) {
+            cache.emplace(std::filesystem::path(cacheDir), cacheMegabytes * 1024 * 1024);
+            if (!cache->Open()) {
+                printf("failed to open cache directory\n");
+                return -1;
+            }
+            cacheKey = CompressCache::MakeKey(
+                uncompressed, static_cast<uint8_t>(compressionType), level);
+            if (cache->Fetch(cacheKey, std::filesystem::path(target))) {
+                timer.Next(ProfilePhase::Write);
+                return ReportProfile(report, std::move(sample), profile, profileJsonPath);
+            }
+        }
 
-        size_t headerSize = 9;
         std::vector<char> compressed;
-        compressed.resize(compress_81_83_bound(uncompressed.size()) + headerSize);
-
-        size_t compressedSize;
-        if (compressionType == 0x81) {
-            compressedSize = compress_81(
-                uncompressed.data(), uncompressed.size(), compressed.data() + headerSize);
-        } else if (compressionType == 0x83) {
-            compressedSize = compress_83(
-                uncompressed.data(), uncompressed.size(), compressed.data() + headerSize);
-        } else {
-            printf("invalid compression type\n");
+        compressed.resize(TopDec::encode_file_image_bound(uncompressed.size()));
+        const std::span<char> output(compressed);
+        timer.Next(ProfilePhase::Allocate);
+
+        if (perf) {
+            perfCounters.Start();
+        }
+        std::error_code ec;
+        const size_t compressedSize = TopDec::encode_file_image(
+            static_cast<uint8_t>(compressionType), uncompressed, output, level, ec);
+        if (perf) {
+            perfReport.Add(perf_format_name(static_cast<uint8_t>(compressionType), true),
+                           uncompressed.size(),
+                           perfCounters.Stop());
+        }
+        if (ec) {
+            if (cache) {
+                cache->Abandon(cacheKey);
+            }
+            printf("compression failure: %s\n", ec.message().c_str());
             return -1;
         }
 
-        if (compressedSize >= 0x10000) {
+        timer.Next(ProfilePhase::Codec);
+
+        if (compressedSize - compressed_header_size >= 0x10000) {
+            if (cache) {
+                cache->Abandon(cacheKey);
+            }
             printf("output too large\n");
             return -1;
         }
-
-        compressed[0] = static_cast<char>(static_cast<uint8_t>(compressionType));
-        compressed[1] = static_cast<char>(compressedSize & 0xff);
-        compressed[2] = static_cast<char>((compressedSize >> 8) & 0xff);
-        compressed[3] = 0;
-        compressed[4] = 0;
-        compressed[5] = static_cast<char>(uncompressed.size() & 0xff);
-        compressed[6] = static_cast<char>((uncompressed.size() >> 8) & 0xff);
-        compressed[7] = 0;
-        compressed[8] = 0;
+        if (cache) {
+            cache->Store(cacheKey, output.first(compressedSize));
+            cache->Trim();
+        }
 
         HyoutaUtils::IO::File outfile(std::filesystem::path(target),
                                       HyoutaUtils::IO::OpenMode::Write);
@@ -223,13 +783,17 @@ int main(int argc, char** argv) {
             printf("failed to open output file\n");
             return -1;
         }
-        if (outfile.Write(compressed.data(), compressedSize + headerSize)
-            != (compressedSize + headerSize)) {
+        if (outfile.Write(compressed.data(), compressedSize) != compressedSize) {
             printf("failed to write output file\n");
             return -1;
         }
+        outfile.Close();
+        timer.Next(ProfilePhase::Write);
 
-        return 0;
+        if (perf && !ReportPerf(perfReport, perfJsonPath)) {
+            return -1;
+        }
+        return ReportProfile(report, std::move(sample), profile, profileJsonPath);
     }
 
     PrintUsage();
@@ -0,0 +1,245 @@
+#include "mirror.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "batch.h"
+#include "file.h"
+#include "thread_pool.h"
+
+static bool MatchGlobAt(std::string_view pattern, std::string_view path) {
+    while (!pattern.empty()) {
+        if (pattern.starts_with("**")) {
+            pattern.remove_prefix(2);
+            // 'a/**/b' should also match 'a/b'
+            if (pattern.starts_with('/') && MatchGlobAt(pattern.substr(1), path)) {
+                return true;
+            }
+            for (size_t i = 0; i <= path.size(); ++i) {
+                if (MatchGlobAt(pattern, path.substr(i))) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        if (pattern[0] == '*') {
+            pattern.remove_prefix(1);
+            for (size_t i = 0;; ++i) {
+                if (MatchGlobAt(pattern, path.substr(i))) {
+                    return true;
+                }
+                if (i == path.size() || path[i] == '/') {
+                    return false;
+                }
+            }
+        }
+        if (path.empty()) {
+            return false;
+        }
+        if (pattern[0] == '?' ? path[0] == '/' : pattern[0] != path[0]) {
+            return false;
+        }
+        pattern.remove_prefix(1);
+        path.remove_prefix(1);
+    }
+    return path.empty();
+}
+
+bool match_glob(std::string_view pattern, std::string_view path) {
+    if (pattern.find('/') == std::string_view::npos) {
+        const size_t slash = path.rfind('/');
+        if (slash != std::string_view::npos) {
+            path.remove_prefix(slash + 1);
+        }
+    }
+    return MatchGlobAt(pattern, path);
+}
+
+void list_files_recursive(const std::filesystem::path& directory,
+                          std::vector<std::filesystem::path>& files,
+                          std::vector<std::filesystem::path>& unreadable) {
+    std::vector<std::filesystem::path> pending{directory};
+    while (!pending.empty()) {
+        const std::filesystem::path current = std::move(pending.back());
+        pending.pop_back();
+        std::error_code ec;
+        std::filesystem::directory_iterator it(current, ec);
+        for (; !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+            std::error_code typeEc;
+            if (it->is_directory(typeEc) && !it->is_symlink(typeEc)) {
+                pending.push_back(it->path());
+            } else if (it->is_regular_file(typeEc)) {
+                files.push_back(it->path());
+            }
+        }
+        if (ec) {
+            unreadable.push_back(current);
+        }
+    }
+}
+
+static bool MatchesAny(const std::vector<std::string>& patterns, std::string_view path) {
+    for (const auto& pattern : patterns) {
+        if (match_glob(pattern, path)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace {
+// What listing a single directory found. All paths are relative to the source directory.
+struct DirectoryListing {
+    std::vector<std::filesystem::path> Directories;
+    std::vector<std::filesystem::path> Files;
+    size_t Skipped = 0;
+    bool Failed = false;
+};
+} // namespace
+
+static bool IsUpToDate(const std::filesystem::directory_entry& input,
+                       const std::filesystem::path& output) {
+    std::error_code ec;
+    const auto outputTime = std::filesystem::last_write_time(output, ec);
+    if (ec) {
+        return false;
+    }
+    const auto inputTime = input.last_write_time(ec);
+    if (ec) {
+        return false;
+    }
+    return outputTime >= inputTime;
+}
+
+static void ListDirectory(const std::filesystem::path& source,
+                          const std::filesystem::path& target,
+                          const std::filesystem::path& relative,
+                          const MirrorOptions& options,
+                          DirectoryListing& listing) {
+    std::error_code ec;
+    std::filesystem::directory_iterator it(source / relative, ec);
+    if (ec) {
+        listing.Failed = true;
+        return;
+    }
+    for (; it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        const auto& entry = *it;
+        auto path = relative / entry.path().filename();
+        const std::string generic = path.generic_string();
+        if (MatchesAny(options.Exclude, generic)) {
+            continue;
+        }
+
+        // don't follow directory symlinks, they could lead back up the tree
+        std::error_code typeEc;
+        if (entry.is_directory(typeEc) && !entry.is_symlink(typeEc)) {
+            listing.Directories.push_back(std::move(path));
+            continue;
+        }
+        if (!entry.is_regular_file(typeEc)) {
+            continue;
+        }
+        if (!options.Include.empty() && !MatchesAny(options.Include, generic)) {
+            continue;
+        }
+        if (options.SkipIfNewer && IsUpToDate(entry, target / path)) {
+            ++listing.Skipped;
+            continue;
+        }
+        listing.Files.push_back(std::move(path));
+    }
+    if (ec) {
+        listing.Failed = true;
+    }
+}
+
+int run_mirror(const std::filesystem::path& source,
+               const std::filesystem::path& target,
+               const MirrorOptions& options) {
+    if (!HyoutaUtils::IO::DirectoryExists(source)) {
+        printf("input is not a directory\n");
+        return -1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // Walk the tree one level at a time, listing all directories of a level in parallel. Listing
+    // is mostly waiting for the filesystem, so this helps even with few cores.
+    std::vector<std::filesystem::path> directories;
+    std::vector<std::filesystem::path> files;
+    size_t skipped = 0;
+    size_t unreadable = 0;
+    {
+        ThreadPool pool(options.Batch.Threads);
+        std::vector<std::filesystem::path> level{std::filesystem::path()};
+        while (!level.empty()) {
+            std::vector<DirectoryListing> listings(level.size());
+            pool.ParallelFor(level.size(), [&](size_t i) {
+                ListDirectory(source, target, level[i], options, listings[i]);
+            });
+
+            std::vector<std::filesystem::path> next;
+            for (size_t i = 0; i < level.size(); ++i) {
+                DirectoryListing& listing = listings[i];
+                if (listing.Failed) {
+                    printf("FAILED  %s: failed to read directory\n",
+                           (source / level[i]).string().c_str());
+                    ++unreadable;
+                }
+                skipped += listing.Skipped;
+                for (auto& file : listing.Files) {
+                    files.push_back(std::move(file));
+                }
+                for (auto& directory : listing.Directories) {
+                    next.push_back(std::move(directory));
+                }
+            }
+            directories.insert(directories.end(), next.begin(), next.end());
+            level = std::move(next);
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    // Parents are listed before their children, so every directory is created exactly once here,
+    // and the batch below finds all of them in the cache.
+    DirectoryCache directoryCache;
+    if (!directoryCache.Create(target)) {
+        printf("failed to create output directory\n");
+        return -1;
+    }
+    for (const auto& directory : directories) {
+        if (!directoryCache.Create(target / directory)) {
+            printf("failed to create output directory %s\n",
+                   (target / directory).string().c_str());
+            return -1;
+        }
+    }
+
+    std::vector<BatchJob> jobs(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        BatchJob& job = jobs[i];
+        job.Op = options.Op;
+        job.Type = options.Type;
+        job.Level = options.Level;
+        job.Input = source / files[i];
+        job.Output = target / files[i];
+    }
+
+    BatchOptions batchOptions = options.Batch;
+    batchOptions.Directories = &directoryCache;
+    const auto results = run_batch(jobs, batchOptions);
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const size_t failed = print_batch_status(jobs, results, seconds, true);
+    if (skipped != 0) {
+        printf("%zu files skipped because their output is up to date\n", skipped);
+    }
+    return failed == 0 && unreadable == 0 ? 0 : -1;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "batch.h"
+#include "compress.h"
+
+struct MirrorOptions {
+    BatchOp Op = BatchOp::Decompress;
+
+    // compression type and level, only used for BatchOp::Compress
+    uint8_t Type = 0x83;
+    int Level = compress_default_level;
+
+    // Glob patterns matched against paths relative to the source directory, with '/' as separator.
+    // If any include patterns are given, only files matching one of them are processed. Files and
+    // directories matching an exclude pattern are skipped.
+    std::vector<std::string> Include;
+    std::vector<std::string> Exclude;
+
+    // skip files whose output already exists and is not older than the input
+    bool SkipIfNewer = false;
+
+    BatchOptions Batch;
+};
+
+// Matches 'path' against a glob pattern. '?' matches any single character and '*' any sequence of
+// characters except '/', '**' also matches across directories. A pattern without any '/' is
+// matched against the file name only.
+bool match_glob(std::string_view pattern, std::string_view path);
+
+// Collects the regular files below 'directory', without following directory symlinks. Directories
+// that can't be read are collected into 'unreadable' and skipped, so one of them doesn't hide the
+// files of all others.
+void list_files_recursive(const std::filesystem::path& directory,
+                          std::vector<std::filesystem::path>& files,
+                          std::vector<std::filesystem::path>& unreadable);
+
+// Processes every file below 'source' and writes the result to the same relative path below
+// 'target', recreating the directory structure. Prints the status of failed files and a summary.
+// Returns 0 if every file succeeded and -1 otherwise.
+int run_mirror(const std::filesystem::path& source,
+               const std::filesystem::path& target,
+               const MirrorOptions& options);
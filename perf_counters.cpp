@@ -0,0 +1,278 @@
+#include "perf_counters.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file.h"
+#include "json.h"
+#include "profile.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char* perf_counter_name(PerfCounter counter) {
+    switch (counter) {
+        case PerfCounter::Cycles: return "cycles";
+        case PerfCounter::Instructions: return "instructions";
+        case PerfCounter::BranchMisses: return "branch_misses";
+        case PerfCounter::L1DMisses: return "l1d_misses";
+        case PerfCounter::LLCMisses: return "llc_misses";
+        default: return "unknown";
+    }
+}
+
+std::string perf_format_name(uint8_t type, bool compress) {
+    static constexpr char hex[] = "0123456789abcdef";
+    std::string s = compress ? "compress_" : "decompress_";
+    s += hex[type >> 4];
+    s += hex[type & 0xf];
+    return s;
+}
+
+PerfCounterGroup::PerfCounterGroup() noexcept {
+    Fds.fill(-1);
+}
+
+PerfCounterGroup::~PerfCounterGroup() noexcept {
+    Close();
+}
+
+#ifdef __linux__
+static int OpenPerfEvent(uint32_t type, uint64_t config, int groupFd) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = groupFd == -1 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+}
+#endif
+
+bool PerfCounterGroup::Open() noexcept {
+    Close();
+#ifdef __linux__
+    static constexpr uint64_t l1dReadMiss = PERF_COUNT_HW_CACHE_L1D
+                                            | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    struct EventConfig {
+        uint32_t Type;
+        uint64_t Config;
+    };
+    static constexpr std::array<EventConfig, perf_counter_count> configs = {{
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HW_CACHE, l1dReadMiss},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    }};
+
+    // cycles lead the group; if that's not available there is no point in the others
+    Fds[0] = OpenPerfEvent(configs[0].Type, configs[0].Config, -1);
+    if (Fds[0] == -1) {
+        return false;
+    }
+    for (size_t i = 1; i < perf_counter_count; ++i) {
+        Fds[i] = OpenPerfEvent(configs[i].Type, configs[i].Config, Fds[0]);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool PerfCounterGroup::IsOpen() const noexcept {
+    return Fds[0] != -1;
+}
+
+void PerfCounterGroup::Close() noexcept {
+#ifdef __linux__
+    for (int& fd : Fds) {
+        if (fd != -1) {
+            close(fd);
+            fd = -1;
+        }
+    }
+#endif
+}
+
+void PerfCounterGroup::Start() noexcept {
+#ifdef __linux__
+    if (!IsOpen()) {
+        return;
+    }
+    ioctl(Fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(Fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+PerfCounterValues PerfCounterGroup::Stop() noexcept {
+    PerfCounterValues result;
+#ifdef __linux__
+    if (!IsOpen()) {
+        return result;
+    }
+    ioctl(Fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    std::array<uint64_t, perf_counter_count> ids{};
+    for (size_t i = 0; i < perf_counter_count; ++i) {
+        if (Fds[i] != -1 && ioctl(Fds[i], PERF_EVENT_IOC_ID, &ids[i]) != 0) {
+            ids[i] = 0;
+        }
+    }
+
+    // layout with PERF_FORMAT_GROUP | PERF_FORMAT_ID: nr, then nr pairs of (value, id)
+    std::array<uint64_t, 1 + perf_counter_count * 2> buffer{};
+    const ssize_t bytesRead = read(Fds[0], buffer.data(), sizeof(buffer));
+    if (bytesRead < static_cast<ssize_t>(sizeof(uint64_t))) {
+        return result;
+    }
+    const uint64_t nr = std::min<uint64_t>(buffer[0], perf_counter_count);
+    for (uint64_t e = 0; e < nr; ++e) {
+        const uint64_t value = buffer[1 + e * 2];
+        const uint64_t id = buffer[2 + e * 2];
+        for (size_t i = 0; i < perf_counter_count; ++i) {
+            if (Fds[i] != -1 && ids[i] == id) {
+                result.Values[i] = value;
+                result.Available[i] = true;
+            }
+        }
+    }
+#endif
+    return result;
+}
+
+void PerfReport::Add(std::string_view format,
+                     uint64_t inputBytes,
+                     const PerfCounterValues& values) {
+    const size_t bucket = size_bucket_index(inputBytes);
+    std::lock_guard lock(Mutex);
+    auto it = std::find_if(Entries.begin(), Entries.end(), [&](const Entry& e) {
+        return e.Format == format && e.SizeBucket == bucket;
+    });
+    if (it == Entries.end()) {
+        Entry& e = Entries.emplace_back();
+        e.Format = std::string(format);
+        e.SizeBucket = bucket;
+        e.Totals.Available.fill(true);
+        it = Entries.end() - 1;
+    }
+    it->Calls += 1;
+    it->Bytes += inputBytes;
+    for (size_t i = 0; i < perf_counter_count; ++i) {
+        it->Totals.Values[i] += values.Values[i];
+        it->Totals.Available[i] = it->Totals.Available[i] && values.Available[i];
+    }
+}
+
+std::vector<PerfReport::Entry> PerfReport::SortedEntries() const {
+    std::vector<Entry> entries;
+    {
+        std::lock_guard lock(Mutex);
+        entries = Entries;
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) {
+        if (lhs.Format != rhs.Format) {
+            return lhs.Format < rhs.Format;
+        }
+        return lhs.SizeBucket < rhs.SizeBucket;
+    });
+    return entries;
+}
+
+static double PerKilobyte(const PerfCounterValues& v, PerfCounter c, uint64_t bytes) {
+    const size_t i = static_cast<size_t>(c);
+    if (!v.Available[i] || bytes == 0) {
+        return -1.0;
+    }
+    return static_cast<double>(v.Values[i]) * 1024.0 / static_cast<double>(bytes);
+}
+
+static double InstructionsPerCycle(const PerfCounterValues& v) {
+    const size_t cycles = static_cast<size_t>(PerfCounter::Cycles);
+    const size_t instructions = static_cast<size_t>(PerfCounter::Instructions);
+    if (!v.Available[cycles] || !v.Available[instructions] || v.Values[cycles] == 0) {
+        return -1.0;
+    }
+    return static_cast<double>(v.Values[instructions]) / static_cast<double>(v.Values[cycles]);
+}
+
+void PerfReport::Print() const {
+    const auto entries = SortedEntries();
+    if (entries.empty()) {
+        printf("performance counters: no samples (perf_event_open unavailable?)\n");
+        return;
+    }
+
+    // values below 0 mean that counter was not available
+    printf("performance counters (per KB of input):\n");
+    printf("  %-14s %-10s %6s %10s %7s %12s %10s %10s\n",
+           "format",
+           "size",
+           "calls",
+           "cycles",
+           "ipc",
+           "branch-miss",
+           "l1d-miss",
+           "llc-miss");
+    for (const auto& e : entries) {
+        printf("  %-14s %-10s %6llu %10.1f %7.3f %12.2f %10.2f %10.2f\n",
+               e.Format.c_str(),
+               size_bucket_name(e.SizeBucket),
+               static_cast<unsigned long long>(e.Calls),
+               PerKilobyte(e.Totals, PerfCounter::Cycles, e.Bytes),
+               InstructionsPerCycle(e.Totals),
+               PerKilobyte(e.Totals, PerfCounter::BranchMisses, e.Bytes),
+               PerKilobyte(e.Totals, PerfCounter::L1DMisses, e.Bytes),
+               PerKilobyte(e.Totals, PerfCounter::LLCMisses, e.Bytes));
+    }
+}
+
+void PerfReport::WriteJson(HyoutaUtils::Json::Writer& json) const {
+    const auto entries = SortedEntries();
+    json.BeginArray();
+    for (const auto& e : entries) {
+        json.BeginObject();
+        json.Key("format");
+        json.String(e.Format);
+        json.Key("size");
+        json.String(size_bucket_name(e.SizeBucket));
+        json.Key("calls");
+        json.UInt(e.Calls);
+        json.Key("bytes");
+        json.UInt(e.Bytes);
+        for (size_t i = 0; i < perf_counter_count; ++i) {
+            json.Key(perf_counter_name(static_cast<PerfCounter>(i)));
+            if (e.Totals.Available[i]) {
+                json.UInt(e.Totals.Values[i]);
+            } else {
+                json.Null();
+            }
+        }
+        json.EndObject();
+    }
+    json.EndArray();
+}
+
+bool PerfReport::WriteJsonFile(std::string_view path) const {
+    HyoutaUtils::Json::Writer json;
+    WriteJson(json);
+    HyoutaUtils::IO::File outfile(path, HyoutaUtils::IO::OpenMode::Write);
+    if (!outfile.IsOpen()) {
+        return false;
+    }
+    const std::string& s = json.GetString();
+    return outfile.Write(s.data(), s.size()) == s.size();
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.h"
+
+// Hardware performance counters around individual codec calls. Only implemented on Linux via
+// perf_event_open(); elsewhere, or when the kernel refuses access (see
+// /proc/sys/kernel/perf_event_paranoid), Open() fails and the counters stay unavailable.
+
+enum class PerfCounter {
+    Cycles,
+    Instructions,
+    BranchMisses,
+    L1DMisses,
+    LLCMisses,
+};
+constexpr size_t perf_counter_count = 5;
+const char* perf_counter_name(PerfCounter counter);
+
+struct PerfCounterValues {
+    std::array<uint64_t, perf_counter_count> Values{};
+
+    // counters that could not be opened on this machine are reported as unavailable
+    std::array<bool, perf_counter_count> Available{};
+};
+
+// Counts events of the calling thread between Start() and Stop(). Not thread-safe; use one
+// instance per thread.
+struct PerfCounterGroup {
+public:
+    PerfCounterGroup() noexcept;
+    PerfCounterGroup(const PerfCounterGroup& other) = delete;
+    PerfCounterGroup(PerfCounterGroup&& other) = delete;
+    PerfCounterGroup& operator=(const PerfCounterGroup& other) = delete;
+    PerfCounterGroup& operator=(PerfCounterGroup&& other) = delete;
+    ~PerfCounterGroup() noexcept;
+
+    bool Open() noexcept;
+    bool IsOpen() const noexcept;
+    void Close() noexcept;
+    void Start() noexcept;
+    PerfCounterValues Stop() noexcept;
+
+private:
+    std::array<int, perf_counter_count> Fds;
+};
+
+// Aggregates counter values per compression format and input size bucket (see profile.h).
+struct PerfReport {
+public:
+    void Add(std::string_view format, uint64_t inputBytes, const PerfCounterValues& values);
+
+    void Print() const;
+    void WriteJson(HyoutaUtils::Json::Writer& json) const;
+    bool WriteJsonFile(std::string_view path) const;
+
+private:
+    struct Entry {
+        std::string Format;
+        size_t SizeBucket;
+        uint64_t Calls = 0;
+        uint64_t Bytes = 0;
+        PerfCounterValues Totals;
+    };
+
+    std::vector<Entry> SortedEntries() const;
+
+    mutable std::mutex Mutex;
+    std::vector<Entry> Entries;
+};
+
+// Name of a compression type byte as used for the report, eg. "83".
+std::string perf_format_name(uint8_t type, bool compress);
@@ -0,0 +1,302 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file.h"
+#include "json.h"
+
+#ifdef _MSC_VER
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+const char* profile_phase_name(ProfilePhase phase) {
+    switch (phase) {
+        case ProfilePhase::Read: return "read";
+        case ProfilePhase::Allocate: return "allocate";
+        case ProfilePhase::Codec: return "codec";
+        case ProfilePhase::Write: return "write";
+        default: return "unknown";
+    }
+}
+
+size_t size_bucket_index(uint64_t size) {
+    size_t index = 0;
+    uint64_t limit = 1024;
+    while (index < (size_bucket_count - 1) && size >= limit) {
+        ++index;
+        limit *= 4;
+    }
+    return index;
+}
+
+const char* size_bucket_name(size_t index) {
+    static constexpr std::array<const char*, size_bucket_count> names = {
+        "<1KB", "1KB-4KB", "4KB-16KB", "16KB-64KB", "64KB-256KB", "256KB-1MB", ">=1MB"};
+    return index < names.size() ? names[index] : "unknown";
+}
+
+uint64_t get_wall_time_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now().time_since_epoch())
+                                     .count());
+}
+
+uint64_t get_thread_cpu_time_ns() {
+#ifdef _MSC_VER
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime) == 0) {
+        return 0;
+    }
+    const uint64_t kernel = (static_cast<uint64_t>(kernelTime.dwHighDateTime) << 32)
+                            | static_cast<uint64_t>(kernelTime.dwLowDateTime);
+    const uint64_t user = (static_cast<uint64_t>(userTime.dwHighDateTime) << 32)
+                          | static_cast<uint64_t>(userTime.dwLowDateTime);
+    return (kernel + user) * 100;
+#else
+    struct timespec ts {};
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000u + static_cast<uint64_t>(ts.tv_nsec);
+#endif
+}
+
+uint64_t PhaseTimes::TotalWallNs() const {
+    uint64_t total = 0;
+    for (uint64_t t : WallNs) {
+        total += t;
+    }
+    return total;
+}
+
+uint64_t PhaseTimes::TotalCpuNs() const {
+    uint64_t total = 0;
+    for (uint64_t t : CpuNs) {
+        total += t;
+    }
+    return total;
+}
+
+PhaseTimer::PhaseTimer(PhaseTimes& times)
+  : Times(times), LastWall(get_wall_time_ns()), LastCpu(get_thread_cpu_time_ns()) {}
+
+void PhaseTimer::Next(ProfilePhase phase) {
+    const uint64_t wall = get_wall_time_ns();
+    const uint64_t cpu = get_thread_cpu_time_ns();
+    Times.WallNs[static_cast<size_t>(phase)] += wall - LastWall;
+    Times.CpuNs[static_cast<size_t>(phase)] += cpu - LastCpu;
+    LastWall = wall;
+    LastCpu = cpu;
+}
+
+ProfileReport::ProfileReport() : StartNs(get_wall_time_ns()), EndNs(StartNs) {}
+
+void ProfileReport::Add(ProfileSample sample) {
+    std::lock_guard lock(Mutex);
+    Samples.push_back(std::move(sample));
+}
+
+void ProfileReport::Finish() {
+    EndNs = get_wall_time_ns();
+}
+
+namespace {
+struct LatencySummary {
+    uint64_t Files = 0;
+    uint64_t Bytes = 0;
+    uint64_t TotalNs = 0;
+    uint64_t P50Ns = 0;
+    uint64_t P99Ns = 0;
+    uint64_t MaxNs = 0;
+};
+} // namespace
+
+static uint64_t Percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(p * static_cast<double>(sorted.size()) + 0.999999);
+    rank = std::clamp(rank, size_t(1), sorted.size());
+    return sorted[rank - 1];
+}
+
+static std::array<LatencySummary, size_bucket_count>
+    SummarizeBuckets(const std::vector<ProfileSample>& samples) {
+    std::array<std::vector<uint64_t>, size_bucket_count> latencies;
+    std::array<LatencySummary, size_bucket_count> summaries;
+    for (const auto& sample : samples) {
+        const size_t bucket = size_bucket_index(sample.InputBytes);
+        const uint64_t ns = sample.Times.TotalWallNs();
+        latencies[bucket].push_back(ns);
+        summaries[bucket].Files += 1;
+        summaries[bucket].Bytes += sample.InputBytes;
+        summaries[bucket].TotalNs += ns;
+    }
+    for (size_t i = 0; i < size_bucket_count; ++i) {
+        auto& l = latencies[i];
+        std::sort(l.begin(), l.end());
+        summaries[i].P50Ns = Percentile(l, 0.5);
+        summaries[i].P99Ns = Percentile(l, 0.99);
+        summaries[i].MaxNs = l.empty() ? 0 : l.back();
+    }
+    return summaries;
+}
+
+static double MegabytesPerSecond(uint64_t bytes, uint64_t ns) {
+    if (ns == 0) {
+        return 0.0;
+    }
+    return (static_cast<double>(bytes) / (1024.0 * 1024.0))
+           / (static_cast<double>(ns) / 1'000'000'000.0);
+}
+
+static double Milliseconds(uint64_t ns) {
+    return static_cast<double>(ns) / 1'000'000.0;
+}
+
+void ProfileReport::Print() const {
+    std::lock_guard lock(Mutex);
+
+    PhaseTimes totals;
+    uint64_t totalBytes = 0;
+    for (const auto& sample : Samples) {
+        for (size_t i = 0; i < profile_phase_count; ++i) {
+            totals.WallNs[i] += sample.Times.WallNs[i];
+            totals.CpuNs[i] += sample.Times.CpuNs[i];
+        }
+        totalBytes += sample.InputBytes;
+    }
+
+    printf("profile (%zu file%s, %llu bytes):\n",
+           Samples.size(),
+           Samples.size() == 1 ? "" : "s",
+           static_cast<unsigned long long>(totalBytes));
+    printf("  %-10s %12s %12s\n", "phase", "wall ms", "cpu ms");
+    for (size_t i = 0; i < profile_phase_count; ++i) {
+        printf("  %-10s %12.3f %12.3f\n",
+               profile_phase_name(static_cast<ProfilePhase>(i)),
+               Milliseconds(totals.WallNs[i]),
+               Milliseconds(totals.CpuNs[i]));
+    }
+    printf("  %-10s %12.3f %12.3f\n",
+           "total",
+           Milliseconds(totals.TotalWallNs()),
+           Milliseconds(totals.TotalCpuNs()));
+
+    if (Samples.size() <= 1) {
+        return;
+    }
+
+    const auto buckets = SummarizeBuckets(Samples);
+    printf("  %-10s %8s %12s %12s %12s %10s\n",
+           "size",
+           "files",
+           "p50 ms",
+           "p99 ms",
+           "max ms",
+           "MB/s");
+    for (size_t i = 0; i < size_bucket_count; ++i) {
+        const auto& b = buckets[i];
+        if (b.Files == 0) {
+            continue;
+        }
+        printf("  %-10s %8llu %12.3f %12.3f %12.3f %10.2f\n",
+               size_bucket_name(i),
+               static_cast<unsigned long long>(b.Files),
+               Milliseconds(b.P50Ns),
+               Milliseconds(b.P99Ns),
+               Milliseconds(b.MaxNs),
+               MegabytesPerSecond(b.Bytes, b.TotalNs));
+    }
+    printf("  overall: %.3f ms, %.2f MB/s\n",
+           Milliseconds(EndNs - StartNs),
+           MegabytesPerSecond(totalBytes, EndNs - StartNs));
+}
+
+void ProfileReport::WriteJson(HyoutaUtils::Json::Writer& json) const {
+    std::lock_guard lock(Mutex);
+
+    uint64_t totalBytes = 0;
+    for (const auto& sample : Samples) {
+        totalBytes += sample.InputBytes;
+    }
+
+    json.BeginObject();
+    json.Key("files");
+    json.UInt(Samples.size());
+    json.Key("bytes");
+    json.UInt(totalBytes);
+    json.Key("wall_ns");
+    json.UInt(EndNs - StartNs);
+    json.Key("throughput_mb_per_s");
+    json.Double(MegabytesPerSecond(totalBytes, EndNs - StartNs));
+
+    json.Key("size_buckets");
+    json.BeginArray();
+    const auto buckets = SummarizeBuckets(Samples);
+    for (size_t i = 0; i < size_bucket_count; ++i) {
+        const auto& b = buckets[i];
+        if (b.Files == 0) {
+            continue;
+        }
+        json.BeginObject();
+        json.Key("size");
+        json.String(size_bucket_name(i));
+        json.Key("files");
+        json.UInt(b.Files);
+        json.Key("bytes");
+        json.UInt(b.Bytes);
+        json.Key("p50_ns");
+        json.UInt(b.P50Ns);
+        json.Key("p99_ns");
+        json.UInt(b.P99Ns);
+        json.Key("max_ns");
+        json.UInt(b.MaxNs);
+        json.Key("throughput_mb_per_s");
+        json.Double(MegabytesPerSecond(b.Bytes, b.TotalNs));
+        json.EndObject();
+    }
+    json.EndArray();
+
+    json.Key("samples");
+    json.BeginArray();
+    for (const auto& sample : Samples) {
+        json.BeginObject();
+        json.Key("path");
+        json.String(sample.Path);
+        json.Key("bytes");
+        json.UInt(sample.InputBytes);
+        for (size_t i = 0; i < profile_phase_count; ++i) {
+            const std::string name = profile_phase_name(static_cast<ProfilePhase>(i));
+            json.Key(name + "_wall_ns");
+            json.UInt(sample.Times.WallNs[i]);
+            json.Key(name + "_cpu_ns");
+            json.UInt(sample.Times.CpuNs[i]);
+        }
+        json.EndObject();
+    }
+    json.EndArray();
+    json.EndObject();
+}
+
+bool ProfileReport::WriteJsonFile(std::string_view path) const {
+    HyoutaUtils::Json::Writer json;
+    WriteJson(json);
+    HyoutaUtils::IO::File outfile(path, HyoutaUtils::IO::OpenMode::Write);
+    if (!outfile.IsOpen()) {
+        return false;
+    }
+    const std::string& s = json.GetString();
+    return outfile.Write(s.data(), s.size()) == s.size();
+}
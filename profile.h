@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json.h"
+
+enum class ProfilePhase {
+    Read,
+    Allocate,
+    Codec,
+    Write,
+};
+constexpr size_t profile_phase_count = 4;
+const char* profile_phase_name(ProfilePhase phase);
+
+// Files are grouped into buckets by size for reporting: <1KB, <4KB, <16KB, <64KB, <256KB, <1MB
+// and everything larger.
+constexpr size_t size_bucket_count = 7;
+size_t size_bucket_index(uint64_t size);
+const char* size_bucket_name(size_t index);
+
+uint64_t get_wall_time_ns();
+uint64_t get_thread_cpu_time_ns();
+
+struct PhaseTimes {
+    std::array<uint64_t, profile_phase_count> WallNs{};
+    std::array<uint64_t, profile_phase_count> CpuNs{};
+
+    uint64_t TotalWallNs() const;
+    uint64_t TotalCpuNs() const;
+};
+
+// Measures consecutive phases of work on the current thread. Every call to Next() attributes the
+// time since the previous call (or construction) to the given phase.
+struct PhaseTimer {
+public:
+    explicit PhaseTimer(PhaseTimes& times);
+
+    void Next(ProfilePhase phase);
+
+private:
+    PhaseTimes& Times;
+    uint64_t LastWall;
+    uint64_t LastCpu;
+};
+
+struct ProfileSample {
+    std::string Path;
+    uint64_t InputBytes = 0;
+    PhaseTimes Times;
+};
+
+// Collects per-file samples from any number of threads and summarizes them.
+struct ProfileReport {
+public:
+    ProfileReport();
+
+    void Add(ProfileSample sample);
+
+    // Marks the end of the run; the time between construction and this call is the wall time
+    // used for the overall throughput.
+    void Finish();
+
+    void Print() const;
+    void WriteJson(HyoutaUtils::Json::Writer& json) const;
+    bool WriteJsonFile(std::string_view path) const;
+
+private:
+    mutable std::mutex Mutex;
+    std::vector<ProfileSample> Samples;
+    uint64_t StartNs;
+    uint64_t EndNs;
+};
@@ -0,0 +1,380 @@
+#include "scan.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "compress.h"
+#include "decompress_observed.h"
+#include "file.h"
+#include "header.h"
+#include "json.h"
+#include "thread_pool.h"
+#include "topdec.h"
+
+// Both lengths of a file image stay below 64 KiB, the same limit 'topdec c' enforces. This makes
+// the four high length bytes of a header zero, which rules out almost every offset right away.
+constexpr uint32_t scan_max_length = 0xffff;
+
+// The most output a stream can produce per compressed byte: a 3-byte run token writes up to 274
+// bytes, plus its share of a flag byte.
+constexpr uint32_t scan_max_expansion = 92;
+
+// Offsets are checked in chunks of this size, one chunk per job.
+constexpr size_t scan_chunk_size = 1024 * 1024;
+
+namespace {
+// Tracks where the last token of a stream ends, so a candidate can be checked for ending exactly
+// at its compressed length.
+struct StreamEndObserver {
+    size_t End = 0;
+
+    void OnFlagByte(size_t in) {
+        End = in + 1;
+    }
+    void OnLiteral(size_t in, size_t /*out*/, char /*c*/) {
+        End = in + 1;
+    }
+    void OnRun(size_t in, size_t /*out*/, char /*c*/, size_t count) {
+        // runs of 19 or more bytes take a third byte for the count
+        End = in + (count >= 19 ? 3 : 2);
+    }
+    void OnBackref(size_t in, size_t /*out*/, size_t /*offset*/, size_t /*count*/) {
+        End = in + 2;
+    }
+    void OnDictRef(size_t in, size_t /*out*/, size_t /*dictOffset*/, size_t /*count*/) {
+        End = in + 2;
+    }
+};
+} // namespace
+
+// Inlined rather than going through parse_compressed_header(), as this runs for every offset that
+// gets past the zero byte filter in ScanChunk().
+static uint32_t ReadLength(const char* data) {
+    return static_cast<uint32_t>(static_cast<uint8_t>(data[0]))
+           | (static_cast<uint32_t>(static_cast<uint8_t>(data[1])) << 8)
+           | (static_cast<uint32_t>(static_cast<uint8_t>(data[2])) << 16)
+           | (static_cast<uint32_t>(static_cast<uint8_t>(data[3])) << 24);
+}
+
+static bool IsPlausibleHeader(const char* data, uint32_t minUncompressedLength, bool stored) {
+    const uint8_t type = static_cast<uint8_t>(data[0]);
+    const uint32_t compressedLength = ReadLength(data + 1);
+    const uint32_t uncompressedLength = ReadLength(data + 5);
+    if (compressedLength > scan_max_length || uncompressedLength > scan_max_length) {
+        return false;
+    }
+    if (uncompressedLength < minUncompressedLength || compressedLength == 0) {
+        return false;
+    }
+    switch (type) {
+        case 0x00: return stored && compressedLength == uncompressedLength;
+        case 0x01:
+        case 0x03:
+        case 0x81:
+        case 0x83:
+            return compressedLength <= compress_81_83_bound(uncompressedLength)
+                   && uncompressedLength <= compressedLength * scan_max_expansion;
+        default: return false;
+    }
+}
+
+static bool ValidateStream(const char* compressed,
+                           const CompressedHeader& header,
+                           std::vector<char>& buffer) {
+    if (header.Type == 0x00) {
+        return true;
+    }
+    buffer.resize(header.UncompressedLength);
+    StreamEndObserver observer;
+    int64_t result;
+    const size_t compressedLength = header.CompressedLength;
+    const size_t uncompressedLength = header.UncompressedLength;
+    switch (header.Type) {
+        case 0x01:
+            result = decompress_internal<true, false, StreamEndObserver, true>(
+                compressed, compressedLength, buffer.data(), uncompressedLength, observer);
+            break;
+        case 0x03:
+            result = decompress_internal<true, true, StreamEndObserver, true>(
+                compressed, compressedLength, buffer.data(), uncompressedLength, observer);
+            break;
+        case 0x81:
+            result = decompress_internal<false, false, StreamEndObserver, true>(
+                compressed, compressedLength, buffer.data(), uncompressedLength, observer);
+            break;
+        case 0x83:
+            result = decompress_internal<false, true, StreamEndObserver, true>(
+                compressed, compressedLength, buffer.data(), uncompressedLength, observer);
+            break;
+        default: return false;
+    }
+    return result == static_cast<int64_t>(uncompressedLength) && observer.End == compressedLength;
+}
+
+static bool HasZeroByte(uint64_t word) {
+    return ((word - 0x0101'0101'0101'0101u) & ~word & 0x8080'8080'8080'8080u) != 0;
+}
+
+static void ScanChunk(std::span<const char> data,
+                      size_t begin,
+                      size_t end,
+                      const ScanOptions& options,
+                      std::vector<ScanHit>& hits) {
+    std::vector<char> buffer;
+    const size_t last = std::min(end, data.size() - compressed_header_size + 1);
+    size_t offset = begin;
+    while (offset < last) {
+        // A header at any of the next eight offsets has its last byte, which must be zero, in the
+        // eight bytes after them. Most of a typical image has no zero byte there, so this skips it
+        // eight offsets at a time. The same goes for zero padding, as only stored entries have a
+        // zero type byte.
+        if (offset + 16 <= data.size()) {
+            uint64_t types;
+            uint64_t lastBytes;
+            std::memcpy(&types, data.data() + offset, sizeof(types));
+            std::memcpy(&lastBytes, data.data() + offset + 8, sizeof(lastBytes));
+            if (!HasZeroByte(lastBytes) || (types == 0 && !options.IncludeStored)) {
+                offset += 8;
+                continue;
+            }
+        }
+
+        const char* candidate = data.data() + offset;
+        if (!IsPlausibleHeader(candidate, options.MinUncompressedLength, options.IncludeStored)) {
+            ++offset;
+            continue;
+        }
+        const auto header = parse_compressed_header(candidate, compressed_header_size);
+        const size_t available = data.size() - offset - compressed_header_size;
+        if (!header || header->CompressedLength > available
+            || !ValidateStream(candidate + compressed_header_size, *header, buffer)) {
+            ++offset;
+            continue;
+        }
+        hits.push_back(ScanHit{static_cast<uint64_t>(offset), *header});
+
+        // anything inside a confirmed stream is just a coincidence, don't look for hits there
+        offset += compressed_header_size + header->CompressedLength;
+    }
+}
+
+std::vector<ScanHit> scan_file_images(std::span<const char> data, const ScanOptions& options) {
+    std::vector<ScanHit> hits;
+    if (data.size() < compressed_header_size) {
+        return hits;
+    }
+    const size_t chunkCount = (data.size() + scan_chunk_size - 1) / scan_chunk_size;
+    std::vector<std::vector<ScanHit>> chunkHits(chunkCount);
+    ThreadPool pool(options.Threads);
+    pool.ParallelFor(chunkCount, [&](size_t i) {
+        const size_t begin = i * scan_chunk_size;
+        ScanChunk(data, begin, begin + scan_chunk_size, options, chunkHits[i]);
+    });
+
+    // Chunks are scanned independently, so a hit can overlap ones found by the next chunks.
+    uint64_t coveredUntil = 0;
+    for (const auto& chunk : chunkHits) {
+        for (const auto& hit : chunk) {
+            if (hit.Offset < coveredUntil) {
+                continue;
+            }
+            hits.push_back(hit);
+            coveredUntil = hit.Offset + compressed_header_size + hit.Header.CompressedLength;
+        }
+    }
+    return hits;
+}
+
+static void PrintScanUsage() {
+    printf(
+        "Usage for scanning:\n"
+        "  topdec scan [options] (path to image or archive)\n"
+        "  Finds compressed files embedded at arbitrary offsets and prints their offsets,\n"
+        "  types and lengths.\n"
+        "  Options are:\n"
+        "    --extract (directory) (decompress every hit into the directory, named by offset)\n"
+        "    --raw (with --extract, write the compressed files as found instead)\n"
+        "    --stored (also report stored type 00 entries, which can't be verified)\n"
+        "    --min-size N (ignore hits that decompress to fewer bytes, defaults to 32)\n"
+        "    --threads N (defaults to the number of hardware threads)\n"
+        "    --json (path) (write the hits as JSON to the given file)\n"
+        "    --quiet (only print the summary)\n");
+}
+
+static bool WriteScanJson(const char* path, const std::vector<ScanHit>& hits) {
+    HyoutaUtils::Json::Writer json;
+    json.BeginArray();
+    for (const auto& hit : hits) {
+        json.BeginObject();
+        json.Key("offset");
+        json.UInt(hit.Offset);
+        json.Key("type");
+        json.UInt(hit.Header.Type);
+        json.Key("compressed");
+        json.UInt(hit.Header.CompressedLength);
+        json.Key("uncompressed");
+        json.UInt(hit.Header.UncompressedLength);
+        json.EndObject();
+    }
+    json.EndArray();
+    const std::string& text = json.GetString();
+    HyoutaUtils::IO::File outfile(std::filesystem::path(path), HyoutaUtils::IO::OpenMode::Write);
+    return outfile.IsOpen() && outfile.Write(text.data(), text.size()) == text.size();
+}
+
+static size_t ExtractHits(std::span<const char> data,
+                          const std::vector<ScanHit>& hits,
+                          const std::filesystem::path& directory,
+                          bool raw,
+                          size_t threads) {
+    std::atomic<size_t> failed = 0;
+    ThreadPool pool(threads);
+    pool.ParallelFor(hits.size(), [&](size_t i) {
+        const ScanHit& hit = hits[i];
+        const auto image =
+            data.subspan(hit.Offset, compressed_header_size + hit.Header.CompressedLength);
+        std::vector<char> decoded;
+        std::span<const char> output = image;
+        if (!raw) {
+            std::error_code ec;
+            decoded.resize(hit.Header.UncompressedLength);
+            TopDec::decode_file_image_exact(image, std::span<char>(decoded), ec);
+            if (ec) {
+                printf("FAILED  0x%010" PRIx64 ": %s\n", hit.Offset, ec.message().c_str());
+                ++failed;
+                return;
+            }
+            output = decoded;
+        }
+
+        std::array<char, 32> name;
+        snprintf(name.data(),
+                 name.size(),
+                 raw ? "%010" PRIx64 ".%02x" : "%010" PRIx64 ".bin",
+                 hit.Offset,
+                 static_cast<unsigned>(hit.Header.Type));
+        HyoutaUtils::IO::File outfile(directory / name.data(), HyoutaUtils::IO::OpenMode::Write);
+        if (!outfile.IsOpen() || outfile.Write(output.data(), output.size()) != output.size()) {
+            printf("FAILED  0x%010" PRIx64 ": failed to write output file\n", hit.Offset);
+            ++failed;
+        }
+    });
+    return failed;
+}
+
+int ScanMain(int argc, char** argv) {
+    ScanOptions options;
+    const char* extractPath = nullptr;
+    bool raw = false;
+    const char* jsonPath = nullptr;
+    bool quiet = false;
+    int idx = 2;
+    while (idx < argc) {
+        const bool hasValue = idx + 1 < argc;
+        if (strcmp("--extract", argv[idx]) == 0 && hasValue) {
+            extractPath = argv[idx + 1];
+            idx += 2;
+            continue;
+        }
+        if (strcmp("--raw", argv[idx]) == 0) {
+            raw = true;
+            ++idx;
+            continue;
+        }
+        if (strcmp("--stored", argv[idx]) == 0) {
+            options.IncludeStored = true;
+            ++idx;
+            continue;
+        }
+        if (strcmp("--min-size", argv[idx]) == 0 && hasValue) {
+            options.MinUncompressedLength =
+                static_cast<uint32_t>(std::max(1ul, strtoul(argv[idx + 1], nullptr, 10)));
+            idx += 2;
+            continue;
+        }
+        if (strcmp("--threads", argv[idx]) == 0 && hasValue) {
+            options.Threads = std::max(size_t(1), size_t(strtoul(argv[idx + 1], nullptr, 10)));
+            idx += 2;
+            continue;
+        }
+        if (strcmp("--json", argv[idx]) == 0 && hasValue) {
+            jsonPath = argv[idx + 1];
+            idx += 2;
+            continue;
+        }
+        if (strcmp("--quiet", argv[idx]) == 0) {
+            quiet = true;
+            ++idx;
+            continue;
+        }
+
+        break;
+    }
+    if (argc - idx != 1 || (raw && extractPath == nullptr)) {
+        PrintScanUsage();
+        return -1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    HyoutaUtils::IO::File infile(std::filesystem::path(argv[idx]),
+                                 HyoutaUtils::IO::OpenMode::Read);
+    if (!infile.IsOpen()) {
+        printf("failed to open input file\n");
+        return -1;
+    }
+    const auto view = infile.Map(HyoutaUtils::IO::AccessHint::Sequential);
+    if (!view) {
+        printf("failed to map input file\n");
+        return -1;
+    }
+    infile.Close();
+    const std::span<const char> data(view->Data(), view->Size());
+
+    const auto hits = scan_file_images(data, options);
+    if (!quiet) {
+        for (const auto& hit : hits) {
+            printf("0x%010" PRIx64 "  type %02x  compressed %5u  uncompressed %5u\n",
+                   hit.Offset,
+                   static_cast<unsigned>(hit.Header.Type),
+                   static_cast<unsigned>(hit.Header.CompressedLength),
+                   static_cast<unsigned>(hit.Header.UncompressedLength));
+        }
+    }
+
+    size_t failed = 0;
+    if (extractPath != nullptr) {
+        const std::filesystem::path directory(extractPath);
+        if (!HyoutaUtils::IO::CreateDirectory(directory)) {
+            printf("failed to create output directory\n");
+            return -1;
+        }
+        failed = ExtractHits(data, hits, directory, raw, options.Threads);
+    }
+    if (jsonPath != nullptr && !WriteScanJson(jsonPath, hits)) {
+        printf("failed to write JSON output\n");
+        return -1;
+    }
+
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%zu files found in %zu bytes, %.3f s (%.1f MB/s)\n",
+           hits.size(),
+           data.size(),
+           seconds,
+           seconds > 0.0 ? static_cast<double>(data.size()) / seconds / 1e6 : 0.0);
+    return failed == 0 ? 0 : -1;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "header.h"
+
+struct ScanOptions {
+    // Also report stored (type 0x00) entries. These can't be confirmed by decoding them, so
+    // anything with a matching pair of lengths is reported.
+    bool IncludeStored = false;
+
+    // ignore candidates that decode to fewer bytes than this
+    uint32_t MinUncompressedLength = 32;
+
+    // 0 uses the number of hardware threads
+    size_t Threads = 0;
+};
+
+struct ScanHit {
+    uint64_t Offset = 0;
+    CompressedHeader Header{};
+};
+
+// Searches 'data' for embedded compressed file images. Every offset is checked for a header with a
+// known type and lengths within the limits of the format, and candidates are then confirmed by
+// decoding them: the stream must produce exactly the length from the header and end exactly where
+// the header says. Where confirmed candidates overlap, the one at the lower offset wins.
+// Returns the hits ordered by offset.
+std::vector<ScanHit> scan_file_images(std::span<const char> data, const ScanOptions& options);
+
+int ScanMain(int argc, char** argv);
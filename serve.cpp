@@ -0,0 +1,730 @@
+#include "serve.h"
+
+#include <cstdio>
+
+#ifdef __linux__
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <semaphore>
+#include <span>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "decode_cache.h"
+#include "json.h"
+#include "profile.h"
+#include "thread_pool.h"
+#include "topdec.h"
+
+namespace {
+// Counters are updated from the worker threads without locking, so each one is individually
+// consistent but a snapshot may mix values from slightly different points in time.
+struct ServeCounters {
+    // log2 buckets of the request latency in microseconds, from receiving the request until the
+    // response has been sent
+    static constexpr size_t latency_bucket_count = 32;
+
+    std::atomic<uint64_t> Connections = 0;
+    std::atomic<uint64_t> Requests = 0;
+    std::atomic<uint64_t> Failed = 0;
+    std::atomic<uint64_t> BytesIn = 0;
+    std::atomic<uint64_t> BytesOut = 0;
+    std::atomic<uint64_t> QueueDepth = 0;
+    std::atomic<uint64_t> MaxQueueDepth = 0;
+    std::atomic<uint64_t> TotalLatencyNs = 0;
+    std::atomic<uint64_t> MaxLatencyNs = 0;
+    std::array<std::atomic<uint64_t>, latency_bucket_count> LatencyBuckets{};
+
+    void Enqueued() {
+        const uint64_t depth = QueueDepth.fetch_add(1) + 1;
+        uint64_t max = MaxQueueDepth.load();
+        while (depth > max && !MaxQueueDepth.compare_exchange_weak(max, depth)) {
+        }
+    }
+
+    void Dequeued() {
+        QueueDepth.fetch_sub(1);
+    }
+
+    void Completed(uint64_t latencyNs, bool success) {
+        Requests.fetch_add(1);
+        if (!success) {
+            Failed.fetch_add(1);
+        }
+        TotalLatencyNs.fetch_add(latencyNs);
+        uint64_t max = MaxLatencyNs.load();
+        while (latencyNs > max && !MaxLatencyNs.compare_exchange_weak(max, latencyNs)) {
+        }
+        const uint64_t us = latencyNs / 1000;
+        const size_t bucket = us == 0 ? 0 : static_cast<size_t>(std::bit_width(us) - 1);
+        LatencyBuckets[std::min(bucket, latency_bucket_count - 1)].fetch_add(1);
+    }
+
+    // Upper bound of the bucket that contains the given percentile, in microseconds.
+    uint64_t PercentileUs(double p) const {
+        uint64_t total = 0;
+        for (const auto& b : LatencyBuckets) {
+            total += b.load();
+        }
+        if (total == 0) {
+            return 0;
+        }
+        const uint64_t rank = std::max(uint64_t(1), static_cast<uint64_t>(p * total + 0.999999));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < latency_bucket_count; ++i) {
+            seen += LatencyBuckets[i].load();
+            if (seen >= rank) {
+                return (uint64_t(1) << (i + 1)) - 1;
+            }
+        }
+        return 0;
+    }
+
+    double MeanUs() const {
+        const uint64_t requests = Requests.load();
+        return requests == 0 ? 0.0 : (TotalLatencyNs.load() / 1000.0) / requests;
+    }
+
+    void WriteJson(HyoutaUtils::Json::Writer& json) const {
+        json.BeginObject();
+        json.Key("connections");
+        json.UInt(Connections.load());
+        json.Key("requests");
+        json.UInt(Requests.load());
+        json.Key("failed");
+        json.UInt(Failed.load());
+        json.Key("bytes_in");
+        json.UInt(BytesIn.load());
+        json.Key("bytes_out");
+        json.UInt(BytesOut.load());
+        json.Key("queue_depth");
+        json.UInt(QueueDepth.load());
+        json.Key("max_queue_depth");
+        json.UInt(MaxQueueDepth.load());
+        json.Key("latency_mean_us");
+        json.Double(MeanUs());
+        json.Key("latency_p50_us");
+        json.UInt(PercentileUs(0.5));
+        json.Key("latency_p99_us");
+        json.UInt(PercentileUs(0.99));
+        json.Key("latency_max_us");
+        json.UInt(MaxLatencyNs.load() / 1000);
+        json.Key("latency_us");
+        json.BeginArray();
+        for (size_t i = 0; i < latency_bucket_count; ++i) {
+            const uint64_t count = LatencyBuckets[i].load();
+            if (count != 0) {
+                json.BeginArray();
+                json.UInt(i == 0 ? 0 : (uint64_t(1) << i));
+                json.UInt((uint64_t(1) << (i + 1)) - 1);
+                json.UInt(count);
+                json.EndArray();
+            }
+        }
+        json.EndArray();
+        json.EndObject();
+    }
+
+    void Print() const {
+        printf("served %llu request%s (%llu failed) on %llu connection%s\n",
+               static_cast<unsigned long long>(Requests.load()),
+               Requests.load() == 1 ? "" : "s",
+               static_cast<unsigned long long>(Failed.load()),
+               static_cast<unsigned long long>(Connections.load()),
+               Connections.load() == 1 ? "" : "s");
+        printf("  %llu bytes in, %llu bytes out, max queue depth %llu\n",
+               static_cast<unsigned long long>(BytesIn.load()),
+               static_cast<unsigned long long>(BytesOut.load()),
+               static_cast<unsigned long long>(MaxQueueDepth.load()));
+        printf("  latency: mean %.1f us, p50 <= %llu us, p99 <= %llu us, max %llu us\n",
+               MeanUs(),
+               static_cast<unsigned long long>(PercentileUs(0.5)),
+               static_cast<unsigned long long>(PercentileUs(0.99)),
+               static_cast<unsigned long long>(MaxLatencyNs.load() / 1000));
+    }
+};
+
+// Owns a socket or file descriptor. Connections are shared between the poll loop and the workers
+// answering their requests, so the descriptor can't be closed and reused for another client while
+// a response is still pending.
+struct UniqueFd {
+    int Fd = -1;
+
+    UniqueFd() = default;
+    explicit UniqueFd(int fd) : Fd(fd) {}
+    UniqueFd(const UniqueFd& other) = delete;
+    UniqueFd(UniqueFd&& other) noexcept : Fd(other.Fd) {
+        other.Fd = -1;
+    }
+    UniqueFd& operator=(const UniqueFd& other) = delete;
+    UniqueFd& operator=(UniqueFd&& other) noexcept {
+        if (this != &other) {
+            Reset();
+            Fd = other.Fd;
+            other.Fd = -1;
+        }
+        return *this;
+    }
+    ~UniqueFd() {
+        Reset();
+    }
+
+    void Reset() {
+        if (Fd != -1) {
+            close(Fd);
+            Fd = -1;
+        }
+    }
+};
+
+struct MappedRegion {
+    void* Base = MAP_FAILED;
+    size_t Length = 0;
+
+    MappedRegion() = default;
+    MappedRegion(const MappedRegion& other) = delete;
+    MappedRegion& operator=(const MappedRegion& other) = delete;
+    ~MappedRegion() {
+        if (Base != MAP_FAILED) {
+            munmap(Base, Length);
+        }
+    }
+};
+
+struct ServeContext {
+    ServeCounters Counters;
+    // only set if the server was started with --cache
+    std::unique_ptr<TopDec::DecodeCache> Cache;
+    // one per request that may be queued or in progress, see serve_pending_requests_per_thread
+    std::unique_ptr<std::counting_semaphore<>> PendingSlots;
+
+    void WriteJson(HyoutaUtils::Json::Writer& json) const {
+        json.BeginObject();
+        json.Key("server");
+        Counters.WriteJson(json);
+        if (Cache) {
+            const auto stats = Cache->GetStats();
+            json.Key("cache");
+            json.BeginObject();
+            json.Key("hits");
+            json.UInt(stats.Hits);
+            json.Key("misses");
+            json.UInt(stats.Misses);
+            json.Key("insertions");
+            json.UInt(stats.Insertions);
+            json.Key("evictions");
+            json.UInt(stats.Evictions);
+            json.Key("uncacheable");
+            json.UInt(stats.Uncacheable);
+            json.Key("entries");
+            json.UInt(stats.Entries);
+            json.Key("bytes");
+            json.UInt(stats.Bytes);
+            json.Key("capacity");
+            json.UInt(stats.Capacity);
+            json.EndObject();
+        }
+        json.EndObject();
+    }
+
+    void Print() const {
+        Counters.Print();
+        if (Cache) {
+            const auto stats = Cache->GetStats();
+            printf("  cache: %llu hits, %llu misses, %llu evictions, %llu entries in %llu bytes\n",
+                   static_cast<unsigned long long>(stats.Hits),
+                   static_cast<unsigned long long>(stats.Misses),
+                   static_cast<unsigned long long>(stats.Evictions),
+                   static_cast<unsigned long long>(stats.Entries),
+                   static_cast<unsigned long long>(stats.Bytes));
+        }
+    }
+};
+
+struct PendingRequest {
+    std::shared_ptr<UniqueFd> Connection;
+    ServeRequest Request;
+    UniqueFd Input;
+    UniqueFd Output;
+    uint64_t ReceivedNs;
+};
+} // namespace
+
+// Once this many requests per worker thread are queued or in progress, the server stops reading
+// from its clients until one of them is done. Their sends then block once the socket buffers are
+// full, instead of the queue growing without bound.
+constexpr size_t serve_pending_requests_per_thread = 16;
+
+static volatile std::sig_atomic_t s_StopRequested = 0;
+
+static void HandleStopSignal(int) {
+    s_StopRequested = 1;
+}
+
+static void PrintServeUsage() {
+    printf(
+        "Usage for daemon mode:\n"
+        "  topdec serve [options] --socket (path)\n"
+        "  Accepts compress and decompress requests on a Unix domain socket until interrupted.\n"
+        "  See serve.h for the protocol.\n"
+        "  Options are:\n"
+        "    --threads N (defaults to the number of hardware threads)\n"
+        "    --cache MB (keep up to this many megabytes of decompressed results in memory)\n");
+}
+
+static bool SendResponse(int connection, const ServeResponse& response, int attachFd) {
+    ServeResponse r = response;
+    iovec iov{&r, sizeof(r)};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int))> control{};
+    if (attachFd != -1) {
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &attachFd, sizeof(int));
+    }
+
+    while (true) {
+        const ssize_t sent = sendmsg(connection, &msg, MSG_NOSIGNAL);
+        if (sent >= 0) {
+            return true;
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+// Only inputs the client can neither shrink nor modify any more are mapped. Truncating a mapped
+// file makes every access past the new end fault, which would take down the whole server.
+constexpr int serve_mappable_seals = F_SEAL_SHRINK | F_SEAL_WRITE;
+
+// Makes the requested input range readable. Sealed memfds are mapped read-only, anything else is
+// read into 'buffer'. 'data' stays empty for an empty range.
+static TopDec::Error MapInput(const ServeRequest& request,
+                              int fd,
+                              MappedRegion& region,
+                              std::vector<char>& buffer,
+                              std::span<const char>& data) {
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+        return TopDec::Error::IoFailure;
+    }
+    const uint64_t fileSize = static_cast<uint64_t>(st.st_size);
+    if (request.InputOffset > fileSize) {
+        return TopDec::Error::InvalidArgument;
+    }
+    const uint64_t size =
+        request.InputSize == 0 ? fileSize - request.InputOffset : request.InputSize;
+    if (size > fileSize - request.InputOffset) {
+        return TopDec::Error::InvalidArgument;
+    }
+    if (size == 0) {
+        data = std::span<const char>();
+        return TopDec::Error::Success;
+    }
+
+    // fails with EINVAL for anything that doesn't support seals, such as regular files
+    const int seals = fcntl(fd, F_GET_SEALS);
+    if (seals == -1 || (seals & serve_mappable_seals) != serve_mappable_seals) {
+        buffer.resize(static_cast<size_t>(size));
+        size_t done = 0;
+        while (done < buffer.size()) {
+            const ssize_t result = pread(fd,
+                                         buffer.data() + done,
+                                         buffer.size() - done,
+                                         static_cast<off_t>(request.InputOffset + done));
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                // an error, or the file shrank since fstat()
+                return TopDec::Error::IoFailure;
+            }
+            done += static_cast<size_t>(result);
+        }
+        data = std::span<const char>(buffer.data(), buffer.size());
+        return TopDec::Error::Success;
+    }
+
+    // mmap offsets have to be page aligned
+    const uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    const uint64_t alignedOffset = request.InputOffset - (request.InputOffset % pageSize);
+    const uint64_t skip = request.InputOffset - alignedOffset;
+    region.Length = static_cast<size_t>(size + skip);
+    region.Base = mmap(
+        nullptr, region.Length, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(alignedOffset));
+    if (region.Base == MAP_FAILED) {
+        return TopDec::Error::IoFailure;
+    }
+    data = std::span<const char>(static_cast<const char*>(region.Base) + skip, size);
+    return TopDec::Error::Success;
+}
+
+// Runs the codec straight into a shared mapping of the output descriptor, so the result is never
+// copied after it has been produced.
+static TopDec::Error RunCodec(const ServeRequest& request,
+                              std::span<const char> input,
+                              int outputFd,
+                              uint64_t& outputSize) {
+    std::error_code ec;
+    const bool decompress = request.Op == static_cast<uint8_t>(ServeOp::Decompress);
+    const size_t bound = decompress ? TopDec::decode_file_image_bound(input, ec)
+                                    : TopDec::encode_file_image_bound(input.size());
+    if (ec) {
+        return static_cast<TopDec::Error>(ec.value());
+    }
+    if (ftruncate(outputFd, static_cast<off_t>(bound)) != 0) {
+        return TopDec::Error::IoFailure;
+    }
+
+    MappedRegion region;
+    region.Length = bound;
+    region.Base = mmap(nullptr, bound, PROT_READ | PROT_WRITE, MAP_SHARED, outputFd, 0);
+    if (region.Base == MAP_FAILED) {
+        return TopDec::Error::IoFailure;
+    }
+    const std::span<char> output(static_cast<char*>(region.Base), bound);
+    const int level = request.Level == 0 ? compress_default_level : request.Level;
+    const size_t length = decompress
+                              ? TopDec::decode_file_image(input, output, ec)
+                              : TopDec::encode_file_image(request.Type, input, output, level, ec);
+    if (ftruncate(outputFd, static_cast<off_t>(length)) != 0) {
+        return TopDec::Error::IoFailure;
+    }
+    outputSize = length;
+    return ec ? static_cast<TopDec::Error>(ec.value()) : TopDec::Error::Success;
+}
+
+static TopDec::Error WriteAll(int fd, std::span<const char> data) {
+    if (ftruncate(fd, 0) != 0) {
+        return TopDec::Error::IoFailure;
+    }
+    size_t written = 0;
+    while (written < data.size()) {
+        const ssize_t result =
+            pwrite(fd, data.data() + written, data.size() - written, static_cast<off_t>(written));
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return TopDec::Error::IoFailure;
+        }
+        written += static_cast<size_t>(result);
+    }
+    return TopDec::Error::Success;
+}
+
+// Decodes through the cache. A hit costs one copy into the output instead of a full decode.
+static TopDec::Error RunCachedDecode(TopDec::DecodeCache& cache,
+                                     std::span<const char> input,
+                                     int outputFd,
+                                     uint64_t& outputSize) {
+    std::error_code ec;
+    const auto data = cache.Decode(input, ec);
+    if (ec) {
+        return static_cast<TopDec::Error>(ec.value());
+    }
+    outputSize = data->size();
+    return WriteAll(outputFd, *data);
+}
+
+static void ProcessRequest(PendingRequest& pending, ServeContext& context) {
+    ServeCounters& counters = context.Counters;
+    counters.Dequeued();
+    const ServeRequest& request = pending.Request;
+
+    ServeResponse response{};
+    response.Magic = serve_response_magic;
+    response.Id = request.Id;
+
+    // results go into the caller's descriptor if there is one, a new memfd otherwise
+    UniqueFd createdOutput;
+    int outputFd = pending.Output.Fd;
+    if (outputFd == -1) {
+        createdOutput = UniqueFd(memfd_create("topdec-output", MFD_CLOEXEC));
+        outputFd = createdOutput.Fd;
+    }
+
+    TopDec::Error status = TopDec::Error::Success;
+    uint64_t outputSize = 0;
+    // this runs as a thread pool job, which must not throw, so the client gets an error instead
+    try {
+        if (outputFd == -1) {
+            status = TopDec::Error::IoFailure;
+        } else if (request.Op == static_cast<uint8_t>(ServeOp::Stats)) {
+            HyoutaUtils::Json::Writer json;
+            context.WriteJson(json);
+            status = WriteAll(outputFd, json.GetString());
+            outputSize = json.GetString().size();
+        } else if (request.Op == static_cast<uint8_t>(ServeOp::Decompress)
+                   || request.Op == static_cast<uint8_t>(ServeOp::Compress)) {
+            MappedRegion inputRegion;
+            std::vector<char> inputBuffer;
+            std::span<const char> input;
+            status = pending.Input.Fd == -1
+                         ? TopDec::Error::InvalidArgument
+                         : MapInput(request, pending.Input.Fd, inputRegion, inputBuffer, input);
+            if (status == TopDec::Error::Success) {
+                counters.BytesIn.fetch_add(input.size());
+                if (context.Cache && request.Op == static_cast<uint8_t>(ServeOp::Decompress)) {
+                    status = RunCachedDecode(*context.Cache, input, outputFd, outputSize);
+                } else {
+                    status = RunCodec(request, input, outputFd, outputSize);
+                }
+                counters.BytesOut.fetch_add(outputSize);
+            }
+        } else {
+            status = TopDec::Error::InvalidArgument;
+        }
+    } catch (const std::bad_alloc&) {
+        status = TopDec::Error::OutOfMemory;
+        outputSize = 0;
+    }
+
+    response.Status = static_cast<int32_t>(status);
+    response.OutputSize = outputSize;
+    SendResponse(pending.Connection->Fd, response, createdOutput.Fd);
+    counters.Completed(get_wall_time_ns() - pending.ReceivedNs, status == TopDec::Error::Success);
+}
+
+// Reads one request from the connection. Returns false once the connection should be dropped.
+static bool ReceiveRequest(const std::shared_ptr<UniqueFd>& connection,
+                           ThreadPool& pool,
+                           ServeContext& context) {
+    ServeCounters& counters = context.Counters;
+    auto pending = std::make_shared<PendingRequest>();
+    pending->Connection = connection;
+
+    iovec iov{&pending->Request, sizeof(ServeRequest)};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int) * 4)> control{};
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+
+    const ssize_t received = recvmsg(connection->Fd, &msg, MSG_CMSG_CLOEXEC);
+    if (received < 0) {
+        return errno == EINTR || errno == EAGAIN;
+    }
+    if (received == 0) {
+        return false;
+    }
+    pending->ReceivedNs = get_wall_time_ns();
+
+    // take ownership of everything that was passed, even if the request turns out to be invalid
+    std::vector<UniqueFd> fds;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; ++i) {
+            int fd;
+            std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            fds.emplace_back(fd);
+        }
+    }
+
+    const bool valid = static_cast<size_t>(received) == sizeof(ServeRequest)
+                       && (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) == 0
+                       && pending->Request.Magic == serve_request_magic && fds.size() <= 2;
+    if (!valid) {
+        ServeResponse response{};
+        response.Magic = serve_response_magic;
+        response.Status = TOPDEC_ERROR_INVALID_ARGUMENT;
+        if (static_cast<size_t>(received) >= sizeof(ServeRequest)) {
+            response.Id = pending->Request.Id;
+        }
+        SendResponse(connection->Fd, response, -1);
+        counters.Completed(get_wall_time_ns() - pending->ReceivedNs, false);
+        return true;
+    }
+
+    if (fds.size() >= 1) {
+        pending->Input = std::move(fds[0]);
+    }
+    if (fds.size() >= 2) {
+        pending->Output = std::move(fds[1]);
+    }
+    context.PendingSlots->acquire();
+    counters.Enqueued();
+    try {
+        pool.Submit([pending, &context]() {
+            ProcessRequest(*pending, context);
+            context.PendingSlots->release();
+        });
+    } catch (const std::bad_alloc&) {
+        counters.Dequeued();
+        context.PendingSlots->release();
+        ServeResponse response{};
+        response.Magic = serve_response_magic;
+        response.Status = TOPDEC_ERROR_OUT_OF_MEMORY;
+        response.Id = pending->Request.Id;
+        SendResponse(connection->Fd, response, -1);
+        counters.Completed(get_wall_time_ns() - pending->ReceivedNs, false);
+    }
+    return true;
+}
+
+static int CreateListenSocket(const char* path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        printf("socket path too long\n");
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // a socket left behind by a previous instance would make bind() fail
+    struct stat st {};
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+
+    const int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        printf("failed to create socket: %s\n", strerror(errno));
+        return -1;
+    }
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0
+        || listen(fd, SOMAXCONN) != 0) {
+        printf("failed to listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int ServeMain(int argc, char** argv) {
+    const char* socketPath = nullptr;
+    size_t threadCount = 0;
+    size_t cacheMegabytes = 0;
+    int idx = 2;
+    while (idx < argc) {
+        const bool hasValue = (idx + 1) < argc;
+        if (strcmp("--socket", argv[idx]) == 0 && hasValue) {
+            socketPath = argv[idx + 1];
+            idx += 2;
+            continue;
+        }
+        if (strcmp("--cache", argv[idx]) == 0 && hasValue) {
+            cacheMegabytes = static_cast<size_t>(strtoul(argv[idx + 1], nullptr, 10));
+            idx += 2;
+            continue;
+        }
+        if (strcmp("--threads", argv[idx]) == 0 && hasValue) {
+            threadCount = static_cast<size_t>(strtoul(argv[idx + 1], nullptr, 10));
+            idx += 2;
+            continue;
+        }
+
+        break;
+    }
+    if (idx != argc || socketPath == nullptr) {
+        PrintServeUsage();
+        return -1;
+    }
+
+    UniqueFd listener(CreateListenSocket(socketPath));
+    if (listener.Fd == -1) {
+        return -1;
+    }
+
+    struct sigaction action {};
+    action.sa_handler = HandleStopSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    ServeContext context;
+    if (cacheMegabytes > 0) {
+        context.Cache = std::make_unique<TopDec::DecodeCache>(cacheMegabytes * 1024 * 1024);
+    }
+    ServeCounters& counters = context.Counters;
+    {
+        ThreadPool pool(threadCount);
+        context.PendingSlots = std::make_unique<std::counting_semaphore<>>(
+            static_cast<ptrdiff_t>(pool.GetThreadCount() * serve_pending_requests_per_thread));
+        printf("listening on %s with %zu worker thread%s\n",
+               socketPath,
+               pool.GetThreadCount(),
+               pool.GetThreadCount() == 1 ? "" : "s");
+        fflush(stdout);
+
+        std::unordered_map<int, std::shared_ptr<UniqueFd>> connections;
+        std::vector<pollfd> pollfds;
+        while (s_StopRequested == 0) {
+            pollfds.clear();
+            pollfds.push_back(pollfd{listener.Fd, POLLIN, 0});
+            for (const auto& c : connections) {
+                pollfds.push_back(pollfd{c.first, POLLIN, 0});
+            }
+            if (poll(pollfds.data(), pollfds.size(), -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                printf("poll failed: %s\n", strerror(errno));
+                break;
+            }
+
+            for (size_t i = 1; i < pollfds.size(); ++i) {
+                if (pollfds[i].revents == 0) {
+                    continue;
+                }
+                auto it = connections.find(pollfds[i].fd);
+                if ((pollfds[i].revents & POLLIN) == 0
+                    || !ReceiveRequest(it->second, pool, context)) {
+                    // workers still answering this client keep the descriptor alive
+                    connections.erase(it);
+                }
+            }
+            if (pollfds[0].revents & POLLIN) {
+                const int fd = accept4(listener.Fd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd != -1) {
+                    connections.emplace(fd, std::make_shared<UniqueFd>(fd));
+                    counters.Connections.fetch_add(1);
+                }
+            }
+        }
+
+        // leaving this scope waits for the pool to finish all queued requests
+    }
+
+    unlink(socketPath);
+    context.Print();
+    return 0;
+}
+#else
+int ServeMain(int /*argc*/, char** /*argv*/) {
+    printf("'topdec serve' is only supported on Linux.\n");
+    return -1;
+}
+#endif
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+// Wire protocol of 'topdec serve'.
+//
+// The server listens on a SOCK_SEQPACKET Unix domain socket, so every request and every response
+// is exactly one message. All integers are little endian. Payloads never travel through the
+// socket itself; they are passed as file descriptors with SCM_RIGHTS:
+//
+// - Every request carries the input as its first descriptor. This can be a memfd or a regular
+//   file; the server uses [InputOffset, InputOffset + InputSize) of it, or everything from
+//   InputOffset to the end if InputSize is 0. A memfd sealed with F_SEAL_SHRINK and F_SEAL_WRITE
+//   is mapped directly; anything else is copied, since the client could change it mid-request.
+// - A request may carry an output descriptor as its second one. The server then truncates it to
+//   the result size and writes the result to it. Otherwise the server creates a memfd for the
+//   result and attaches it to the response.
+//
+// Requests are processed concurrently, so responses may arrive in a different order than the
+// requests were sent; use the Id to match them up.
+
+constexpr uint32_t serve_request_magic = 0x31534454;  // "TDS1"
+constexpr uint32_t serve_response_magic = 0x31524454; // "TDR1"
+
+enum class ServeOp : uint8_t {
+    // Decode a complete compressed file, header included.
+    Decompress = 1,
+    // Compress into a complete file with header, using Type and Level. Level 0 selects the default.
+    Compress = 2,
+    // Return the server counters as JSON. Takes no input descriptor.
+    Stats = 3,
+};
+
+struct ServeRequest {
+    uint32_t Magic;
+    uint8_t Op;
+    uint8_t Type;
+    uint8_t Level;
+    uint8_t Reserved;
+    uint64_t Id;
+    uint64_t InputOffset;
+    uint64_t InputSize;
+};
+static_assert(sizeof(ServeRequest) == 32);
+
+struct ServeResponse {
+    uint32_t Magic;
+    // One of the TOPDEC_* status values from topdec_c.h.
+    int32_t Status;
+    uint64_t Id;
+    uint64_t OutputSize;
+};
+static_assert(sizeof(ServeResponse) == 24);
+
+int ServeMain(int argc, char** argv);
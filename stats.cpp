@@ -0,0 +1,635 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "decompress.h"
+#include "decompress_observed.h"
+#include "file.h"
+#include "header.h"
+#include "json.h"
+#include "mirror.h"
+#include "perf_counters.h"
+#include "profile.h"
+
+template<size_t N>
+static void MergeArray(std::array<uint64_t, N>& lhs, const std::array<uint64_t, N>& rhs) {
+    for (size_t i = 0; i < N; ++i) {
+        lhs[i] += rhs[i];
+    }
+}
+
+static void MergeTokenType(TokenTypeStats& lhs, const TokenTypeStats& rhs) {
+    lhs.Count += rhs.Count;
+    lhs.CompressedBytes += rhs.CompressedBytes;
+    lhs.UncompressedBytes += rhs.UncompressedBytes;
+}
+
+void TokenStats::Merge(const TokenStats& other) {
+    Files += other.Files;
+    CompressedBytes += other.CompressedBytes;
+    UncompressedBytes += other.UncompressedBytes;
+    FlagBytes += other.FlagBytes;
+    ShiftJisBytes += other.ShiftJisBytes;
+    MergeTokenType(Literals, other.Literals);
+    MergeTokenType(Runs, other.Runs);
+    MergeTokenType(Backrefs, other.Backrefs);
+    MergeTokenType(DictRefs, other.DictRefs);
+    MergeArray(BackrefLengths, other.BackrefLengths);
+    MergeArray(DictRefLengths, other.DictRefLengths);
+    MergeArray(BackrefOffsets, other.BackrefOffsets);
+    MergeArray(DictRefDistances, other.DictRefDistances);
+    MergeArray(RunLengths, other.RunLengths);
+}
+
+static size_t Log2Bucket(size_t value) {
+    return value == 0 ? 0 : static_cast<size_t>(std::bit_width(value) - 1);
+}
+
+static double Ratio(uint64_t a, uint64_t b) {
+    return b == 0 ? 0.0 : (static_cast<double>(a) / static_cast<double>(b));
+}
+
+static void WriteTokenTypeJson(HyoutaUtils::Json::Writer& json,
+                               std::string_view name,
+                               const TokenTypeStats& stats) {
+    json.Key(name);
+    json.BeginObject();
+    json.Key("count");
+    json.UInt(stats.Count);
+    json.Key("compressed_bytes");
+    json.UInt(stats.CompressedBytes);
+    json.Key("uncompressed_bytes");
+    json.UInt(stats.UncompressedBytes);
+    json.EndObject();
+}
+
+// Histograms are written as a list of [lower bound, upper bound, count] entries, skipping empty
+// buckets.
+template<size_t N>
+static void WriteLinearHistogramJson(HyoutaUtils::Json::Writer& json,
+                                     std::string_view name,
+                                     const std::array<uint64_t, N>& histogram) {
+    json.Key(name);
+    json.BeginArray();
+    for (size_t i = 0; i < N; ++i) {
+        if (histogram[i] != 0) {
+            json.BeginArray();
+            json.UInt(i);
+            json.UInt(i);
+            json.UInt(histogram[i]);
+            json.EndArray();
+        }
+    }
+    json.EndArray();
+}
+
+template<size_t N>
+static void WriteLog2HistogramJson(HyoutaUtils::Json::Writer& json,
+                                   std::string_view name,
+                                   const std::array<uint64_t, N>& histogram) {
+    json.Key(name);
+    json.BeginArray();
+    for (size_t i = 0; i < N; ++i) {
+        if (histogram[i] != 0) {
+            json.BeginArray();
+            json.UInt(uint64_t(1) << i);
+            json.UInt((uint64_t(1) << (i + 1)) - 1);
+            json.UInt(histogram[i]);
+            json.EndArray();
+        }
+    }
+    json.EndArray();
+}
+
+void TokenStats::WriteJson(HyoutaUtils::Json::Writer& json) const {
+    json.BeginObject();
+    json.Key("files");
+    json.UInt(Files);
+    json.Key("compressed_bytes");
+    json.UInt(CompressedBytes);
+    json.Key("uncompressed_bytes");
+    json.UInt(UncompressedBytes);
+    json.Key("ratio");
+    json.Double(Ratio(CompressedBytes, UncompressedBytes));
+    json.Key("flag_bytes");
+    json.UInt(FlagBytes);
+    json.Key("flag_byte_density");
+    json.Double(Ratio(FlagBytes, CompressedBytes));
+    json.Key("sjis_bytes");
+    json.UInt(ShiftJisBytes);
+    json.Key("sjis_fraction");
+    json.Double(Ratio(ShiftJisBytes, UncompressedBytes));
+    WriteTokenTypeJson(json, "literals", Literals);
+    WriteTokenTypeJson(json, "runs", Runs);
+    WriteTokenTypeJson(json, "backrefs", Backrefs);
+    WriteTokenTypeJson(json, "dictrefs", DictRefs);
+    WriteLinearHistogramJson(json, "backref_lengths", BackrefLengths);
+    WriteLog2HistogramJson(json, "backref_offsets", BackrefOffsets);
+    WriteLinearHistogramJson(json, "dictref_lengths", DictRefLengths);
+    WriteLog2HistogramJson(json, "dictref_distances", DictRefDistances);
+    WriteLog2HistogramJson(json, "run_lengths", RunLengths);
+    json.EndObject();
+}
+
+static uint64_t CountShiftJisBytes(const char* data, size_t length) {
+    uint64_t count = 0;
+    size_t i = 0;
+    while (i + 1 < length) {
+        const uint8_t lead = static_cast<uint8_t>(data[i]);
+        const uint8_t trail = static_cast<uint8_t>(data[i + 1]);
+        const bool isLead = (lead >= 0x81 && lead <= 0x9f) || (lead >= 0xe0 && lead <= 0xfc);
+        const bool isTrail = (trail >= 0x40 && trail <= 0x7e) || (trail >= 0x80 && trail <= 0xfc);
+        if (isLead && isTrail) {
+            count += 2;
+            i += 2;
+        } else {
+            ++i;
+        }
+    }
+    return count;
+}
+
+namespace {
+struct StatsDecodeObserver {
+    TokenStats& Stats;
+    std::vector<uint32_t>& Regions;
+    size_t DictStart;
+    size_t NextOut = 0;
+
+    void AddRegionBytes(size_t out, size_t bytes) {
+        if (Regions.empty()) {
+            return;
+        }
+        const size_t region = std::min(out / token_stats_region_size, Regions.size() - 1);
+        Regions[region] += static_cast<uint32_t>(bytes);
+    }
+
+    void AddToken(TokenTypeStats& type, size_t out, size_t compressedBytes, size_t count) {
+        ++type.Count;
+        type.CompressedBytes += compressedBytes;
+        type.UncompressedBytes += count;
+        AddRegionBytes(out, compressedBytes);
+        NextOut = out + count;
+    }
+
+    void OnFlagByte(size_t /*in*/) {
+        ++Stats.FlagBytes;
+        AddRegionBytes(NextOut, 1);
+    }
+    void OnLiteral(size_t /*in*/, size_t out, char /*c*/) {
+        AddToken(Stats.Literals, out, 1, 1);
+    }
+    void OnRun(size_t /*in*/, size_t out, char /*c*/, size_t count) {
+        // runs of 19 or more bytes need an extra byte for the count
+        AddToken(Stats.Runs, out, count >= 19 ? 3 : 2, count);
+        ++Stats.RunLengths[std::min(Log2Bucket(count), Stats.RunLengths.size() - 1)];
+    }
+    void OnBackref(size_t /*in*/, size_t out, size_t offset, size_t count) {
+        AddToken(Stats.Backrefs, out, 2, count);
+        ++Stats.BackrefLengths[std::min(count, Stats.BackrefLengths.size() - 1)];
+        ++Stats.BackrefOffsets[std::min(Log2Bucket(offset), Stats.BackrefOffsets.size() - 1)];
+    }
+    void OnDictRef(size_t /*in*/, size_t out, size_t dictOffset, size_t count) {
+        AddToken(Stats.DictRefs, out, 2, count);
+        ++Stats.DictRefLengths[std::min(count, Stats.DictRefLengths.size() - 1)];
+
+        // distance from the current write position in the dictionary ring buffer; 0 means the
+        // position that is about to be overwritten, which is the oldest byte in the ring
+        size_t distance = (DictStart + out - dictOffset) & 0xfffu;
+        if (distance == 0) {
+            distance = 0x1000;
+        }
+        ++Stats.DictRefDistances[std::min(Log2Bucket(distance),
+                                          Stats.DictRefDistances.size() - 1)];
+    }
+};
+} // namespace
+
+bool collect_token_stats(const char* data, size_t length, FileTokenStats& result) {
+    const auto header = parse_compressed_header(data, length);
+    if (!header) {
+        result.Error = "file too small";
+        return false;
+    }
+    if (header->CompressedLength > length - compressed_header_size) {
+        result.Error = "compressed length exceeds file size";
+        return false;
+    }
+
+    result.Type = header->Type;
+    result.Stats = TokenStats();
+    result.Stats.Files = 1;
+    result.Stats.CompressedBytes = header->CompressedLength;
+    result.Stats.UncompressedBytes = header->UncompressedLength;
+    result.RegionCompressedBytes.assign(
+        (header->UncompressedLength + token_stats_region_size - 1) / token_stats_region_size, 0);
+
+    const char* compressed = data + compressed_header_size;
+    if (header->Type == 0x00) {
+        if (header->CompressedLength != header->UncompressedLength) {
+            result.Error = "stored data length mismatch";
+            return false;
+        }
+        for (size_t i = 0; i < result.RegionCompressedBytes.size(); ++i) {
+            result.RegionCompressedBytes[i] = static_cast<uint32_t>(
+                std::min(token_stats_region_size,
+                         header->UncompressedLength - i * token_stats_region_size));
+        }
+        result.Stats.ShiftJisBytes = CountShiftJisBytes(compressed, header->UncompressedLength);
+        result.Success = true;
+        return true;
+    }
+
+    std::vector<char> uncompressed;
+    uncompressed.resize(header->UncompressedLength + decompress_reserve_extra_bytes());
+    int64_t decompressResult = -2;
+    if (header->Type == 0x01) {
+        StatsDecodeObserver observer{result.Stats, result.RegionCompressedBytes, 0xfee};
+        decompressResult = decompress_01(compressed,
+                                         header->CompressedLength,
+                                         uncompressed.data(),
+                                         header->UncompressedLength,
+                                         observer);
+    } else if (header->Type == 0x03) {
+        StatsDecodeObserver observer{result.Stats, result.RegionCompressedBytes, 0xfef};
+        decompressResult = decompress_03(compressed,
+                                         header->CompressedLength,
+                                         uncompressed.data(),
+                                         header->UncompressedLength,
+                                         observer);
+    } else if (header->Type == 0x81) {
+        StatsDecodeObserver observer{result.Stats, result.RegionCompressedBytes, 0};
+        decompressResult = decompress_81(compressed,
+                                         header->CompressedLength,
+                                         uncompressed.data(),
+                                         header->UncompressedLength,
+                                         observer);
+    } else if (header->Type == 0x83) {
+        StatsDecodeObserver observer{result.Stats, result.RegionCompressedBytes, 0};
+        decompressResult = decompress_83(compressed,
+                                         header->CompressedLength,
+                                         uncompressed.data(),
+                                         header->UncompressedLength,
+                                         observer);
+    } else {
+        result.Error = "unsupported compression format";
+        return false;
+    }
+
+    if (decompressResult < 0) {
+        result.Error = "decompression failure";
+        return false;
+    }
+
+    result.Stats.ShiftJisBytes =
+        CountShiftJisBytes(uncompressed.data(), header->UncompressedLength);
+
+    result.Success = true;
+    return true;
+}
+
+static bool ReadFile(const std::filesystem::path& path, std::vector<char>& data) {
+    HyoutaUtils::IO::File infile(path, HyoutaUtils::IO::OpenMode::Read);
+    if (!infile.IsOpen()) {
+        return false;
+    }
+    const auto length = infile.GetLength();
+    if (!length) {
+        return false;
+    }
+    data.resize(*length);
+    return infile.Read(data.data(), data.size()) == data.size();
+}
+
+static void PrintStatsUsage() {
+    printf(
+        "Usage for token statistics:\n"
+        "  topdec stats [options] (path to compressed file or directory)...\n"
+        "  Directories are searched recursively.\n"
+        "  Options are:\n"
+        "    --json (print machine-readable output)\n"
+        "    --heatmap (include the compression ratio of each 4KB output region)\n"
+        "    --threads N (defaults to the number of hardware threads)\n"
+        "    --profile (print time spent in each phase and per-file latencies)\n"
+        "    --profile-json (path) (write the profile as JSON to the given file)\n"
+        "    --perf (decode every file once more and print hardware performance counters)\n"
+        "    --perf-json (path) (write the performance counters as JSON to the given file)\n");
+}
+
+static void PrintTokenType(const char* name, const TokenTypeStats& stats) {
+    printf("  %-9s %12llu tokens, %12llu bytes in, %12llu bytes out\n",
+           name,
+           static_cast<unsigned long long>(stats.Count),
+           static_cast<unsigned long long>(stats.CompressedBytes),
+           static_cast<unsigned long long>(stats.UncompressedBytes));
+}
+
+template<size_t N>
+static void PrintLinearHistogram(const char* name, const std::array<uint64_t, N>& histogram) {
+    printf("%s:\n", name);
+    for (size_t i = 0; i < N; ++i) {
+        if (histogram[i] != 0) {
+            printf("  %9zu: %llu\n", i, static_cast<unsigned long long>(histogram[i]));
+        }
+    }
+}
+
+template<size_t N>
+static void PrintLog2Histogram(const char* name, const std::array<uint64_t, N>& histogram) {
+    printf("%s:\n", name);
+    for (size_t i = 0; i < N; ++i) {
+        if (histogram[i] != 0) {
+            printf("  %4zu-%4zu: %llu\n",
+                   size_t(1) << i,
+                   (size_t(1) << (i + 1)) - 1,
+                   static_cast<unsigned long long>(histogram[i]));
+        }
+    }
+}
+
+static void PrintStats(const TokenStats& stats) {
+    printf("files: %llu\n", static_cast<unsigned long long>(stats.Files));
+    printf("compressed: %llu bytes, uncompressed: %llu bytes, ratio %.4f\n",
+           static_cast<unsigned long long>(stats.CompressedBytes),
+           static_cast<unsigned long long>(stats.UncompressedBytes),
+           Ratio(stats.CompressedBytes, stats.UncompressedBytes));
+    printf("flag bytes: %llu (%.4f of compressed data)\n",
+           static_cast<unsigned long long>(stats.FlagBytes),
+           Ratio(stats.FlagBytes, stats.CompressedBytes));
+    printf("shift-jis bytes: %llu (%.4f of uncompressed data)\n",
+           static_cast<unsigned long long>(stats.ShiftJisBytes),
+           Ratio(stats.ShiftJisBytes, stats.UncompressedBytes));
+    printf("tokens:\n");
+    PrintTokenType("literals", stats.Literals);
+    PrintTokenType("runs", stats.Runs);
+    PrintTokenType("backrefs", stats.Backrefs);
+    PrintTokenType("dictrefs", stats.DictRefs);
+    PrintLinearHistogram("backref lengths", stats.BackrefLengths);
+    PrintLog2Histogram("backref offsets", stats.BackrefOffsets);
+    PrintLinearHistogram("dictref lengths", stats.DictRefLengths);
+    PrintLog2Histogram("dictref distances", stats.DictRefDistances);
+    PrintLog2Histogram("run lengths", stats.RunLengths);
+}
+
+static double RegionRatio(const FileTokenStats& file, size_t region) {
+    const uint64_t regionStart = region * token_stats_region_size;
+    const uint64_t regionSize =
+        std::min<uint64_t>(token_stats_region_size, file.Stats.UncompressedBytes - regionStart);
+    return Ratio(file.RegionCompressedBytes[region], regionSize);
+}
+
+int StatsMain(int argc, char** argv) {
+    bool json = false;
+    bool heatmap = false;
+    bool profile = false;
+    const char* profileJsonPath = nullptr;
+    bool perf = false;
+    const char* perfJsonPath = nullptr;
+    size_t threadCount = std::max(size_t(1), size_t(std::thread::hardware_concurrency()));
+    int idx = 2;
+    while (idx < argc) {
+        if (strcmp("--json", argv[idx]) == 0) {
+            json = true;
+            ++idx;
+            continue;
+        }
+        if (strcmp("--heatmap", argv[idx]) == 0) {
+            heatmap = true;
+            ++idx;
+            continue;
+        }
+        if (strcmp("--profile", argv[idx]) == 0) {
+            profile = true;
+            ++idx;
+            continue;
+        }
+        if (strcmp("--profile-json", argv[idx]) == 0) {
+            ++idx;
+            if (idx >= argc) {
+                PrintStatsUsage();
+                return -1;
+            }
+            profileJsonPath = argv[idx];
+            ++idx;
+            continue;
+        }
+        if (strcmp("--perf", argv[idx]) == 0) {
+            perf = true;
+            ++idx;
+            continue;
+        }
+        if (strcmp("--perf-json", argv[idx]) == 0) {
+            ++idx;
+            if (idx >= argc) {
+                PrintStatsUsage();
+                return -1;
+            }
+            perf = true;
+            perfJsonPath = argv[idx];
+            ++idx;
+            continue;
+        }
+        if (strcmp("--threads", argv[idx]) == 0) {
+            ++idx;
+            if (idx >= argc) {
+                PrintStatsUsage();
+                return -1;
+            }
+            threadCount = std::max(size_t(1), size_t(strtoul(argv[idx], nullptr, 10)));
+            ++idx;
+            continue;
+        }
+
+        break;
+    }
+    if (idx >= argc) {
+        PrintStatsUsage();
+        return -1;
+    }
+
+    std::vector<FileTokenStats> files;
+    for (; idx < argc; ++idx) {
+        std::filesystem::path path(argv[idx]);
+        std::error_code ec;
+        if (std::filesystem::is_directory(path, ec)) {
+            std::vector<std::filesystem::path> paths;
+            std::vector<std::filesystem::path> unreadable;
+            list_files_recursive(path, paths, unreadable);
+            std::sort(paths.begin(), paths.end());
+            for (const auto& p : paths) {
+                files.emplace_back().Path = p.string();
+            }
+            for (const auto& p : unreadable) {
+                FileTokenStats& file = files.emplace_back();
+                file.Path = p.string();
+                file.Error = "failed to read directory";
+            }
+        } else {
+            files.emplace_back().Path = path.string();
+        }
+    }
+
+    ProfileReport report;
+    PerfReport perfReport;
+    std::atomic<bool> perfUnavailable = false;
+    std::atomic<size_t> nextFile = 0;
+    const auto worker = [&]() -> void {
+        std::vector<char> data;
+        std::vector<char> perfBuffer;
+        PerfCounterGroup perfCounters;
+        if (perf && !perfCounters.Open()) {
+            perfUnavailable = true;
+        }
+        while (true) {
+            const size_t i = nextFile.fetch_add(1);
+            if (i >= files.size()) {
+                return;
+            }
+            FileTokenStats& file = files[i];
+            if (!file.Error.empty()) {
+                continue;
+            }
+            ProfileSample sample;
+            PhaseTimer timer(sample.Times);
+            if (!ReadFile(std::filesystem::path(file.Path), data)) {
+                file.Error = "failed to read file";
+                continue;
+            }
+            timer.Next(ProfilePhase::Read);
+            collect_token_stats(data.data(), data.size(), file);
+            timer.Next(ProfilePhase::Codec);
+
+            // the statistics observer distorts the counters, so measure a plain decode instead
+            if (perfCounters.IsOpen() && file.Success && file.Type != 0x00) {
+                const auto header = parse_compressed_header(data.data(), data.size());
+                perfBuffer.resize(header->UncompressedLength + decompress_reserve_extra_bytes());
+                perfCounters.Start();
+                decompress_type(header->Type,
+                                data.data() + compressed_header_size,
+                                header->CompressedLength,
+                                perfBuffer.data(),
+                                header->UncompressedLength);
+                perfReport.Add(
+                    perf_format_name(header->Type, false), data.size(), perfCounters.Stop());
+            }
+            if (profile || profileJsonPath != nullptr) {
+                sample.Path = file.Path;
+                sample.InputBytes = data.size();
+                report.Add(std::move(sample));
+            }
+            if (!heatmap) {
+                file.RegionCompressedBytes.clear();
+            }
+        }
+    };
+    threadCount = std::min(threadCount, files.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : threads) {
+        t.join();
+    }
+    report.Finish();
+
+    TokenStats total;
+    size_t failed = 0;
+    for (const auto& file : files) {
+        if (file.Success) {
+            total.Merge(file.Stats);
+        } else {
+            ++failed;
+        }
+    }
+
+    if (json) {
+        HyoutaUtils::Json::Writer writer;
+        writer.BeginObject();
+        writer.Key("total");
+        total.WriteJson(writer);
+        writer.Key("failed");
+        writer.UInt(failed);
+        writer.Key("files");
+        writer.BeginArray();
+        for (const auto& file : files) {
+            writer.BeginObject();
+            writer.Key("path");
+            writer.String(file.Path);
+            writer.Key("success");
+            writer.Bool(file.Success);
+            if (!file.Success) {
+                writer.Key("error");
+                writer.String(file.Error);
+                writer.EndObject();
+                continue;
+            }
+            writer.Key("type");
+            writer.UInt(file.Type);
+            writer.Key("stats");
+            file.Stats.WriteJson(writer);
+            if (heatmap) {
+                writer.Key("region_ratios");
+                writer.BeginArray();
+                for (size_t i = 0; i < file.RegionCompressedBytes.size(); ++i) {
+                    writer.Double(RegionRatio(file, i));
+                }
+                writer.EndArray();
+            }
+            writer.EndObject();
+        }
+        writer.EndArray();
+        writer.EndObject();
+        printf("%s\n", writer.GetString().c_str());
+    } else {
+        for (const auto& file : files) {
+            if (!file.Success) {
+                printf("%s: %s\n", file.Path.c_str(), file.Error.c_str());
+            }
+        }
+        PrintStats(total);
+        if (heatmap) {
+            for (const auto& file : files) {
+                if (!file.Success) {
+                    continue;
+                }
+                printf("%s (type 0x%02x):\n", file.Path.c_str(), static_cast<int>(file.Type));
+                for (size_t i = 0; i < file.RegionCompressedBytes.size(); ++i) {
+                    printf("  0x%08zx: %.4f\n", i * token_stats_region_size, RegionRatio(file, i));
+                }
+            }
+        }
+    }
+
+    if (profile) {
+        report.Print();
+    }
+    if (perfUnavailable) {
+        printf("performance counters are not available\n");
+    } else if (perf) {
+        if (perfJsonPath == nullptr) {
+            perfReport.Print();
+        } else if (!perfReport.WriteJsonFile(perfJsonPath)) {
+            printf("failed to write performance counters\n");
+            return -1;
+        }
+    }
+    if (profileJsonPath != nullptr && !report.WriteJsonFile(profileJsonPath)) {
+        printf("failed to write profile\n");
+        return -1;
+    }
+
+    return failed == 0 ? 0 : -1;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "json.h"
+
+// Size of the output regions the compression ratio heatmap is computed over.
+constexpr size_t token_stats_region_size = 0x1000;
+
+struct TokenTypeStats {
+    uint64_t Count = 0;
+    uint64_t CompressedBytes = 0;
+    uint64_t UncompressedBytes = 0;
+};
+
+struct TokenStats {
+    uint64_t Files = 0;
+    uint64_t CompressedBytes = 0;
+    uint64_t UncompressedBytes = 0;
+    uint64_t FlagBytes = 0;
+
+    // uncompressed bytes that are part of a double-byte Shift-JIS character
+    uint64_t ShiftJisBytes = 0;
+
+    TokenTypeStats Literals;
+    TokenTypeStats Runs;
+    TokenTypeStats Backrefs;
+    TokenTypeStats DictRefs;
+
+    // indexed by the exact match length
+    std::array<uint64_t, 19> BackrefLengths{};
+    std::array<uint64_t, 19> DictRefLengths{};
+
+    // indexed by floor(log2(value)), so bucket n covers [2^n, 2^(n+1))
+    std::array<uint64_t, 12> BackrefOffsets{};
+    std::array<uint64_t, 13> DictRefDistances{};
+    std::array<uint64_t, 9> RunLengths{};
+
+    void Merge(const TokenStats& other);
+    void WriteJson(HyoutaUtils::Json::Writer& json) const;
+};
+
+struct FileTokenStats {
+    std::string Path;
+    uint8_t Type = 0;
+    bool Success = false;
+    std::string Error;
+    TokenStats Stats;
+
+    // compressed bytes spent on each token_stats_region_size region of the output
+    std::vector<uint32_t> RegionCompressedBytes;
+};
+
+// Decodes the given compressed file image (including header) and collects token statistics.
+// Returns false and fills result.Error if the data could not be decoded.
+bool collect_token_stats(const char* data, size_t length, FileTokenStats& result);
+
+int StatsMain(int argc, char** argv);
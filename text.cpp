@@ -1,247 +1,222 @@
 #include "text.h"
 
+#include <algorithm>
 #include <array>
+#include <bit>
 #include <charconv>
+#include <cstddef>
+#include <cstdint>
 #include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
 
-#ifdef _MSC_VER
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
-#else
-#include <iconv.h>
+#include "text_rewrite.h"
+#include "text_unicode.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TEXT_UTF_SSE2
 #endif
 
 namespace HyoutaUtils::TextUtils {
-#ifdef _MSC_VER
-static std::optional<std::string>
-    WStringToCodepage(const wchar_t* data, size_t length, UINT codepage) {
-    if (length == 0) {
-        return std::string();
-    }
-
-    if (length > INT32_MAX) {
-        return std::nullopt;
-    }
-
-    BOOL usedDefaultChar = FALSE;
-    const DWORD flags = (codepage == CP_UTF8) ? WC_ERR_INVALID_CHARS : WC_NO_BEST_FIT_CHARS;
-    const LPBOOL usedDefaultCharPtr = (codepage == CP_UTF8) ? nullptr : &usedDefaultChar;
-
-    const auto requiredBytes = WideCharToMultiByte(
-        codepage, flags, data, static_cast<int>(length), nullptr, 0, nullptr, usedDefaultCharPtr);
-    if (requiredBytes <= 0 || usedDefaultChar != FALSE) {
-        return std::nullopt;
-    }
-
-    std::string result;
-    result.resize(requiredBytes);
-    const auto convertedBytes = WideCharToMultiByte(codepage,
-                                                    flags,
-                                                    data,
-                                                    static_cast<int>(length),
-                                                    result.data(),
-                                                    result.size(),
-                                                    nullptr,
-                                                    usedDefaultCharPtr);
-    if (convertedBytes != requiredBytes || usedDefaultChar != FALSE) {
-        return std::nullopt;
-    }
-
-    return result;
+#ifdef TEXT_UTF_SSE2
+// Number of ASCII bytes at the start of the 16 at 'in'.
+static size_t AsciiPrefix16(const uint8_t* in) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+    const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(v));
+    return mask == 0 ? 16 : static_cast<size_t>(std::countr_zero(mask));
 }
 
-template<typename T>
-static std::optional<T> CodepageToString16(const char* data, size_t length, UINT codepage) {
-    static_assert(sizeof(typename T::value_type) == 2);
-
-    if (length == 0) {
-        return T();
-    }
-
-    if (length > INT32_MAX) {
-        return std::nullopt;
-    }
+// Number of code units below 0x80 at the start of the 16 at 'in'.
+static size_t AsciiPrefix16(const char16_t* in) {
+    const __m128i high = _mm_set1_epi16(static_cast<short>(0xff80));
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 8));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i asciiA = _mm_cmpeq_epi16(_mm_and_si128(a, high), zero);
+    const __m128i asciiB = _mm_cmpeq_epi16(_mm_and_si128(b, high), zero);
+    const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_packs_epi16(asciiA, asciiB)));
+    return mask == 0xffff ? 16 : static_cast<size_t>(std::countr_one(mask));
+}
+#endif
 
-    const auto requiredBytes =
-        MultiByteToWideChar(codepage, MB_ERR_INVALID_CHARS, data, length, nullptr, 0);
-    if (requiredBytes <= 0) {
-        return std::nullopt;
-    }
+template<bool Write>
+static std::optional<size_t> ConvertUtf8ToUtf16(std::string_view input,
+                                                char16_t* output,
+                                                size_t capacity) {
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(input.data());
+    const uint8_t* const end = in + input.size();
+    size_t length = 0;
+    while (in != end) {
+#ifdef TEXT_UTF_SSE2
+        // Widen the ASCII bytes at the start of the next 16. A full block is stored in one go;
+        // otherwise the prefix is, and the scalar code below takes the character after it.
+        if (end - in >= 16) {
+            const size_t ascii = AsciiPrefix16(in);
+            if (ascii == 16) {
+                if (!Unicode::Reserve<Write>(length, capacity, 16)) {
+                    return std::nullopt;
+                }
+                if constexpr (Write) {
+                    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+                    const __m128i zero = _mm_setzero_si128();
+                    __m128i* out = reinterpret_cast<__m128i*>(output + length);
+                    _mm_storeu_si128(out, _mm_unpacklo_epi8(v, zero));
+                    _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(v, zero));
+                }
+                in += 16;
+                length += 16;
+                continue;
+            }
+            if (!Unicode::Reserve<Write>(length, capacity, ascii)) {
+                return std::nullopt;
+            }
+            if constexpr (Write) {
+                for (size_t i = 0; i < ascii; ++i) {
+                    output[length + i] = static_cast<char16_t>(in[i]);
+                }
+            }
+            in += ascii;
+            length += ascii;
+        }
+#endif
 
-    T wstr;
-    wstr.resize(requiredBytes);
-    const auto convertedBytes = MultiByteToWideChar(
-        codepage, MB_ERR_INVALID_CHARS, data, length, (wchar_t*)wstr.data(), wstr.size());
-    if (convertedBytes != requiredBytes) {
-        return std::nullopt;
+        const auto [c, inputLength] = Unicode::DecodeUtf8(in, end);
+        if (inputLength == 0) {
+            return std::nullopt;
+        }
+        in += inputLength;
+        if (c < 0x10000) {
+            if (!Unicode::Reserve<Write>(length, capacity, 1)) {
+                return std::nullopt;
+            }
+            if constexpr (Write) {
+                output[length] = static_cast<char16_t>(c);
+            }
+            ++length;
+        } else {
+            if (!Unicode::Reserve<Write>(length, capacity, 2)) {
+                return std::nullopt;
+            }
+            if constexpr (Write) {
+                output[length] = static_cast<char16_t>(0xd800 + ((c - 0x10000) >> 10));
+                output[length + 1] = static_cast<char16_t>(0xdc00 + (c & 0x3ff));
+            }
+            length += 2;
+        }
     }
-
-    return wstr;
+    return length;
 }
-#else
-static std::optional<std::string> ConvertString(const char* data,
-                                                size_t length,
-                                                const char* sourceEncoding,
-                                                const char* targetEncoding) {
-    if (length == 0) {
-        return std::string();
-    }
 
-    iconv_t cd = iconv_open(targetEncoding, sourceEncoding);
-    if (cd == ((iconv_t)-1)) {
-        return std::nullopt;
-    }
-    struct ScopedIconvT {
-        iconv_t cd;
-        ~ScopedIconvT() {
-            iconv_close(cd);
+template<bool Write>
+static std::optional<size_t> ConvertUtf16ToUtf8(std::u16string_view input,
+                                                char* output,
+                                                size_t capacity) {
+    const char16_t* in = input.data();
+    const char16_t* const end = in + input.size();
+    size_t length = 0;
+    while (in != end) {
+#ifdef TEXT_UTF_SSE2
+        // Narrow the ASCII code units at the start of the next 16, like in ConvertUtf8ToUtf16().
+        if (end - in >= 16) {
+            const size_t ascii = AsciiPrefix16(in);
+            if (ascii == 16) {
+                if (!Unicode::Reserve<Write>(length, capacity, 16)) {
+                    return std::nullopt;
+                }
+                if constexpr (Write) {
+                    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+                    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 8));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + length),
+                                     _mm_packus_epi16(a, b));
+                }
+                in += 16;
+                length += 16;
+                continue;
+            }
+            if (!Unicode::Reserve<Write>(length, capacity, ascii)) {
+                return std::nullopt;
+            }
+            if constexpr (Write) {
+                for (size_t i = 0; i < ascii; ++i) {
+                    output[length + i] = static_cast<char>(in[i]);
+                }
+            }
+            in += ascii;
+            length += ascii;
         }
-    };
-    ScopedIconvT scoped{cd};
+#endif
 
-    std::string result;
-    std::array<char, 2048> buffer;
-    size_t rest = length;
-    char* next = const_cast<char*>(data);
-    do {
-        char* in = next;
-        char* out = buffer.data();
-        size_t outfree = buffer.size();
-        size_t rv = iconv(cd, &in, &rest, &out, &outfree);
-        if (out == buffer.data()) {
-            break;
+        char32_t c = *in;
+        if (c >= 0xd800 && c <= 0xdfff) {
+            // only a high surrogate followed by a low one is valid
+            if (c >= 0xdc00 || end - in < 2 || in[1] < 0xdc00 || in[1] > 0xdfff) {
+                return std::nullopt;
+            }
+            c = 0x10000 + ((c - 0xd800) << 10) + (in[1] - 0xdc00);
+            in += 2;
+        } else {
+            ++in;
         }
-        if (rv == ((size_t)-1) && errno != E2BIG) {
+        const size_t count = Unicode::Utf8Length(c);
+        if (!Unicode::Reserve<Write>(length, capacity, count)) {
             return std::nullopt;
         }
-        result.append(buffer.data(), out);
-        if (in == next) {
-            break;
+        if constexpr (Write) {
+            Unicode::EncodeUtf8(output + length, c, count);
         }
-        next = in;
-    } while (rest > 0);
-
-    if (rest != 0) {
-        return std::nullopt;
+        length += count;
     }
-
-    return result;
+    return length;
 }
-#endif
 
-std::optional<std::string> Utf16ToUtf8(const char16_t* data, size_t length) {
-#ifdef _MSC_VER
-    return WStringToCodepage(reinterpret_cast<const wchar_t*>(data), length, CP_UTF8);
-#else
-    return ConvertString(reinterpret_cast<const char*>(data), length * 2, "UTF-16LE", "UTF-8");
-#endif
+std::optional<size_t> Utf8ToUtf16(std::string_view input, std::span<char16_t> output) {
+    if (output.empty()) {
+        return ConvertUtf8ToUtf16<false>(input, nullptr, 0);
+    }
+    return ConvertUtf8ToUtf16<true>(input, output.data(), output.size());
 }
 
-std::optional<std::u16string> Utf8ToUtf16(const char* data, size_t length) {
-#ifdef _MSC_VER
-    return CodepageToString16<std::u16string>(data, length, CP_UTF8);
-#else
-    const auto str = ConvertString(data, length, "UTF-8", "UTF-16LE");
-    if (!str || (str->size() % 2) != 0) {
-        return std::nullopt;
+std::optional<size_t> Utf16ToUtf8(std::u16string_view input, std::span<char> output) {
+    if (output.empty()) {
+        return ConvertUtf16ToUtf8<false>(input, nullptr, 0);
     }
-    std::u16string str16;
-    str16.reserve(str->size() / 2);
-    for (size_t i = 0; i < str->size(); i += 2) {
-        const char16_t c =
-            char16_t(uint16_t(uint8_t((*str)[i])) | (uint16_t(uint8_t((*str)[i + 1])) << 8));
-        str16.push_back(c);
-    }
-    return str16;
-#endif
+    return ConvertUtf16ToUtf8<true>(input, output.data(), output.size());
 }
 
-std::optional<std::string> Utf16ToShiftJis(const char16_t* data, size_t length) {
-#ifdef _MSC_VER
-    return WStringToCodepage(reinterpret_cast<const wchar_t*>(data), length, 932);
-#else
-    auto str8 = Utf16ToUtf8(data, length);
-    if (!str8) {
-        return std::nullopt;
-    }
-    return Utf8ToShiftJis(str8->data(), str8->size());
-#endif
+std::optional<std::string> Utf16ToUtf8(const char16_t* data, size_t length) {
+    return Unicode::ConvertAllocating<std::string>(
+        std::u16string_view(data, length), 3, [](std::u16string_view in, std::span<char> out) {
+            return Utf16ToUtf8(in, out);
+        });
 }
 
-std::optional<std::u16string> ShiftJisToUtf16(const char* data, size_t length) {
-#ifdef _MSC_VER
-    return CodepageToString16<std::u16string>(data, length, 932);
-#else
-    auto str8 = ShiftJisToUtf8(data, length);
-    if (!str8) {
-        return std::nullopt;
-    }
-    return Utf8ToUtf16(str8->data(), str8->size());
-#endif
+std::optional<std::u16string> Utf8ToUtf16(const char* data, size_t length) {
+    return Unicode::ConvertAllocating<std::u16string>(
+        std::string_view(data, length), 1, [](std::string_view in, std::span<char16_t> out) {
+            return Utf8ToUtf16(in, out);
+        });
 }
 
 #ifdef _MSC_VER
 std::optional<std::string> WStringToUtf8(const wchar_t* data, size_t length) {
-    return WStringToCodepage(data, length, CP_UTF8);
+    return Utf16ToUtf8(reinterpret_cast<const char16_t*>(data), length);
 }
 
 std::optional<std::wstring> Utf8ToWString(const char* data, size_t length) {
-    return CodepageToString16<std::wstring>(data, length, CP_UTF8);
-}
-
-std::optional<std::string> WStringToShiftJis(const wchar_t* data, size_t length) {
-    return WStringToCodepage(data, length, 932);
-}
-
-std::optional<std::wstring> ShiftJisToWString(const char* data, size_t length) {
-    return CodepageToString16<std::wstring>(data, length, 932);
+    return Unicode::ConvertAllocating<std::wstring>(
+        std::string_view(data, length), 1, [](std::string_view in, std::span<wchar_t> out) {
+            return Utf8ToUtf16(
+                in, std::span<char16_t>(reinterpret_cast<char16_t*>(out.data()), out.size()));
+        });
 }
 #endif
 
-std::optional<std::string> ShiftJisToUtf8(const char* data, size_t length) {
-#ifdef _MSC_VER
-    auto wstr = ShiftJisToWString(data, length);
-    if (!wstr) {
-        return std::nullopt;
-    }
-    return WStringToUtf8(wstr->data(), wstr->size());
-#else
-    return ConvertString(data, length, "CP932", "UTF-8");
-#endif
-}
-
-std::optional<std::string> Utf8ToShiftJis(const char* data, size_t length) {
-#ifdef _MSC_VER
-    auto wstr = Utf8ToWString(data, length);
-    if (!wstr) {
-        return std::nullopt;
-    }
-    return WStringToShiftJis(wstr->data(), wstr->size());
-#else
-    return ConvertString(data, length, "UTF-8", "CP932");
-#endif
-}
-
 std::string Replace(std::string_view input, std::string_view search, std::string_view replacement) {
-    if (search.empty()) {
-        return std::string(input);
-    }
-
-    std::string s;
-    std::string_view rest = input;
-    while (!rest.empty()) {
-        if (rest.starts_with(search)) {
-            s += replacement;
-            rest.remove_prefix(search.size());
-        } else {
-            s += rest.front();
-            rest.remove_prefix(1);
-        }
-    }
-    return s;
+    const ReplacementRule rule{search, replacement};
+    return TextReplacer(std::span<const ReplacementRule>(&rule, 1)).Apply(input);
 }
 
 std::string InsertSubstring(std::string_view a,
@@ -249,11 +224,7 @@ std::string InsertSubstring(std::string_view a,
                             std::string_view b,
                             size_t offsetb,
                             size_t lengthb) {
-    std::string s;
-    s += a.substr(0, offseta);
-    s += b.substr(offsetb, lengthb);
-    s += a.substr(offseta);
-    return s;
+    return Concat({a.substr(0, offseta), b.substr(offsetb, lengthb), a.substr(offseta)});
 }
 
 std::string ReplaceSubstring(std::string_view a,
@@ -262,26 +233,15 @@ std::string ReplaceSubstring(std::string_view a,
                              std::string_view b,
                              size_t offsetb,
                              size_t lengthb) {
-    std::string s;
-    s += a.substr(0, offseta);
-    s += b.substr(offsetb, lengthb);
-    s += a.substr(offseta + lengtha);
-    return s;
+    return Concat({a.substr(0, offseta), b.substr(offsetb, lengthb), a.substr(offseta + lengtha)});
 }
 
 std::string Remove(std::string_view input, size_t offset, size_t length) {
-    std::string s;
-    s += input.substr(0, offset);
-    s += input.substr(offset + length);
-    return s;
+    return Concat({input.substr(0, offset), input.substr(offset + length)});
 }
 
 std::string Insert(std::string_view input, size_t offset, std::string_view insert) {
-    std::string s;
-    s += input.substr(0, offset);
-    s += insert;
-    s += input.substr(offset);
-    return s;
+    return Concat({input.substr(0, offset), insert, input.substr(offset)});
 }
 
 std::string UInt32ToString(uint32_t value) {
@@ -294,35 +254,13 @@ std::string UInt32ToString(uint32_t value) {
 }
 
 std::string AdjustNewlinesToTwoSpaces(std::string desc) {
-    size_t idx = 0;
-    std::string s = std::move(desc);
-    while (true) {
-        size_t nidx = s.find_first_of('\n', idx);
-        if (nidx == std::string::npos) {
-            break;
-        }
-
-        size_t spaces = 0;
-        size_t i = nidx + 1;
-        while (i < s.size()) {
-            if (s[i] == ' ') {
-                ++i;
-                ++spaces;
-            } else {
-                break;
-            }
-        }
-
-        if (spaces != 2) {
-            if (spaces < 2) {
-                s = InsertSubstring(s, nidx + 1, "  ", 0, 2 - spaces);
-            } else {
-                s = Remove(s, nidx + 1, spaces - 2);
-            }
-        }
-
-        idx = nidx + 1;
+    const size_t newlines = static_cast<size_t>(std::count(desc.begin(), desc.end(), '\n'));
+    if (newlines == 0) {
+        return desc;
     }
+    std::string s;
+    s.reserve(desc.size() + newlines * 2);
+    AppendWithIndentedLines(s, desc, 2);
     return s;
 }
 
@@ -342,28 +280,15 @@ std::string_view Trim(std::string_view sv) {
 
 std::vector<std::string_view> Split(std::string_view sv, std::string_view splitPattern) {
     std::vector<std::string_view> result;
-    std::string_view rest = sv;
-    while (true) {
-        size_t offset = rest.find(splitPattern);
-        if (offset == std::string_view::npos) {
-            result.push_back(rest);
-            return result;
-        } else {
-            result.push_back(rest.substr(0, offset));
-            rest = rest.substr(offset + splitPattern.size());
-        }
+    for (std::string_view piece : SplitRange(sv, splitPattern)) {
+        result.push_back(piece);
     }
+    return result;
 }
 
-std::string Join(const std::vector<std::string_view>& svs, std::string_view joinPattern) {
+std::string Join(std::span<const std::string_view> svs, std::string_view joinPattern) {
     std::string result;
-    if (!svs.empty()) {
-        result.append(svs[0]);
-        for (size_t i = 1; i < svs.size(); ++i) {
-            result.append(joinPattern);
-            result.append(svs[i]);
-        }
-    }
+    AppendJoined(result, svs, joinPattern);
     return result;
 }
 
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -31,6 +32,24 @@ std::optional<std::wstring> ShiftJisToWString(const char* data, size_t length);
 std::optional<std::string> ShiftJisToUtf8(const char* data, size_t length);
 std::optional<std::string> Utf8ToShiftJis(const char* data, size_t length);
 
+// Non-allocating UTF-8 and UTF-16 conversions, validating the input. Same convention as the CP932
+// ones below.
+std::optional<size_t> Utf8ToUtf16(std::string_view input, std::span<char16_t> output);
+std::optional<size_t> Utf16ToUtf8(std::u16string_view input, std::span<char> output);
+
+// Non-allocating CP932 conversions, using built-in tables. They write the converted string to
+// 'output' and return its length in code units. With an empty 'output' nothing is written, and the
+// return value is the length 'output' needs to have. Returns nullopt if the input isn't valid or
+// doesn't fit into 'output'.
+std::optional<size_t> ShiftJisToUtf8(std::string_view input, std::span<char> output);
+std::optional<size_t> Utf8ToShiftJis(std::string_view input, std::span<char> output);
+std::optional<size_t> ShiftJisToUtf16(std::string_view input, std::span<char16_t> output);
+std::optional<size_t> Utf16ToShiftJis(std::u16string_view input, std::span<char> output);
+
+// Code point of the CP932 double-byte character made of 'first' and 'second', or 0 if there is
+// none.
+char16_t ShiftJisDoubleByteToUtf16(uint8_t first, uint8_t second);
+
 std::string Replace(std::string_view input, std::string_view search, std::string_view replacement);
 std::string InsertSubstring(std::string_view a,
                             size_t offseta,
@@ -48,12 +67,15 @@ std::string Insert(std::string_view input, size_t offset, std::string_view inser
 
 std::string UInt32ToString(uint32_t value);
 
+// Makes every line break be followed by exactly two spaces.
 std::string AdjustNewlinesToTwoSpaces(std::string desc);
 
 std::string_view Trim(std::string_view sv);
 
+// Split() collects the pieces of a SplitRange from text_rewrite.h; iterate over one of those
+// directly to avoid allocating.
 std::vector<std::string_view> Split(std::string_view sv, std::string_view splitPattern);
-std::string Join(const std::vector<std::string_view>& svs, std::string_view joinPattern);
+std::string Join(std::span<const std::string_view> svs, std::string_view joinPattern);
 
 bool CaseInsensitiveEquals(std::string_view lhs, std::string_view rhs);
 } // namespace HyoutaUtils::TextUtils
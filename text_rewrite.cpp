@@ -0,0 +1,207 @@
+#include "text_rewrite.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TEXT_REWRITE_SSE2
+#endif
+
+namespace HyoutaUtils::TextUtils {
+// With more distinct first bytes than this, comparing against each of them costs more than a
+// table lookup per byte.
+static constexpr size_t max_vector_first_bytes = 8;
+
+TextReplacer::TextReplacer(std::span<const ReplacementRule> rules) {
+    for (const ReplacementRule& rule : rules) {
+        if (!rule.Search.empty()) {
+            Rules.push_back(Rule{std::string(rule.Search), std::string(rule.Replacement)});
+        }
+    }
+
+    // counting sort by first byte, keeping the priority order within each bucket
+    std::array<uint32_t, 256> counts{};
+    for (const Rule& rule : Rules) {
+        ++counts[static_cast<uint8_t>(rule.Search[0])];
+    }
+    uint32_t start = 0;
+    for (size_t b = 0; b < 256; ++b) {
+        BucketStart[b] = start;
+        start += counts[b];
+        if (counts[b] != 0) {
+            FirstBytes.push_back(static_cast<uint8_t>(b));
+        }
+    }
+    BucketStart[256] = start;
+    RuleOrder.resize(Rules.size());
+    std::array<uint32_t, 256> next{};
+    std::copy(BucketStart.begin(), BucketStart.begin() + 256, next.begin());
+    for (size_t i = 0; i < Rules.size(); ++i) {
+        RuleOrder[next[static_cast<uint8_t>(Rules[i].Search[0])]++] = static_cast<uint32_t>(i);
+    }
+}
+
+TextReplacer::~TextReplacer() = default;
+
+size_t TextReplacer::FindCandidate(const char* data, size_t offset, size_t size) const {
+    if (FirstBytes.size() == 1) {
+        const void* p = std::memchr(data + offset, FirstBytes[0], size - offset);
+        return p == nullptr ? size : static_cast<size_t>(static_cast<const char*>(p) - data);
+    }
+
+#ifdef TEXT_REWRITE_SSE2
+    if (FirstBytes.size() <= max_vector_first_bytes) {
+        __m128i needles[max_vector_first_bytes];
+        for (size_t i = 0; i < FirstBytes.size(); ++i) {
+            needles[i] = _mm_set1_epi8(static_cast<char>(FirstBytes[i]));
+        }
+        while (size - offset >= 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+            __m128i hits = _mm_cmpeq_epi8(v, needles[0]);
+            for (size_t i = 1; i < FirstBytes.size(); ++i) {
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, needles[i]));
+            }
+            const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hits));
+            if (mask != 0) {
+                return offset + static_cast<size_t>(std::countr_zero(mask));
+            }
+            offset += 16;
+        }
+    }
+#endif
+
+    for (; offset < size; ++offset) {
+        const uint8_t b = static_cast<uint8_t>(data[offset]);
+        if (BucketStart[b] != BucketStart[b + 1]) {
+            return offset;
+        }
+    }
+    return size;
+}
+
+void TextReplacer::Apply(std::string_view input, std::string& output) const {
+    if (Rules.empty()) {
+        output.append(input);
+        return;
+    }
+
+    const char* const data = input.data();
+    const size_t size = input.size();
+    size_t copied = 0;
+    size_t offset = 0;
+    while (true) {
+        offset = FindCandidate(data, offset, size);
+        if (offset == size) {
+            break;
+        }
+
+        const uint8_t b = static_cast<uint8_t>(data[offset]);
+        const Rule* match = nullptr;
+        for (uint32_t i = BucketStart[b]; i < BucketStart[b + 1]; ++i) {
+            const Rule& rule = Rules[RuleOrder[i]];
+            if (input.substr(offset).starts_with(rule.Search)) {
+                match = &rule;
+                break;
+            }
+        }
+        if (match == nullptr) {
+            ++offset;
+            continue;
+        }
+
+        output.append(data + copied, offset - copied);
+        output.append(match->Replacement);
+        offset += match->Search.size();
+        copied = offset;
+    }
+    output.append(data + copied, size - copied);
+}
+
+std::string TextReplacer::Apply(std::string_view input) const {
+    std::string result;
+    result.reserve(input.size());
+    Apply(input, result);
+    return result;
+}
+
+void AppendWithIndentedLines(std::string& output, std::string_view input, size_t spaces) {
+    while (true) {
+        const size_t newline = input.find('\n');
+        if (newline == std::string_view::npos) {
+            output.append(input);
+            return;
+        }
+        output.append(input.substr(0, newline + 1));
+        output.append(spaces, ' ');
+        input.remove_prefix(newline + 1);
+        input.remove_prefix(std::min(input.find_first_not_of(' '), input.size()));
+    }
+}
+
+void AppendJoined(std::string& output,
+                  std::span<const std::string_view> parts,
+                  std::string_view separator) {
+    if (parts.empty()) {
+        return;
+    }
+    size_t length = output.size() + separator.size() * (parts.size() - 1);
+    for (std::string_view part : parts) {
+        length += part.size();
+    }
+    output.reserve(length);
+    output.append(parts[0]);
+    for (size_t i = 1; i < parts.size(); ++i) {
+        output.append(separator);
+        output.append(parts[i]);
+    }
+}
+
+std::string Concat(std::initializer_list<std::string_view> parts) {
+    size_t length = 0;
+    for (std::string_view part : parts) {
+        length += part.size();
+    }
+    std::string result;
+    result.reserve(length);
+    for (std::string_view part : parts) {
+        result.append(part);
+    }
+    return result;
+}
+
+SplitRange::Iterator::Iterator(std::string_view input, std::string_view separator)
+  : Rest(input), Separator(separator), Done(false) {
+    FindNext();
+}
+
+SplitRange::Iterator& SplitRange::Iterator::operator++() {
+    if (Last) {
+        Done = true;
+    } else {
+        FindNext();
+    }
+    return *this;
+}
+
+void SplitRange::Iterator::FindNext() {
+    const size_t offset = Separator.empty() ? std::string_view::npos : Rest.find(Separator);
+    if (offset == std::string_view::npos) {
+        Current = Rest;
+        Rest = std::string_view();
+        Last = true;
+    } else {
+        Current = Rest.substr(0, offset);
+        Rest.remove_prefix(offset + Separator.size());
+    }
+}
+} // namespace HyoutaUtils::TextUtils
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Single-pass building blocks for rewriting strings. Everything here appends to an output string
+// instead of returning a new one, so callers can reserve once and reuse their buffers; the
+// convenience functions in text.h are built on top of these.
+namespace HyoutaUtils::TextUtils {
+struct ReplacementRule {
+    std::string_view Search;
+    std::string_view Replacement;
+};
+
+// Replaces any number of search strings in one pass over the input. Matches are found left to
+// right and never overlap; where several rules match at the same offset, the one listed first
+// wins. Rules with an empty search string are ignored.
+//
+// Candidate offsets are found by the first byte of the search strings: with a single distinct
+// first byte through memchr(), with up to eight of them 16 bytes at a time with SSE2 where
+// available, and otherwise through a lookup table. Only the rules sharing the byte at a candidate
+// are compared there.
+struct TextReplacer {
+public:
+    explicit TextReplacer(std::span<const ReplacementRule> rules);
+    TextReplacer(const TextReplacer& other) = default;
+    TextReplacer(TextReplacer&& other) = default;
+    TextReplacer& operator=(const TextReplacer& other) = default;
+    TextReplacer& operator=(TextReplacer&& other) = default;
+    ~TextReplacer();
+
+    // Appends 'input' with all replacements applied to 'output'.
+    void Apply(std::string_view input, std::string& output) const;
+    std::string Apply(std::string_view input) const;
+
+private:
+    struct Rule {
+        std::string Search;
+        std::string Replacement;
+    };
+
+    size_t FindCandidate(const char* data, size_t offset, size_t size) const;
+
+    std::vector<Rule> Rules;
+
+    // Rules[RuleOrder[BucketStart[b]]] to Rules[RuleOrder[BucketStart[b + 1] - 1]] are the rules
+    // whose search string starts with byte b, in priority order.
+    std::vector<uint32_t> RuleOrder;
+    std::array<uint32_t, 257> BucketStart{};
+
+    // distinct first bytes of all search strings
+    std::vector<uint8_t> FirstBytes;
+};
+
+// Appends 'input' to 'output', with every line break followed by exactly 'spaces' spaces: runs of
+// spaces directly after a '\n' are shortened or padded, including after a final '\n'.
+void AppendWithIndentedLines(std::string& output, std::string_view input, size_t spaces);
+
+// Appends all of 'parts' to 'output', with 'separator' between each two of them, after reserving
+// the space for the result.
+void AppendJoined(std::string& output,
+                  std::span<const std::string_view> parts,
+                  std::string_view separator);
+
+// Concatenates 'parts' into a string allocated once at its final size.
+std::string Concat(std::initializer_list<std::string_view> parts);
+
+// Lazily splits a string at every occurrence of a separator, like Split() in text.h but without
+// collecting the pieces:
+//
+//     for (std::string_view line : SplitRange(text, "\n")) { ... }
+//
+// An input without the separator is a single piece, so there is always at least one, even for an
+// empty input. An empty separator doesn't split at all.
+struct SplitRange {
+public:
+    struct Iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = ptrdiff_t;
+
+        Iterator() = default;
+        Iterator(std::string_view input, std::string_view separator);
+
+        std::string_view operator*() const {
+            return Current;
+        }
+        Iterator& operator++();
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+        bool operator==(std::default_sentinel_t) const {
+            return Done;
+        }
+
+    private:
+        void FindNext();
+
+        std::string_view Rest;
+        std::string_view Separator;
+        std::string_view Current;
+
+        // set once a piece without a following separator has been passed
+        bool Last = false;
+        bool Done = true;
+    };
+
+    SplitRange(std::string_view input, std::string_view separator)
+      : Input(input), Separator(separator) {}
+
+    Iterator begin() const {
+        return Iterator(Input, Separator);
+    }
+    std::default_sentinel_t end() const {
+        return std::default_sentinel;
+    }
+
+private:
+    std::string_view Input;
+    std::string_view Separator;
+};
+} // namespace HyoutaUtils::TextUtils
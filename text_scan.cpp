@@ -0,0 +1,427 @@
+#include "text_scan.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TEXT_SCAN_SSE2
+#endif
+
+#include "file.h"
+#include "mirror.h"
+#include "text.h"
+#include "thread_pool.h"
+#include "topdec.h"
+
+// Assigned CP932 double-byte characters, except for the user-defined area, which decodes to the
+// private use area and doesn't show up in text.
+static bool IsShiftJisPair(uint8_t first, uint8_t second) {
+    const char16_t c = HyoutaUtils::TextUtils::ShiftJisDoubleByteToUtf16(first, second);
+    return c != 0 && (c < 0xe000 || c > 0xf8ff);
+}
+
+static bool IsSingleByteText(uint8_t c, bool shiftJis) {
+    if ((c >= 0x20 && c < 0x7f) || c == '\t' || c == '\n' || c == '\r') {
+        return true;
+    }
+    // half-width katakana
+    return shiftJis && c >= 0xa1 && c <= 0xdf;
+}
+
+// Bytes that can't be part of any text, not even as the second byte of a Shift-JIS character.
+static bool IsBreaker(uint8_t c, bool shiftJis) {
+    if (c < 0x20) {
+        return c != '\t' && c != '\n' && c != '\r';
+    }
+    return c == 0x7f || c >= (shiftJis ? 0xfd : 0x80);
+}
+
+#ifdef TEXT_SCAN_SSE2
+static uint32_t BreakerMask(const char* p, bool shiftJis) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x1f)), v);
+    const __m128i whitespace = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+                                                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+                                            _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    __m128i breaker = _mm_or_si128(_mm_andnot_si128(whitespace, control),
+                                   _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+    if (shiftJis) {
+        const __m128i high = _mm_set1_epi8(static_cast<char>(0xfd));
+        breaker = _mm_or_si128(breaker, _mm_cmpeq_epi8(_mm_max_epu8(v, high), v));
+    } else {
+        // only the top bit of each byte ends up in the mask
+        breaker = _mm_or_si128(breaker, v);
+    }
+    return static_cast<uint32_t>(_mm_movemask_epi8(breaker));
+}
+
+static bool IsPrintableAsciiBlock(const char* p) {
+    // signed compares, so bytes with the top bit set fail the first one
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1f)),
+                                            _mm_cmplt_epi8(v, _mm_set1_epi8(0x7f)));
+    return _mm_movemask_epi8(printable) == 0xffff;
+}
+#endif
+
+static size_t FindBreaker(std::span<const char> data, size_t offset, bool shiftJis) {
+#ifdef TEXT_SCAN_SSE2
+    while (data.size() - offset >= 16) {
+        const uint32_t mask = BreakerMask(data.data() + offset, shiftJis);
+        if (mask != 0) {
+            return offset + static_cast<size_t>(std::countr_zero(mask));
+        }
+        offset += 16;
+    }
+#endif
+    while (offset < data.size() && !IsBreaker(static_cast<uint8_t>(data[offset]), shiftJis)) {
+        ++offset;
+    }
+    return offset;
+}
+
+namespace {
+struct RunBuilder {
+    const TextScanOptions& Options;
+    std::vector<TextRun>& Runs;
+    size_t Start = 0;
+    size_t Characters = 0;
+    bool HasDoubleByte = false;
+
+    void Finish(size_t end) {
+        if (Characters >= Options.MinCharacters
+            && (HasDoubleByte || !Options.ShiftJis || Options.IncludeSingleByteOnly)) {
+            Runs.push_back(TextRun{Start, end - Start});
+        }
+    }
+
+    void Restart(size_t start) {
+        Start = start;
+        Characters = 0;
+        HasDoubleByte = false;
+    }
+};
+} // namespace
+
+// Splits a stretch without breakers into runs of valid characters.
+static void ScanSegment(std::span<const char> data,
+                        size_t begin,
+                        size_t end,
+                        const TextScanOptions& options,
+                        std::vector<TextRun>& runs) {
+    RunBuilder run{options, runs, begin};
+    size_t i = begin;
+    while (i < end) {
+#ifdef TEXT_SCAN_SSE2
+        if (end - i >= 16 && IsPrintableAsciiBlock(data.data() + i)) {
+            i += 16;
+            run.Characters += 16;
+            continue;
+        }
+#endif
+        const uint8_t c = static_cast<uint8_t>(data[i]);
+        if (IsSingleByteText(c, options.ShiftJis)) {
+            ++i;
+            ++run.Characters;
+            continue;
+        }
+        if (options.ShiftJis && end - i >= 2
+            && IsShiftJisPair(c, static_cast<uint8_t>(data[i + 1]))) {
+            i += 2;
+            ++run.Characters;
+            run.HasDoubleByte = true;
+            continue;
+        }
+
+        // the next byte may still start a character, so only this one is dropped
+        run.Finish(i);
+        ++i;
+        run.Restart(i);
+    }
+    run.Finish(end);
+}
+
+std::vector<TextRun> find_text_runs(std::span<const char> data, const TextScanOptions& options) {
+    std::vector<TextRun> runs;
+    const size_t minCharacters = std::max(size_t(1), options.MinCharacters);
+    size_t offset = 0;
+    while (offset < data.size()) {
+        const size_t end = FindBreaker(data, offset, options.ShiftJis);
+
+        // every character takes at least one byte
+        if (end - offset >= minCharacters) {
+            ScanSegment(data, offset, end, options, runs);
+        }
+        offset = end + 1;
+    }
+    return runs;
+}
+
+// Converts all runs to UTF-8 with a single call by joining them with null bytes, which no run
+// contains. Runs that fail to convert come back empty.
+static std::vector<std::string> ConvertRuns(std::span<const char> data,
+                                            const std::vector<TextRun>& runs,
+                                            bool shiftJis) {
+    std::vector<std::string> result;
+    result.reserve(runs.size());
+    if (!shiftJis) {
+        for (const auto& run : runs) {
+            result.emplace_back(data.data() + run.Offset, run.Length);
+        }
+        return result;
+    }
+
+    std::string joined;
+    for (const auto& run : runs) {
+        joined.append(data.data() + run.Offset, run.Length);
+        joined.push_back('\0');
+    }
+    const auto converted = HyoutaUtils::TextUtils::ShiftJisToUtf8(joined.data(), joined.size());
+    if (converted) {
+        std::string_view rest(*converted);
+        while (!rest.empty() && result.size() < runs.size()) {
+            const size_t end = rest.find('\0');
+            result.emplace_back(rest.substr(0, end));
+            rest.remove_prefix(end == std::string_view::npos ? rest.size() : end + 1);
+        }
+        if (result.size() == runs.size()) {
+            return result;
+        }
+    }
+
+    // the converter disagrees with our idea of valid text somewhere, so find out which run it is
+    result.clear();
+    for (const auto& run : runs) {
+        auto text = HyoutaUtils::TextUtils::ShiftJisToUtf8(data.data() + run.Offset, run.Length);
+        result.emplace_back(text ? std::move(*text) : std::string());
+    }
+    return result;
+}
+
+// Keeps every string on a single line.
+static void AppendEscaped(std::string& output, std::string_view text) {
+    for (const char c : text) {
+        if (c == '\n') {
+            output += "\\n";
+        } else if (c == '\r') {
+            output += "\\r";
+        } else if (c == '\t') {
+            output += "\\t";
+        } else if (c == '\\') {
+            output += "\\\\";
+        } else {
+            output += c;
+        }
+    }
+}
+
+namespace {
+struct StringsFile {
+    std::filesystem::path Path;
+    bool Success = false;
+    std::string Error;
+    std::string Output;
+};
+} // namespace
+
+// Loads the file and, unless 'raw' is set, decompresses it. Returns the data to search, which
+// lives in 'view' or 'buffer'.
+static std::optional<std::span<const char>> LoadData(StringsFile& file,
+                                                     bool raw,
+                                                     HyoutaUtils::IO::FileView& view,
+                                                     std::vector<char>& buffer) {
+    HyoutaUtils::IO::File infile(file.Path, HyoutaUtils::IO::OpenMode::Read);
+    if (!infile.IsOpen()) {
+        file.Error = "failed to open file";
+        return std::nullopt;
+    }
+    std::vector<char> contents;
+    std::span<const char> image;
+    if (auto mapped = infile.Map(HyoutaUtils::IO::AccessHint::Sequential)) {
+        view = std::move(*mapped);
+        image = std::span<const char>(view.Data(), view.Size());
+    } else {
+        const auto length = infile.GetLength();
+        if (!length) {
+            file.Error = "failed to read file";
+            return std::nullopt;
+        }
+        contents.resize(*length);
+        if (infile.Read(contents.data(), contents.size()) != contents.size()) {
+            file.Error = "failed to read file";
+            return std::nullopt;
+        }
+        image = contents;
+    }
+    if (raw) {
+        if (!contents.empty()) {
+            buffer = std::move(contents);
+            return std::span<const char>(buffer);
+        }
+        return image;
+    }
+
+    std::error_code ec;
+    const auto header = TopDec::parse_file_image_header(image, ec);
+    if (!header) {
+        file.Error = ec.message();
+        return std::nullopt;
+    }
+    buffer.resize(header->UncompressedLength);
+    TopDec::decode_file_image_exact(image, std::span<char>(buffer), ec);
+
+    // a stream of the wrong length still has text worth looking at
+    if (ec && ec != TopDec::Error::LengthMismatch) {
+        file.Error = ec.message();
+        return std::nullopt;
+    }
+    return std::span<const char>(buffer);
+}
+
+static void ProcessFile(StringsFile& file,
+                        const TextScanOptions& options,
+                        bool raw,
+                        bool printOffsets) {
+    HyoutaUtils::IO::FileView view;
+    std::vector<char> buffer;
+    const auto data = LoadData(file, raw, view, buffer);
+    if (!data) {
+        return;
+    }
+
+    const auto runs = find_text_runs(*data, options);
+    const auto texts = ConvertRuns(*data, runs, options.ShiftJis);
+    const std::string path = file.Path.string();
+    for (size_t i = 0; i < runs.size(); ++i) {
+        if (texts[i].empty()) {
+            continue;
+        }
+        file.Output += path;
+        if (printOffsets) {
+            std::array<char, 32> offset;
+            snprintf(offset.data(), offset.size(), ":0x%08zx", runs[i].Offset);
+            file.Output += offset.data();
+        }
+        file.Output += ": ";
+        AppendEscaped(file.Output, texts[i]);
+        file.Output += '\n';
+    }
+    file.Success = true;
+}
+
+static void PrintStringsUsage() {
+    printf(
+        "Usage for finding text:\n"
+        "  topdec strings [options] (path to compressed file or directory)...\n"
+        "  Decompresses the files in memory and prints every run of printable text in them as\n"
+        "  'path: text', with line breaks and tabs escaped. Directories are searched recursively.\n"
+        "  Options are:\n"
+        "    --sjis (look for Shift-JIS text and print it as UTF-8, instead of ASCII)\n"
+        "    --min-length N (ignore runs of fewer characters, defaults to 4)\n"
+        "    --single-byte (with --sjis, also print runs without any double-byte characters)\n"
+        "    --offsets (print the offset of each run in the decompressed data)\n"
+        "    --raw (search the files as they are instead of decompressing them)\n"
+        "    --threads N (defaults to the number of hardware threads)\n");
+}
+
+int StringsMain(int argc, char** argv) {
+    TextScanOptions options;
+    bool raw = false;
+    bool printOffsets = false;
+    size_t threads = 0;
+    int idx = 2;
+    while (idx < argc) {
+        const bool hasValue = idx + 1 < argc;
+        if (strcmp("--sjis", argv[idx]) == 0) {
+            options.ShiftJis = true;
+            ++idx;
+            continue;
+        }
+        if (strcmp("--min-length", argv[idx]) == 0 && hasValue) {
+            options.MinCharacters =
+                std::max(size_t(1), size_t(strtoul(argv[idx + 1], nullptr, 10)));
+            idx += 2;
+            continue;
+        }
+        if (strcmp("--single-byte", argv[idx]) == 0) {
+            options.IncludeSingleByteOnly = true;
+            ++idx;
+            continue;
+        }
+        if (strcmp("--offsets", argv[idx]) == 0) {
+            printOffsets = true;
+            ++idx;
+            continue;
+        }
+        if (strcmp("--raw", argv[idx]) == 0) {
+            raw = true;
+            ++idx;
+            continue;
+        }
+        if (strcmp("--threads", argv[idx]) == 0 && hasValue) {
+            threads = std::max(size_t(1), size_t(strtoul(argv[idx + 1], nullptr, 10)));
+            idx += 2;
+            continue;
+        }
+
+        break;
+    }
+    if (idx >= argc) {
+        PrintStringsUsage();
+        return -1;
+    }
+
+    std::vector<StringsFile> files;
+    for (; idx < argc; ++idx) {
+        std::filesystem::path path(argv[idx]);
+        std::error_code ec;
+        if (std::filesystem::is_directory(path, ec)) {
+            std::vector<std::filesystem::path> paths;
+            std::vector<std::filesystem::path> unreadable;
+            list_files_recursive(path, paths, unreadable);
+            std::sort(paths.begin(), paths.end());
+            for (auto& p : paths) {
+                files.emplace_back().Path = std::move(p);
+            }
+            for (auto& p : unreadable) {
+                StringsFile& file = files.emplace_back();
+                file.Path = std::move(p);
+                file.Error = "failed to read directory";
+            }
+        } else {
+            files.emplace_back().Path = std::move(path);
+        }
+    }
+
+    ThreadPool pool(threads);
+    pool.ParallelFor(files.size(), [&](size_t i) {
+        if (files[i].Error.empty()) {
+            ProcessFile(files[i], options, raw, printOffsets);
+        }
+    });
+
+    size_t failed = 0;
+    for (const auto& file : files) {
+        if (file.Success) {
+            fwrite(file.Output.data(), 1, file.Output.size(), stdout);
+        } else {
+            printf("%s: %s\n", file.Path.string().c_str(), file.Error.c_str());
+            ++failed;
+        }
+    }
+    return failed == 0 ? 0 : -1;
+}
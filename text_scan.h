@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct TextScanOptions {
+    // Look for Shift-JIS (CP932) text instead of plain ASCII.
+    bool ShiftJis = false;
+
+    // ignore runs with fewer characters than this
+    size_t MinCharacters = 4;
+
+    // With ShiftJis, also report runs without a single double-byte character. Those are mostly
+    // ASCII and half-width katakana, which plenty of binary data looks like.
+    bool IncludeSingleByteOnly = false;
+};
+
+struct TextRun {
+    size_t Offset = 0;
+    size_t Length = 0;
+};
+
+// Finds maximal runs of printable text in 'data', in order. ASCII text is printable characters,
+// tabs and line breaks. Shift-JIS text adds half-width katakana and every assigned double-byte
+// character of CP932, except for the user-defined private use area. Bytes that can't be part of
+// any text are found 16 at a time with SSE2 where available, so only the stretches between them
+// are checked character by character.
+std::vector<TextRun> find_text_runs(std::span<const char> data, const TextScanOptions& options);
+
+int StringsMain(int argc, char** argv);
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+
+// Helpers shared by the converters in text.cpp and text_cp932.cpp.
+namespace HyoutaUtils::TextUtils::Unicode {
+inline bool IsAsciiWord(const uint8_t* data) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    return (word & 0x8080808080808080ull) == 0;
+}
+
+// A decoded character and the number of code units it took; 0 units for invalid input. Returned
+// by value rather than advancing an input pointer passed by reference, so the caller's loop can
+// keep that pointer in a register.
+struct DecodedCharacter {
+    char32_t Value;
+    size_t Length;
+};
+
+// Overlong forms, surrogates and anything past U+10FFFF are invalid.
+inline DecodedCharacter DecodeUtf8(const uint8_t* in, const uint8_t* end) {
+    const uint8_t c = *in;
+    size_t length;
+    char32_t result;
+    char32_t minimum;
+    if (c < 0x80) {
+        return DecodedCharacter{c, 1};
+    } else if ((c & 0xe0) == 0xc0) {
+        length = 2;
+        result = c & 0x1f;
+        minimum = 0x80;
+    } else if ((c & 0xf0) == 0xe0) {
+        length = 3;
+        result = c & 0x0f;
+        minimum = 0x800;
+    } else if ((c & 0xf8) == 0xf0) {
+        length = 4;
+        result = c & 0x07;
+        minimum = 0x10000;
+    } else {
+        return DecodedCharacter{0, 0};
+    }
+    if (static_cast<size_t>(end - in) < length) {
+        return DecodedCharacter{0, 0};
+    }
+    for (size_t i = 1; i < length; ++i) {
+        if ((in[i] & 0xc0) != 0x80) {
+            return DecodedCharacter{0, 0};
+        }
+        result = (result << 6) | (in[i] & 0x3f);
+    }
+    if (result < minimum || result > 0x10ffff || (result >= 0xd800 && result <= 0xdfff)) {
+        return DecodedCharacter{0, 0};
+    }
+    return DecodedCharacter{result, length};
+}
+
+inline size_t Utf8Length(char32_t c) {
+    return c < 0x80 ? 1 : (c < 0x800 ? 2 : (c < 0x10000 ? 3 : 4));
+}
+
+inline void EncodeUtf8(char* out, char32_t c, size_t length) {
+    if (length == 1) {
+        out[0] = static_cast<char>(c);
+    } else if (length == 2) {
+        out[0] = static_cast<char>(0xc0 | (c >> 6));
+        out[1] = static_cast<char>(0x80 | (c & 0x3f));
+    } else if (length == 3) {
+        out[0] = static_cast<char>(0xe0 | (c >> 12));
+        out[1] = static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+        out[2] = static_cast<char>(0x80 | (c & 0x3f));
+    } else {
+        out[0] = static_cast<char>(0xf0 | (c >> 18));
+        out[1] = static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+        out[2] = static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+        out[3] = static_cast<char>(0x80 | (c & 0x3f));
+    }
+}
+
+// The converters run in two modes: with 'Write' set they fill their output and fail if it runs
+// out of space, without it they only count. Their state is kept in locals rather than an output
+// object, so the compiler can keep it in registers across the character-typed stores.
+template<bool Write>
+bool Reserve(size_t length, size_t capacity, size_t count) {
+    return !Write || capacity - length >= count;
+}
+
+// The allocating variants convert into a buffer of the largest possible size and trim it, so the
+// conversion never has to be redone. 'maxRatio' is the most output code units a single input code
+// unit can turn into.
+template<typename String, typename Input, typename Func>
+std::optional<String> ConvertAllocating(Input input, size_t maxRatio, const Func& convert) {
+    String result;
+    result.resize(input.size() * maxRatio);
+    const auto length = convert(input, std::span<typename String::value_type>(result));
+    if (!length) {
+        return std::nullopt;
+    }
+    result.resize(*length);
+    return result;
+}
+} // namespace HyoutaUtils::TextUtils::Unicode
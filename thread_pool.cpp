@@ -0,0 +1,155 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace {
+// The pool and queue of the worker running on the current thread, if any.
+thread_local const ThreadPool* CurrentPool = nullptr;
+thread_local size_t CurrentQueue = 0;
+} // namespace
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(size_t(1), size_t(std::thread::hardware_concurrency()));
+    }
+    Queues.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        Queues.emplace_back(std::make_unique<WorkerQueue>());
+    }
+    Threads.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        Threads.emplace_back([this, i]() { WorkerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(Mutex);
+        ShuttingDown = true;
+    }
+    JobAvailable.notify_all();
+    for (auto& t : Threads) {
+        t.join();
+    }
+}
+
+size_t ThreadPool::GetThreadCount() const noexcept {
+    return Threads.size();
+}
+
+void ThreadPool::Submit(std::function<void()> job) {
+    // keep jobs spawned by a job on the same worker, their data is likely still in its cache
+    const size_t index =
+        CurrentPool == this ? CurrentQueue : NextQueue.fetch_add(1) % Queues.size();
+    {
+        WorkerQueue& queue = *Queues[index];
+        std::lock_guard lock(queue.Mutex);
+        queue.Jobs.push_back(std::move(job));
+    }
+    {
+        std::lock_guard lock(Mutex);
+        Pending.fetch_add(1);
+    }
+    JobAvailable.notify_one();
+}
+
+bool ThreadPool::TryPop(size_t index, std::function<void()>& job) {
+    const size_t count = Queues.size();
+    for (size_t i = 0; i < count; ++i) {
+        WorkerQueue& queue = *Queues[(index + i) % count];
+        std::lock_guard lock(queue.Mutex);
+        if (!queue.Jobs.empty()) {
+            job = std::move(queue.Jobs.front());
+            queue.Jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::WorkerLoop(size_t index) {
+    CurrentPool = this;
+    CurrentQueue = index;
+    while (true) {
+        std::function<void()> job;
+        if (TryPop(index, job)) {
+            Pending.fetch_sub(1);
+            job();
+            continue;
+        }
+
+        // Pending can briefly drop below zero when a job is taken before its Submit() has counted
+        // it, so only a positive value means there is something left to take.
+        std::unique_lock lock(Mutex);
+        JobAvailable.wait(lock, [this]() { return ShuttingDown || Pending.load() > 0; });
+        if (Pending.load() <= 0) {
+            return;
+        }
+    }
+}
+
+namespace {
+struct ParallelForState {
+    std::atomic<size_t> Next = 0;
+    size_t Completed = 0;
+    std::mutex Mutex;
+    std::condition_variable Done;
+};
+} // namespace
+
+void ThreadPool::ParallelFor(size_t count,
+                             const std::function<void(size_t)>& func,
+                             size_t maxParallelism) {
+    if (count == 0) {
+        return;
+    }
+
+    size_t helpers = std::min(Threads.size(), count - 1);
+    if (maxParallelism != 0) {
+        helpers = std::min(helpers, maxParallelism - 1);
+    }
+
+    // Completion is tracked per index rather than per helper: a helper that only gets scheduled
+    // after the range has been drained (or never, because every worker is busy with the job that
+    // called us) finds nothing left to do and never touches 'func'.
+    auto state = std::make_shared<ParallelForState>();
+    const auto drain = [state, count, &func]() -> void {
+        while (true) {
+            const size_t i = state->Next.fetch_add(1);
+            if (i >= count) {
+                return;
+            }
+            func(i);
+            std::lock_guard lock(state->Mutex);
+            if (++state->Completed == count) {
+                state->Done.notify_all();
+            }
+        }
+    };
+
+    // A helper that can't be queued only costs parallelism, as the calling thread drains whatever
+    // is left. Leaving early instead would return while queued helpers still refer to 'func'.
+    for (size_t i = 0; i < helpers; ++i) {
+        try {
+            Submit(drain);
+        } catch (...) {
+            break;
+        }
+    }
+    drain();
+
+    std::unique_lock lock(state->Mutex);
+    state->Done.wait(lock, [&]() { return state->Completed == count; });
+}
+
+ThreadPool& GetSharedThreadPool() {
+    static ThreadPool pool;
+    return pool;
+}
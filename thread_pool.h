@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads that is kept alive between calls, so that callers submitting
+// many small jobs don't pay for thread creation every time.
+//
+// Every worker has its own job queue. Jobs submitted from inside a job go to the submitting
+// worker's queue, jobs from other threads are spread over the queues round-robin, and a worker
+// whose queue runs dry steals from the others. Each queue is run in submission order, so callers
+// that submit their most expensive jobs first get them started first.
+struct ThreadPool {
+public:
+    // A thread count of 0 uses the number of hardware threads.
+    explicit ThreadPool(size_t threadCount = 0);
+    ThreadPool(const ThreadPool& other) = delete;
+    ThreadPool(ThreadPool&& other) = delete;
+    ThreadPool& operator=(const ThreadPool& other) = delete;
+    ThreadPool& operator=(ThreadPool&& other) = delete;
+    ~ThreadPool();
+
+    size_t GetThreadCount() const noexcept;
+
+    // Queues a job to be run on one of the worker threads.
+    void Submit(std::function<void()> job);
+
+    // Calls 'func' for every index in [0, count) and returns once all calls have finished. The
+    // calling thread takes part in the work, so this is safe to call from inside a job. At most
+    // 'maxParallelism' threads (including the calling one) work on the range; 0 means no limit.
+    // 'func' must not throw.
+    void ParallelFor(size_t count,
+                     const std::function<void(size_t)>& func,
+                     size_t maxParallelism = 0);
+
+private:
+    struct WorkerQueue {
+        std::mutex Mutex;
+        std::deque<std::function<void()>> Jobs;
+    };
+
+    void WorkerLoop(size_t index);
+    bool TryPop(size_t index, std::function<void()>& job);
+
+    std::vector<std::unique_ptr<WorkerQueue>> Queues;
+    std::atomic<size_t> NextQueue = 0;
+
+    // Pending is only ever incremented with Mutex held, so a worker that checks it under Mutex
+    // before going to sleep can't miss a job.
+    std::mutex Mutex;
+    std::condition_variable JobAvailable;
+    std::atomic<ptrdiff_t> Pending = 0;
+    bool ShuttingDown = false;
+
+    std::vector<std::thread> Threads;
+};
+
+// Process-wide pool with one thread per hardware thread, created on first use. Shared by the
+// library's batch functions so that repeated batches reuse the same threads.
+ThreadPool& GetSharedThreadPool();
@@ -0,0 +1,405 @@
+#include "topdec.h"
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <optional>
+#include <span>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "compress.h"
+#include "decompress.h"
+#include "header.h"
+#include "thread_pool.h"
+
+namespace TopDec {
+namespace {
+struct ErrorCategory : std::error_category {
+    const char* name() const noexcept override {
+        return "topdec";
+    }
+
+    std::string message(int value) const override {
+        return topdec_status_string(value);
+    }
+};
+} // namespace
+
+const std::error_category& error_category() noexcept {
+    static const ErrorCategory category;
+    return category;
+}
+
+std::error_code make_error_code(Error e) noexcept {
+    return std::error_code(static_cast<int>(e), error_category());
+}
+
+size_t decompress_bound(size_t uncompressedLength) noexcept {
+    return uncompressedLength + decompress_reserve_extra_bytes();
+}
+
+size_t compress_bound(size_t uncompressedLength) noexcept {
+    return compress_81_83_bound(uncompressedLength);
+}
+
+size_t encode_file_image_bound(size_t uncompressedLength) noexcept {
+    return compressed_header_size + compress_bound(uncompressedLength);
+}
+
+static size_t DecompressChecked(uint8_t type,
+                                std::span<const char> compressed,
+                                std::span<char> uncompressed,
+                                size_t uncompressedLength,
+                                bool exact,
+                                std::error_code& ec) noexcept {
+    ec.clear();
+    if (type == 0x00) {
+        if (compressed.size() != uncompressedLength) {
+            ec = Error::CorruptData;
+            return 0;
+        }
+        if (uncompressed.size() < uncompressedLength) {
+            ec = Error::OutputTooSmall;
+            return 0;
+        }
+        if (uncompressedLength > 0) {
+            std::memcpy(uncompressed.data(), compressed.data(), uncompressedLength);
+        }
+        return uncompressedLength;
+    }
+
+    if (uncompressed.size() < (exact ? uncompressedLength : decompress_bound(uncompressedLength))) {
+        ec = Error::OutputTooSmall;
+        return 0;
+    }
+    const auto decoder = exact ? decompress_exact_type : decompress_type;
+    const int64_t result = decoder(
+        type, compressed.data(), compressed.size(), uncompressed.data(), uncompressedLength);
+    if (result == -2) {
+        ec = Error::UnsupportedType;
+        return 0;
+    }
+    if (result < 0) {
+        ec = Error::CorruptData;
+        return 0;
+    }
+    if (static_cast<size_t>(result) != uncompressedLength) {
+        ec = Error::LengthMismatch;
+    }
+    return static_cast<size_t>(result);
+}
+
+size_t decompress(uint8_t type,
+                  std::span<const char> compressed,
+                  std::span<char> uncompressed,
+                  size_t uncompressedLength,
+                  std::error_code& ec) noexcept {
+    return DecompressChecked(type, compressed, uncompressed, uncompressedLength, false, ec);
+}
+
+size_t decompress_exact(uint8_t type,
+                        std::span<const char> compressed,
+                        std::span<char> uncompressed,
+                        size_t uncompressedLength,
+                        std::error_code& ec) noexcept {
+    return DecompressChecked(type, compressed, uncompressed, uncompressedLength, true, ec);
+}
+
+size_t decompress_01(std::span<const char> compressed,
+                     std::span<char> uncompressed,
+                     size_t uncompressedLength,
+                     std::error_code& ec) noexcept {
+    return decompress(0x01, compressed, uncompressed, uncompressedLength, ec);
+}
+
+size_t decompress_03(std::span<const char> compressed,
+                     std::span<char> uncompressed,
+                     size_t uncompressedLength,
+                     std::error_code& ec) noexcept {
+    return decompress(0x03, compressed, uncompressed, uncompressedLength, ec);
+}
+
+size_t decompress_81(std::span<const char> compressed,
+                     std::span<char> uncompressed,
+                     size_t uncompressedLength,
+                     std::error_code& ec) noexcept {
+    return decompress(0x81, compressed, uncompressed, uncompressedLength, ec);
+}
+
+size_t decompress_83(std::span<const char> compressed,
+                     std::span<char> uncompressed,
+                     size_t uncompressedLength,
+                     std::error_code& ec) noexcept {
+    return decompress(0x83, compressed, uncompressed, uncompressedLength, ec);
+}
+
+size_t compress(uint8_t type,
+                std::span<const char> uncompressed,
+                std::span<char> compressed,
+                int level,
+                std::error_code& ec) noexcept {
+    ec.clear();
+    if (level < compress_min_level || level > compress_max_level) {
+        ec = Error::InvalidArgument;
+        return 0;
+    }
+    if (type == 0x00) {
+        if (compressed.size() < uncompressed.size()) {
+            ec = Error::OutputTooSmall;
+            return 0;
+        }
+        if (!uncompressed.empty()) {
+            std::memcpy(compressed.data(), uncompressed.data(), uncompressed.size());
+        }
+        return uncompressed.size();
+    }
+
+    // the encoder doesn't check the output size, so it needs room for the worst case up front
+    if (compressed.size() < compress_bound(uncompressed.size())) {
+        ec = Error::OutputTooSmall;
+        return 0;
+    }
+    switch (type) {
+        case 0x01:
+            return ::compress_01(
+                uncompressed.data(), uncompressed.size(), compressed.data(), level);
+        case 0x03:
+            return ::compress_03(
+                uncompressed.data(), uncompressed.size(), compressed.data(), level);
+        case 0x81:
+            return ::compress_81(
+                uncompressed.data(), uncompressed.size(), compressed.data(), level);
+        case 0x83:
+            return ::compress_83(
+                uncompressed.data(), uncompressed.size(), compressed.data(), level);
+        default: ec = Error::UnsupportedType; return 0;
+    }
+}
+
+size_t compress_01(std::span<const char> uncompressed,
+                   std::span<char> compressed,
+                   int level,
+                   std::error_code& ec) noexcept {
+    return compress(0x01, uncompressed, compressed, level, ec);
+}
+
+size_t compress_03(std::span<const char> uncompressed,
+                   std::span<char> compressed,
+                   int level,
+                   std::error_code& ec) noexcept {
+    return compress(0x03, uncompressed, compressed, level, ec);
+}
+
+size_t compress_81(std::span<const char> uncompressed,
+                   std::span<char> compressed,
+                   int level,
+                   std::error_code& ec) noexcept {
+    return compress(0x81, uncompressed, compressed, level, ec);
+}
+
+size_t compress_83(std::span<const char> uncompressed,
+                   std::span<char> compressed,
+                   int level,
+                   std::error_code& ec) noexcept {
+    return compress(0x83, uncompressed, compressed, level, ec);
+}
+
+std::optional<CompressedHeader> parse_file_image_header(std::span<const char> file,
+                                                        std::error_code& ec) noexcept {
+    ec.clear();
+    const auto header = parse_compressed_header(file.data(), file.size());
+    if (!header) {
+        ec = Error::TruncatedHeader;
+        return std::nullopt;
+    }
+    if (file.size() - compressed_header_size < header->CompressedLength) {
+        ec = Error::TruncatedData;
+        return std::nullopt;
+    }
+    return header;
+}
+
+size_t decode_file_image_bound(std::span<const char> file, std::error_code& ec) noexcept {
+    const auto header = parse_file_image_header(file, ec);
+    if (!header) {
+        return 0;
+    }
+    return decompress_bound(header->UncompressedLength);
+}
+
+size_t decode_file_image(std::span<const char> file,
+                         std::span<char> output,
+                         std::error_code& ec) noexcept {
+    const auto header = parse_file_image_header(file, ec);
+    if (!header) {
+        return 0;
+    }
+    return decompress(header->Type,
+                      file.subspan(compressed_header_size, header->CompressedLength),
+                      output,
+                      header->UncompressedLength,
+                      ec);
+}
+
+size_t decode_file_image_exact(std::span<const char> file,
+                               std::span<char> output,
+                               std::error_code& ec) noexcept {
+    const auto header = parse_file_image_header(file, ec);
+    if (!header) {
+        return 0;
+    }
+    return decompress_exact(header->Type,
+                            file.subspan(compressed_header_size, header->CompressedLength),
+                            output,
+                            header->UncompressedLength,
+                            ec);
+}
+
+void decode_file_image(std::span<const char> file,
+                       std::vector<char>& output,
+                       std::error_code& ec) {
+    const size_t bound = decode_file_image_bound(file, ec);
+    if (ec) {
+        output.clear();
+        return;
+    }
+    output.resize(bound);
+    const size_t length = decode_file_image(file, std::span<char>(output), ec);
+    output.resize(length);
+}
+
+size_t encode_file_image(uint8_t type,
+                         std::span<const char> uncompressed,
+                         std::span<char> output,
+                         int level,
+                         std::error_code& ec) noexcept {
+    ec.clear();
+    if (uncompressed.size() > std::numeric_limits<uint32_t>::max()) {
+        ec = Error::InputTooLarge;
+        return 0;
+    }
+    if (output.size() < compressed_header_size) {
+        ec = Error::OutputTooSmall;
+        return 0;
+    }
+    const size_t length =
+        compress(type, uncompressed, output.subspan(compressed_header_size), level, ec);
+    if (ec) {
+        return 0;
+    }
+    if (length > std::numeric_limits<uint32_t>::max()) {
+        ec = Error::InputTooLarge;
+        return 0;
+    }
+    write_compressed_header(output.data(),
+                            CompressedHeader{type,
+                                             static_cast<uint32_t>(length),
+                                             static_cast<uint32_t>(uncompressed.size())});
+    return compressed_header_size + length;
+}
+
+void encode_file_image(uint8_t type,
+                       std::span<const char> uncompressed,
+                       std::vector<char>& output,
+                       int level,
+                       std::error_code& ec) {
+    output.resize(encode_file_image_bound(uncompressed.size()));
+    const size_t length = encode_file_image(type, uncompressed, std::span<char>(output), level, ec);
+    output.resize(length);
+}
+
+// Jobs run on pool threads, so an allocation failure must not escape as an exception.
+template<typename Func>
+static void RunBatchItem(BatchItem& item, const Func& func) {
+    try {
+        func(item);
+    } catch (const std::bad_alloc&) {
+        item.Output.clear();
+        item.Error = Error::OutOfMemory;
+    }
+}
+
+void decode_file_images(std::span<BatchItem> items, size_t maxThreads) {
+    GetSharedThreadPool().ParallelFor(
+        items.size(),
+        [&](size_t i) {
+            RunBatchItem(items[i], [](BatchItem& item) {
+                decode_file_image(item.Input, item.Output, item.Error);
+            });
+        },
+        maxThreads);
+}
+
+size_t decode_file_images_contiguous_size(std::span<const std::span<const char>> files,
+                                          std::error_code& ec) noexcept {
+    ec.clear();
+    size_t total = 0;
+    for (const auto& file : files) {
+        const auto header = parse_file_image_header(file, ec);
+        if (!header) {
+            return 0;
+        }
+        total += header->UncompressedLength;
+    }
+    return total;
+}
+
+void decode_file_images_contiguous(std::span<const std::span<const char>> files,
+                                   std::span<char> output,
+                                   std::span<size_t> offsets,
+                                   std::error_code& ec,
+                                   size_t maxThreads) {
+    ec.clear();
+    if (offsets.size() <= files.size()) {
+        ec = Error::InvalidArgument;
+        return;
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        const auto header = parse_file_image_header(files[i], ec);
+        if (!header) {
+            return;
+        }
+        offsets[i] = offset;
+        offset += header->UncompressedLength;
+    }
+    offsets[files.size()] = offset;
+    if (output.size() < offset) {
+        ec = Error::OutputTooSmall;
+        return;
+    }
+
+    std::vector<std::error_code> errors(files.size());
+    GetSharedThreadPool().ParallelFor(
+        files.size(),
+        [&](size_t i) {
+            const size_t length = offsets[i + 1] - offsets[i];
+            const size_t decoded = decode_file_image_exact(
+                files[i], output.subspan(offsets[i], length), errors[i]);
+            if (!errors[i] && decoded != length) {
+                errors[i] = Error::LengthMismatch;
+            }
+        },
+        maxThreads);
+    for (const auto& error : errors) {
+        if (error) {
+            ec = error;
+            return;
+        }
+    }
+}
+
+void encode_file_images(uint8_t type, std::span<BatchItem> items, int level, size_t maxThreads) {
+    GetSharedThreadPool().ParallelFor(
+        items.size(),
+        [&](size_t i) {
+            RunBatchItem(items[i], [&](BatchItem& item) {
+                encode_file_image(type, item.Input, item.Output, level, item.Error);
+            });
+        },
+        maxThreads);
+}
+} // namespace TopDec
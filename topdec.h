@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include "compress.h"
+#include "header.h"
+#include "topdec_c.h"
+
+// C++ interface of libtopdec. Unlike the raw functions in compress.h and decompress.h, these
+// check buffer sizes and report failures as std::error_code instead of magic return values.
+// Functions that return a size return 0 on failure unless documented otherwise.
+namespace TopDec {
+enum class Error : int {
+    Success = TOPDEC_OK,
+    InvalidArgument = TOPDEC_ERROR_INVALID_ARGUMENT,
+    TruncatedHeader = TOPDEC_ERROR_TRUNCATED_HEADER,
+    TruncatedData = TOPDEC_ERROR_TRUNCATED_DATA,
+    UnsupportedType = TOPDEC_ERROR_UNSUPPORTED_TYPE,
+    CorruptData = TOPDEC_ERROR_CORRUPT_DATA,
+    LengthMismatch = TOPDEC_ERROR_LENGTH_MISMATCH,
+    OutputTooSmall = TOPDEC_ERROR_OUTPUT_TOO_SMALL,
+    InputTooLarge = TOPDEC_ERROR_INPUT_TOO_LARGE,
+    IoFailure = TOPDEC_ERROR_IO_FAILURE,
+    OutOfMemory = TOPDEC_ERROR_OUT_OF_MEMORY,
+};
+
+TOPDEC_API const std::error_category& error_category() noexcept;
+TOPDEC_API std::error_code make_error_code(Error e) noexcept;
+} // namespace TopDec
+
+namespace std {
+template<>
+struct is_error_code_enum<TopDec::Error> : true_type {};
+} // namespace std
+
+namespace TopDec {
+TOPDEC_API size_t decompress_bound(size_t uncompressedLength) noexcept;
+TOPDEC_API size_t compress_bound(size_t uncompressedLength) noexcept;
+TOPDEC_API size_t encode_file_image_bound(size_t uncompressedLength) noexcept;
+
+// Raw streams without a file header. 'uncompressed' must be at least
+// decompress_bound(uncompressedLength) bytes. If the stream decodes to a different length than
+// expected, the error is LengthMismatch and the return value is the actual length.
+TOPDEC_API size_t decompress(uint8_t type,
+                             std::span<const char> compressed,
+                             std::span<char> uncompressed,
+                             size_t uncompressedLength,
+                             std::error_code& ec) noexcept;
+
+// Like decompress(), but never writes past 'uncompressedLength', so 'uncompressed' only needs to be
+// that large. That allows decoding straight into memory that can't take any slack, such as a
+// mapped output file of the final size. A stream that decodes to more data is cut off; it is
+// reported as LengthMismatch with the length it would have decoded to.
+TOPDEC_API size_t decompress_exact(uint8_t type,
+                                   std::span<const char> compressed,
+                                   std::span<char> uncompressed,
+                                   size_t uncompressedLength,
+                                   std::error_code& ec) noexcept;
+
+TOPDEC_API size_t decompress_01(std::span<const char> compressed,
+                                std::span<char> uncompressed,
+                                size_t uncompressedLength,
+                                std::error_code& ec) noexcept;
+TOPDEC_API size_t decompress_03(std::span<const char> compressed,
+                                std::span<char> uncompressed,
+                                size_t uncompressedLength,
+                                std::error_code& ec) noexcept;
+TOPDEC_API size_t decompress_81(std::span<const char> compressed,
+                                std::span<char> uncompressed,
+                                size_t uncompressedLength,
+                                std::error_code& ec) noexcept;
+TOPDEC_API size_t decompress_83(std::span<const char> compressed,
+                                std::span<char> uncompressed,
+                                size_t uncompressedLength,
+                                std::error_code& ec) noexcept;
+
+// 'compressed' must be at least compress_bound(uncompressed.size()) bytes.
+TOPDEC_API size_t compress(uint8_t type,
+                           std::span<const char> uncompressed,
+                           std::span<char> compressed,
+                           int level,
+                           std::error_code& ec) noexcept;
+TOPDEC_API size_t compress_01(std::span<const char> uncompressed,
+                              std::span<char> compressed,
+                              int level,
+                              std::error_code& ec) noexcept;
+TOPDEC_API size_t compress_03(std::span<const char> uncompressed,
+                              std::span<char> compressed,
+                              int level,
+                              std::error_code& ec) noexcept;
+TOPDEC_API size_t compress_81(std::span<const char> uncompressed,
+                              std::span<char> compressed,
+                              int level,
+                              std::error_code& ec) noexcept;
+TOPDEC_API size_t compress_83(std::span<const char> uncompressed,
+                              std::span<char> compressed,
+                              int level,
+                              std::error_code& ec) noexcept;
+
+// File images are complete files as stored on disk, including the header.
+TOPDEC_API std::optional<CompressedHeader> parse_file_image_header(std::span<const char> file,
+                                                                   std::error_code& ec) noexcept;
+
+// Output size needed to decode the given file image, as read from its header.
+TOPDEC_API size_t decode_file_image_bound(std::span<const char> file,
+                                          std::error_code& ec) noexcept;
+
+// Decodes a file image, dispatching on the type byte of its header. Same LengthMismatch
+// behavior as decompress().
+TOPDEC_API size_t decode_file_image(std::span<const char> file,
+                                    std::span<char> output,
+                                    std::error_code& ec) noexcept;
+
+// Exact-bound variant, see decompress_exact(). 'output' only needs to be as large as the
+// uncompressed length in the header.
+TOPDEC_API size_t decode_file_image_exact(std::span<const char> file,
+                                          std::span<char> output,
+                                          std::error_code& ec) noexcept;
+
+// Allocating variant; 'output' is resized to the decoded length. Reusing the same vector across
+// calls avoids reallocating it every time.
+TOPDEC_API void decode_file_image(std::span<const char> file,
+                                  std::vector<char>& output,
+                                  std::error_code& ec);
+
+TOPDEC_API size_t encode_file_image(uint8_t type,
+                                    std::span<const char> uncompressed,
+                                    std::span<char> output,
+                                    int level,
+                                    std::error_code& ec) noexcept;
+TOPDEC_API void encode_file_image(uint8_t type,
+                                  std::span<const char> uncompressed,
+                                  std::vector<char>& output,
+                                  int level,
+                                  std::error_code& ec);
+
+struct BatchItem {
+    std::span<const char> Input;
+    std::vector<char> Output;
+    std::error_code Error;
+};
+
+// Process every item on the library's internal thread pool, using at most 'maxThreads' threads
+// (0 for no limit). Each item's Output is reused, so keeping the items around between batches
+// avoids allocations.
+TOPDEC_API void decode_file_images(std::span<BatchItem> items, size_t maxThreads = 0);
+TOPDEC_API void encode_file_images(uint8_t type,
+                                   std::span<BatchItem> items,
+                                   int level = compress_default_level,
+                                   size_t maxThreads = 0);
+
+// Output size needed by decode_file_images_contiguous(): the sum of the uncompressed lengths in
+// the headers of all file images.
+TOPDEC_API size_t decode_file_images_contiguous_size(std::span<const std::span<const char>> files,
+                                                     std::error_code& ec) noexcept;
+
+// Decodes all file images into 'output' back to back, without any slack between them, so a whole
+// set of assets needs just one allocation. 'offsets' must have room for files.size() + 1 entries;
+// file i is decoded to [offsets[i], offsets[i + 1]). Runs on the library's internal thread pool
+// like decode_file_images(). On failure, 'ec' is the error of the first file that failed; since
+// the layout is fixed up front, a file that decodes to a different length than its header says is
+// an error here (LengthMismatch).
+TOPDEC_API void decode_file_images_contiguous(std::span<const std::span<const char>> files,
+                                              std::span<char> output,
+                                              std::span<size_t> offsets,
+                                              std::error_code& ec,
+                                              size_t maxThreads = 0);
+} // namespace TopDec
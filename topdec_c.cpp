@@ -0,0 +1,380 @@
+#include "topdec_c.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <system_error>
+#include <vector>
+
+#include "decode_cache.h"
+#include "header.h"
+#include "thread_pool.h"
+#include "topdec.h"
+
+// Thin wrappers around the C++ interface in topdec.h. Library errors map 1:1 onto the status
+// values; anything else can't happen with the functions used here.
+static int ToStatus(const std::error_code& ec) {
+    if (!ec) {
+        return TOPDEC_OK;
+    }
+    if (ec.category() == TopDec::error_category()) {
+        return ec.value();
+    }
+    if (ec == std::errc::not_enough_memory) {
+        return TOPDEC_ERROR_OUT_OF_MEMORY;
+    }
+    return TOPDEC_ERROR_INVALID_ARGUMENT;
+}
+
+// No exception may unwind across the C interface. Entry points that only call noexcept functions
+// are safe as they are; all others run their body through this. The only exceptions that can come
+// out of them are failures to get memory or other resources such as threads, so all of them are
+// reported as TOPDEC_ERROR_OUT_OF_MEMORY.
+template<typename Func>
+static int Guarded(const Func& func) noexcept {
+    try {
+        return func();
+    } catch (...) {
+        return TOPDEC_ERROR_OUT_OF_MEMORY;
+    }
+}
+
+struct topdec_cache {
+    explicit topdec_cache(size_t byteBudget) : Cache(byteBudget) {}
+
+    TopDec::DecodeCache Cache;
+};
+
+struct topdec_cache_buffer {
+    TopDec::DecodeCache::Buffer Data;
+};
+
+static std::span<const char> InputSpan(const void* data, size_t size) {
+    return std::span<const char>(static_cast<const char*>(data), size);
+}
+
+static std::span<char> OutputSpan(void* data, size_t size) {
+    return std::span<char>(static_cast<char*>(data), size);
+}
+
+extern "C" {
+uint32_t topdec_abi_version(void) {
+    return TOPDEC_ABI_VERSION;
+}
+
+const char* topdec_status_string(int status) {
+    switch (status) {
+        case TOPDEC_OK: return "success";
+        case TOPDEC_ERROR_INVALID_ARGUMENT: return "invalid argument";
+        case TOPDEC_ERROR_TRUNCATED_HEADER: return "input too small to contain a header";
+        case TOPDEC_ERROR_TRUNCATED_DATA: return "input shorter than the length in its header";
+        case TOPDEC_ERROR_UNSUPPORTED_TYPE: return "unsupported compression type";
+        case TOPDEC_ERROR_CORRUPT_DATA: return "corrupt compressed data";
+        case TOPDEC_ERROR_LENGTH_MISMATCH: return "decoded length differs from header";
+        case TOPDEC_ERROR_OUTPUT_TOO_SMALL: return "output buffer too small";
+        case TOPDEC_ERROR_INPUT_TOO_LARGE: return "input too large";
+        case TOPDEC_ERROR_IO_FAILURE: return "reading or writing a file failed";
+        case TOPDEC_ERROR_OUT_OF_MEMORY: return "out of memory";
+        default: return "unknown error";
+    }
+}
+
+size_t topdec_decompress_bound(size_t uncompressed_size) {
+    return TopDec::decompress_bound(uncompressed_size);
+}
+
+size_t topdec_compress_bound(size_t uncompressed_size) {
+    return TopDec::compress_bound(uncompressed_size);
+}
+
+size_t topdec_encode_file_image_bound(size_t uncompressed_size) {
+    return TopDec::encode_file_image_bound(uncompressed_size);
+}
+
+int topdec_parse_header(const void* file, size_t file_size, topdec_header* header) {
+    if ((file == nullptr && file_size != 0) || header == nullptr) {
+        return TOPDEC_ERROR_INVALID_ARGUMENT;
+    }
+    std::error_code ec;
+    const auto h = TopDec::parse_file_image_header(InputSpan(file, file_size), ec);
+    if (!h) {
+        return ToStatus(ec);
+    }
+    header->type = h->Type;
+    header->compressed_length = h->CompressedLength;
+    header->uncompressed_length = h->UncompressedLength;
+    return TOPDEC_OK;
+}
+
+int topdec_decompress(uint8_t type,
+                      const void* compressed,
+                      size_t compressed_size,
+                      void* output,
+                      size_t output_capacity,
+                      size_t uncompressed_size,
+                      size_t* output_size) {
+    if ((compressed == nullptr && compressed_size != 0)
+        || (output == nullptr && output_capacity != 0) || output_size == nullptr) {
+        return TOPDEC_ERROR_INVALID_ARGUMENT;
+    }
+    std::error_code ec;
+    *output_size = TopDec::decompress(type,
+                                      InputSpan(compressed, compressed_size),
+                                      OutputSpan(output, output_capacity),
+                                      uncompressed_size,
+                                      ec);
+    return ToStatus(ec);
+}
+
+int topdec_compress(uint8_t type,
+                    int level,
+                    const void* input,
+                    size_t input_size,
+                    void* output,
+                    size_t output_capacity,
+                    size_t* output_size) {
+    if ((input == nullptr && input_size != 0) || (output == nullptr && output_capacity != 0)
+        || output_size == nullptr) {
+        return TOPDEC_ERROR_INVALID_ARGUMENT;
+    }
+    std::error_code ec;
+    *output_size = TopDec::compress(
+        type, InputSpan(input, input_size), OutputSpan(output, output_capacity), level, ec);
+    return ToStatus(ec);
+}
+
+int topdec_decode_file_image(const void* file,
+                             size_t file_size,
+                             void* output,
+                             size_t output_capacity,
+                             size_t* output_size) {
+    if ((file == nullptr && file_size != 0) || (output == nullptr && output_capacity != 0)
+        || output_size == nullptr) {
+        return TOPDEC_ERROR_INVALID_ARGUMENT;
+    }
+    std::error_code ec;
+    *output_size = TopDec::decode_file_image(
+        InputSpan(file, file_size), OutputSpan(output, output_capacity), ec);
+    return ToStatus(ec);
+}
+
+int topdec_encode_file_image(uint8_t type,
+                             int level,
+                             const void* input,
+                             size_t input_size,
+                             void* output,
+                             size_t output_capacity,
+                             size_t* output_size) {
+    if ((input == nullptr && input_size != 0) || (output == nullptr && output_capacity != 0)
+        || output_size == nullptr) {
+        return TOPDEC_ERROR_INVALID_ARGUMENT;
+    }
+    std::error_code ec;
+    *output_size = TopDec::encode_file_image(
+        type, InputSpan(input, input_size), OutputSpan(output, output_capacity), level, ec);
+    return ToStatus(ec);
+}
+
+static int FirstFailure(const topdec_batch_item* items, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (items[i].status != TOPDEC_OK) {
+            return items[i].status;
+        }
+    }
+    return TOPDEC_OK;
+}
+
+int topdec_decode_file_images(topdec_batch_item* items, size_t count, size_t max_threads) {
+    if (items == nullptr && count != 0) {
+        return TOPDEC_ERROR_INVALID_ARGUMENT;
+    }
+    return Guarded([&]() {
+        GetSharedThreadPool().ParallelFor(
+            count,
+            [&](size_t i) {
+                topdec_batch_item& item = items[i];
+                item.output_size = 0;
+                item.status = topdec_decode_file_image(item.input,
+                                                       item.input_size,
+                                                       item.output,
+                                                       item.output_capacity,
+                                                       &item.output_size);
+            },
+            max_threads);
+        return FirstFailure(items, count);
+    });
+}
+
+int topdec_encode_file_images(uint8_t type,
+                              int level,
+                              topdec_batch_item* items,
+                              size_t count,
+                              size_t max_threads) {
+    if (items == nullptr && count != 0) {
+        return TOPDEC_ERROR_INVALID_ARGUMENT;
+    }
+    return Guarded([&]() {
+        GetSharedThreadPool().ParallelFor(
+            count,
+            [&](size_t i) {
+                topdec_batch_item& item = items[i];
+                item.output_size = 0;
+                item.status = topdec_encode_file_image(type,
+                                                       level,
+                                                       item.input,
+                                                       item.input_size,
+                                                       item.output,
+                                                       item.output_capacity,
+                                                       &item.output_size);
+            },
+            max_threads);
+        return FirstFailure(items, count);
+    });
+}
+
+int topdec_decode_file_images_contiguous_size(const void* const* files,
+                                              const size_t* file_sizes,
+                                              size_t count,
+                                              size_t* output_size) {
+    if ((count != 0 && (files == nullptr || file_sizes == nullptr)) || output_size == nullptr) {
+        return TOPDEC_ERROR_INVALID_ARGUMENT;
+    }
+    *output_size = 0;
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        std::error_code ec;
+        const auto header = TopDec::parse_file_image_header(InputSpan(files[i], file_sizes[i]), ec);
+        if (!header) {
+            return ToStatus(ec);
+        }
+        total += header->UncompressedLength;
+    }
+    *output_size = total;
+    return TOPDEC_OK;
+}
+
+// Same as TopDec::decode_file_images_contiguous(), but works on the caller's arrays directly
+// instead of building a span for every file.
+int topdec_decode_file_images_contiguous(const void* const* files,
+                                         const size_t* file_sizes,
+                                         size_t count,
+                                         void* output,
+                                         size_t output_capacity,
+                                         size_t* offsets,
+                                         size_t max_threads) {
+    if ((count != 0 && (files == nullptr || file_sizes == nullptr))
+        || (output == nullptr && output_capacity != 0) || offsets == nullptr) {
+        return TOPDEC_ERROR_INVALID_ARGUMENT;
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < count; ++i) {
+        std::error_code ec;
+        const auto header = TopDec::parse_file_image_header(InputSpan(files[i], file_sizes[i]), ec);
+        if (!header) {
+            return ToStatus(ec);
+        }
+        offsets[i] = offset;
+        offset += header->UncompressedLength;
+    }
+    offsets[count] = offset;
+    if (output_capacity < offset) {
+        return TOPDEC_ERROR_OUTPUT_TOO_SMALL;
+    }
+
+    // Failures are collected per image rather than under a lock, so the workers can't throw.
+    std::vector<int> statuses;
+    const std::span<char> arena = OutputSpan(output, output_capacity);
+    return Guarded([&]() {
+        statuses.resize(count, TOPDEC_OK);
+        GetSharedThreadPool().ParallelFor(
+            count,
+            [&](size_t i) {
+                const size_t length = offsets[i + 1] - offsets[i];
+                std::error_code ec;
+                const size_t decoded = TopDec::decode_file_image_exact(
+                    InputSpan(files[i], file_sizes[i]), arena.subspan(offsets[i], length), ec);
+                statuses[i] = ToStatus(ec);
+                if (statuses[i] == TOPDEC_OK && decoded != length) {
+                    statuses[i] = TOPDEC_ERROR_LENGTH_MISMATCH;
+                }
+            },
+            max_threads);
+        for (int status : statuses) {
+            if (status != TOPDEC_OK) {
+                return status;
+            }
+        }
+        return static_cast<int>(TOPDEC_OK);
+    });
+}
+
+topdec_cache* topdec_cache_create(size_t byte_budget) {
+    // nothrow new only covers the allocation itself, not what the constructor allocates
+    try {
+        return new topdec_cache(byte_budget);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void topdec_cache_destroy(topdec_cache* cache) {
+    delete cache;
+}
+
+int topdec_cache_decode(topdec_cache* cache,
+                        const void* file,
+                        size_t file_size,
+                        topdec_cache_buffer** buffer) {
+    if (cache == nullptr || (file == nullptr && file_size != 0) || buffer == nullptr) {
+        return TOPDEC_ERROR_INVALID_ARGUMENT;
+    }
+    *buffer = nullptr;
+    return Guarded([&]() {
+        std::error_code ec;
+        auto data = cache->Cache.Decode(InputSpan(file, file_size), ec);
+        if (ec) {
+            return ToStatus(ec);
+        }
+        *buffer = new topdec_cache_buffer{std::move(data)};
+        return static_cast<int>(TOPDEC_OK);
+    });
+}
+
+const void* topdec_cache_buffer_data(const topdec_cache_buffer* buffer) {
+    return buffer->Data->data();
+}
+
+size_t topdec_cache_buffer_size(const topdec_cache_buffer* buffer) {
+    return buffer->Data->size();
+}
+
+void topdec_cache_buffer_release(topdec_cache_buffer* buffer) {
+    delete buffer;
+}
+
+// These two can only fail to lock a mutex, which leaves nothing sensible to report.
+void topdec_cache_clear(topdec_cache* cache) {
+    try {
+        cache->Cache.Clear();
+    } catch (...) {
+    }
+}
+
+void topdec_cache_get_stats(const topdec_cache* cache, topdec_cache_stats* stats) {
+    *stats = topdec_cache_stats{};
+    TopDec::DecodeCacheStats s;
+    try {
+        s = cache->Cache.GetStats();
+    } catch (...) {
+        return;
+    }
+    stats->hits = s.Hits;
+    stats->misses = s.Misses;
+    stats->insertions = s.Insertions;
+    stats->evictions = s.Evictions;
+    stats->uncacheable = s.Uncacheable;
+    stats->entries = s.Entries;
+    stats->bytes = s.Bytes;
+    stats->capacity = s.Capacity;
+}
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+/* Stable C interface of libtopdec. Only plain C types cross this boundary, so it can be used from
+ * other languages and by binaries built with a different compiler or C++ standard library than
+ * the library itself. New functions may be added in later versions; existing signatures, struct
+ * layouts and status values don't change without bumping TOPDEC_ABI_VERSION. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(TOPDEC_STATIC)
+#define TOPDEC_API
+#elif defined(_MSC_VER)
+#ifdef TOPDEC_BUILDING_LIBRARY
+#define TOPDEC_API __declspec(dllexport)
+#else
+#define TOPDEC_API __declspec(dllimport)
+#endif
+#else
+#define TOPDEC_API __attribute__((visibility("default")))
+#endif
+
+#define TOPDEC_ABI_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Every function returns one of these. */
+enum {
+    TOPDEC_OK = 0,
+    TOPDEC_ERROR_INVALID_ARGUMENT = 1,
+    TOPDEC_ERROR_TRUNCATED_HEADER = 2,
+    TOPDEC_ERROR_TRUNCATED_DATA = 3,
+    TOPDEC_ERROR_UNSUPPORTED_TYPE = 4,
+    TOPDEC_ERROR_CORRUPT_DATA = 5,
+    TOPDEC_ERROR_LENGTH_MISMATCH = 6,
+    TOPDEC_ERROR_OUTPUT_TOO_SMALL = 7,
+    TOPDEC_ERROR_INPUT_TOO_LARGE = 8,
+    TOPDEC_ERROR_IO_FAILURE = 9,
+    TOPDEC_ERROR_OUT_OF_MEMORY = 10,
+};
+
+typedef struct topdec_header {
+    uint8_t type;
+    uint32_t compressed_length;
+    uint32_t uncompressed_length;
+} topdec_header;
+
+/* One buffer of a batch call. The caller fills in input, input_size, output and output_capacity;
+ * the library fills in output_size and status. */
+typedef struct topdec_batch_item {
+    const void* input;
+    size_t input_size;
+    void* output;
+    size_t output_capacity;
+    size_t output_size;
+    int status;
+} topdec_batch_item;
+
+TOPDEC_API uint32_t topdec_abi_version(void);
+TOPDEC_API const char* topdec_status_string(int status);
+
+/* Output capacity needed to decompress data of the given uncompressed length. This is larger than
+ * the uncompressed length itself, as the decoder may write past the end on malformed input. */
+TOPDEC_API size_t topdec_decompress_bound(size_t uncompressed_size);
+
+/* Output capacity needed to compress 'uncompressed_size' bytes, without the file header. */
+TOPDEC_API size_t topdec_compress_bound(size_t uncompressed_size);
+
+/* Output capacity needed for the file image of 'uncompressed_size' bytes, including the header. */
+TOPDEC_API size_t topdec_encode_file_image_bound(size_t uncompressed_size);
+
+TOPDEC_API int topdec_parse_header(const void* file, size_t file_size, topdec_header* header);
+
+/* Raw stream functions without a file header. 'type' is one of 0x00, 0x01, 0x03, 0x81 or 0x83.
+ * On TOPDEC_ERROR_LENGTH_MISMATCH, *output_size is the amount of bytes actually produced. */
+TOPDEC_API int topdec_decompress(uint8_t type,
+                                 const void* compressed,
+                                 size_t compressed_size,
+                                 void* output,
+                                 size_t output_capacity,
+                                 size_t uncompressed_size,
+                                 size_t* output_size);
+TOPDEC_API int topdec_compress(uint8_t type,
+                               int level,
+                               const void* input,
+                               size_t input_size,
+                               void* output,
+                               size_t output_capacity,
+                               size_t* output_size);
+
+/* Functions on complete files, header included. 'output_capacity' for decoding must be at least
+ * topdec_decompress_bound() of the uncompressed length in the header. */
+TOPDEC_API int topdec_decode_file_image(const void* file,
+                                        size_t file_size,
+                                        void* output,
+                                        size_t output_capacity,
+                                        size_t* output_size);
+TOPDEC_API int topdec_encode_file_image(uint8_t type,
+                                        int level,
+                                        const void* input,
+                                        size_t input_size,
+                                        void* output,
+                                        size_t output_capacity,
+                                        size_t* output_size);
+
+/* Process all items on the library's internal thread pool, using at most 'max_threads' threads
+ * (0 for no limit). Returns TOPDEC_OK if every item succeeded, otherwise the status of the first
+ * item that failed. */
+TOPDEC_API int
+    topdec_decode_file_images(topdec_batch_item* items, size_t count, size_t max_threads);
+TOPDEC_API int topdec_encode_file_images(uint8_t type,
+                                         int level,
+                                         topdec_batch_item* items,
+                                         size_t count,
+                                         size_t max_threads);
+
+/* Decodes 'count' file images into one contiguous buffer, back to back. Query the needed output
+ * capacity with topdec_decode_file_images_contiguous_size() first. 'offsets' must have room for
+ * count + 1 entries; image i ends up at [offsets[i], offsets[i + 1]). Returns the status of the
+ * first image that failed; an image whose decoded length differs from its header is a failure. */
+TOPDEC_API int topdec_decode_file_images_contiguous_size(const void* const* files,
+                                                         const size_t* file_sizes,
+                                                         size_t count,
+                                                         size_t* output_size);
+TOPDEC_API int topdec_decode_file_images_contiguous(const void* const* files,
+                                                    const size_t* file_sizes,
+                                                    size_t count,
+                                                    void* output,
+                                                    size_t output_capacity,
+                                                    size_t* offsets,
+                                                    size_t max_threads);
+
+/* Cache of decoded file images, keyed by a hash of the compressed file and bounded by a byte
+ * budget. Safe to use from multiple threads. See decode_cache.h for details. */
+typedef struct topdec_cache topdec_cache;
+typedef struct topdec_cache_buffer topdec_cache_buffer;
+
+typedef struct topdec_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t insertions;
+    uint64_t evictions;
+    uint64_t uncacheable;
+    uint64_t entries;
+    uint64_t bytes;
+    uint64_t capacity;
+} topdec_cache_stats;
+
+/* Returns NULL if the cache could not be allocated. */
+TOPDEC_API topdec_cache* topdec_cache_create(size_t byte_budget);
+TOPDEC_API void topdec_cache_destroy(topdec_cache* cache);
+
+/* Looks up or decodes the given file image. On success *buffer receives a reference to the
+ * immutable result, which stays valid until it is released, even if the cache evicts it or is
+ * destroyed in the meantime. */
+TOPDEC_API int topdec_cache_decode(topdec_cache* cache,
+                                   const void* file,
+                                   size_t file_size,
+                                   topdec_cache_buffer** buffer);
+TOPDEC_API const void* topdec_cache_buffer_data(const topdec_cache_buffer* buffer);
+TOPDEC_API size_t topdec_cache_buffer_size(const topdec_cache_buffer* buffer);
+TOPDEC_API void topdec_cache_buffer_release(topdec_cache_buffer* buffer);
+
+TOPDEC_API void topdec_cache_clear(topdec_cache* cache);
+TOPDEC_API void topdec_cache_get_stats(const topdec_cache* cache, topdec_cache_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,614 @@
+#include "watch.h"
+
+#include <cstdio>
+
+#ifdef __linux__
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "compress.h"
+#include "mirror.h"
+
+using WatchClock = std::chrono::steady_clock;
+
+namespace {
+struct WatchOptions {
+    // Type, Level, Include, Exclude and Batch apply to every file; the initial sync also uses
+    // SkipIfNewer.
+    MirrorOptions Mirror;
+
+    // A file is compressed once it has gone this long without another event, so the burst of
+    // events from a single save results in a single compression.
+    std::chrono::milliseconds Debounce{50};
+
+    // nice value of the compression threads
+    int Priority = 10;
+
+    // bring the target up to date before watching
+    bool InitialSync = true;
+};
+} // namespace
+
+// IN_MODIFY catches changes that never close a file written to, such as truncate(2) or a writer
+// that keeps its file open. The kernel merges repeated ones for the same file, and the debounce
+// holds off compressing until the writes have stopped.
+static constexpr uint32_t directory_watch_mask = IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_DELETE
+                                                 | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+// events that queue a file for compression, or for removing its output
+static constexpr uint32_t file_change_mask =
+    IN_CLOSE_WRITE | IN_MODIFY | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+
+static bool MatchesAny(const std::vector<std::string>& patterns, std::string_view path) {
+    for (const auto& pattern : patterns) {
+        if (match_glob(pattern, path)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool IsExcluded(const WatchOptions& options, const std::filesystem::path& relative) {
+    return MatchesAny(options.Mirror.Exclude, relative.generic_string());
+}
+
+static bool IsWantedFile(const WatchOptions& options, const std::filesystem::path& relative) {
+    const std::string generic = relative.generic_string();
+    if (MatchesAny(options.Mirror.Exclude, generic)) {
+        return false;
+    }
+    return options.Mirror.Include.empty() || MatchesAny(options.Mirror.Include, generic);
+}
+
+static bool IsUpToDate(const std::filesystem::path& input, const std::filesystem::path& output) {
+    std::error_code ec;
+    const auto outputTime = std::filesystem::last_write_time(output, ec);
+    if (ec) {
+        return false;
+    }
+    const auto inputTime = std::filesystem::last_write_time(input, ec);
+    return !ec && outputTime >= inputTime;
+}
+
+namespace {
+// Compresses changed files on a background thread. Files queued while a batch is running are
+// collected into the next one, so a busy compressor naturally works in larger batches.
+struct Compressor {
+public:
+    Compressor(const std::filesystem::path& source,
+               const std::filesystem::path& target,
+               const WatchOptions& options)
+      : Source(source), Target(target), Options(options) {
+        Thread = std::thread([this]() { Run(); });
+    }
+    Compressor(const Compressor& other) = delete;
+    Compressor(Compressor&& other) = delete;
+    Compressor& operator=(const Compressor& other) = delete;
+    Compressor& operator=(Compressor&& other) = delete;
+    ~Compressor() {
+        {
+            std::lock_guard lock(Mutex);
+            Stopping = true;
+        }
+        Wake.notify_one();
+        Thread.join();
+    }
+
+    // Paths are relative to the source directory. A path whose file no longer exists has its
+    // output removed instead.
+    void Enqueue(std::vector<std::filesystem::path> files) {
+        {
+            std::lock_guard lock(Mutex);
+            for (auto& file : files) {
+                Queue.push_back(std::move(file));
+            }
+        }
+        Wake.notify_one();
+    }
+
+private:
+    void Run();
+    void ProcessBatch(std::vector<std::filesystem::path> files);
+
+    const std::filesystem::path& Source;
+    const std::filesystem::path& Target;
+    const WatchOptions& Options;
+
+    std::mutex Mutex;
+    std::condition_variable Wake;
+    std::vector<std::filesystem::path> Queue;
+    bool Stopping = false;
+
+    std::thread Thread;
+};
+} // namespace
+
+void Compressor::Run() {
+    // Threads inherit the nice value of the thread that creates them, so this also covers the
+    // reader, codec and writer threads of every batch started from here.
+    const auto tid = static_cast<id_t>(syscall(SYS_gettid));
+    if (Options.Priority != 0 && setpriority(PRIO_PROCESS, tid, Options.Priority) != 0) {
+        printf("failed to set priority: %s\n", strerror(errno));
+    }
+
+    while (true) {
+        std::vector<std::filesystem::path> files;
+        {
+            std::unique_lock lock(Mutex);
+            Wake.wait(lock, [this]() { return Stopping || !Queue.empty(); });
+            if (Queue.empty()) {
+                return;
+            }
+            files.swap(Queue);
+        }
+        ProcessBatch(std::move(files));
+    }
+}
+
+void Compressor::ProcessBatch(std::vector<std::filesystem::path> files) {
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+
+    const auto start = WatchClock::now();
+    std::vector<BatchJob> jobs;
+    for (const auto& file : files) {
+        const auto input = Source / file;
+        const auto output = Target / file;
+        std::error_code ec;
+        if (std::filesystem::is_regular_file(input, ec)) {
+            BatchJob& job = jobs.emplace_back();
+            job.Op = BatchOp::Compress;
+            job.Type = Options.Mirror.Type;
+            job.Level = Options.Mirror.Level;
+            job.Input = input;
+            job.Output = output;
+            continue;
+        }
+
+        // Outputs can be device files, so leave anything that isn't a regular file alone.
+        if (std::filesystem::is_regular_file(std::filesystem::symlink_status(output, ec))
+            && std::filesystem::remove(output, ec)) {
+            printf("removed %s\n", output.string().c_str());
+        }
+    }
+
+    if (!jobs.empty()) {
+        const auto results = run_batch(jobs, Options.Mirror.Batch);
+        const double seconds =
+            std::chrono::duration<double>(WatchClock::now() - start).count();
+        print_batch_status(jobs, results, seconds, false);
+    }
+    fflush(stdout);
+}
+
+namespace {
+// The inotify instance and the directories it watches. inotify isn't recursive, so every
+// directory below the source gets a watch of its own, and new ones are added as they appear.
+struct Watcher {
+public:
+    Watcher(const std::filesystem::path& source,
+            const std::filesystem::path& target,
+            const WatchOptions& options)
+      : Source(source), Target(target), Options(options) {}
+    Watcher(const Watcher& other) = delete;
+    Watcher(Watcher&& other) = delete;
+    Watcher& operator=(const Watcher& other) = delete;
+    Watcher& operator=(Watcher&& other) = delete;
+    ~Watcher() {
+        if (Fd != -1) {
+            close(Fd);
+        }
+    }
+
+    bool Open() {
+        Fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        return Fd != -1;
+    }
+
+    int GetFd() const {
+        return Fd;
+    }
+
+    // Watches 'relative' and every directory below it. The files found on the way are added to
+    // 'files' if it's set, since they may have been written before the watch was in place.
+    void AddTree(const std::filesystem::path& relative, std::vector<std::filesystem::path>* files);
+
+    // Reads all pending events and adds the files they affect to 'changed'. Returns false if
+    // events were lost and the whole tree has to be checked again.
+    bool ReadEvents(std::vector<std::filesystem::path>& changed);
+
+private:
+    void RemoveTree(const std::filesystem::path& relative,
+                    std::vector<std::filesystem::path>& changed);
+
+    const std::filesystem::path& Source;
+    const std::filesystem::path& Target;
+    const WatchOptions& Options;
+    int Fd = -1;
+
+    // watch descriptor to directory, relative to the source
+    std::unordered_map<int, std::filesystem::path> Directories;
+};
+} // namespace
+
+void Watcher::AddTree(const std::filesystem::path& relative,
+                      std::vector<std::filesystem::path>* files) {
+    std::vector<std::filesystem::path> stack{relative};
+    while (!stack.empty()) {
+        const std::filesystem::path directory = std::move(stack.back());
+        stack.pop_back();
+        const auto path = Source / directory;
+        const int wd = inotify_add_watch(Fd, path.c_str(), directory_watch_mask);
+        if (wd == -1) {
+            if (errno == ENOSPC) {
+                printf("failed to watch %s: out of inotify watches, see "
+                       "/proc/sys/fs/inotify/max_user_watches\n",
+                       path.string().c_str());
+            } else if (errno != ENOENT) {
+                printf("failed to watch %s: %s\n", path.string().c_str(), strerror(errno));
+            }
+            continue;
+        }
+        Directories[wd] = directory;
+
+        std::error_code ec;
+        std::filesystem::directory_iterator it(path, ec);
+        for (; !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+            const auto child = directory / it->path().filename();
+            std::error_code typeEc;
+            if (it->is_directory(typeEc) && !it->is_symlink(typeEc)) {
+                if (!IsExcluded(Options, child)) {
+                    stack.push_back(child);
+                }
+            } else if (files != nullptr && it->is_regular_file(typeEc)
+                       && IsWantedFile(Options, child)) {
+                files->push_back(child);
+            }
+        }
+    }
+}
+
+void Watcher::RemoveTree(const std::filesystem::path& relative,
+                         std::vector<std::filesystem::path>& changed) {
+    // The files of the directory can't be listed anymore, so go by the outputs that exist for it.
+    // They are queued like deleted files, which removes them.
+    std::error_code ec;
+    std::filesystem::recursive_directory_iterator it(Target / relative, ec);
+    for (; !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        std::error_code typeEc;
+        if (it->is_regular_file(typeEc)) {
+            changed.push_back(relative / it->path().lexically_relative(Target / relative));
+        }
+    }
+
+    for (auto it = Directories.begin(); it != Directories.end();) {
+        const auto mismatch = std::mismatch(
+            relative.begin(), relative.end(), it->second.begin(), it->second.end());
+        if (mismatch.first == relative.end()) {
+            inotify_rm_watch(Fd, it->first);
+            it = Directories.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool Watcher::ReadEvents(std::vector<std::filesystem::path>& changed) {
+    bool complete = true;
+    alignas(inotify_event) std::array<char, 0x10000> buffer;
+    while (true) {
+        const ssize_t length = read(Fd, buffer.data(), buffer.size());
+        if (length <= 0) {
+            return complete;
+        }
+        for (size_t offset = 0; offset < static_cast<size_t>(length);) {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer.data() + offset);
+            offset += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                complete = false;
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                // the directory is gone, or RemoveTree() has already dropped the watch
+                Directories.erase(event->wd);
+                continue;
+            }
+            const auto directory = Directories.find(event->wd);
+            if (directory == Directories.end() || event->len == 0) {
+                continue;
+            }
+            const auto relative = directory->second / event->name;
+
+            if (event->mask & IN_ISDIR) {
+                if (IsExcluded(Options, relative)) {
+                    continue;
+                }
+                // A directory moved within the source shows up as a move out of its old place and
+                // a move into the new one; its watches still carry the old path, so start over.
+                if (event->mask & IN_MOVED_FROM) {
+                    RemoveTree(relative, changed);
+                } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    AddTree(relative, &changed);
+                }
+                continue;
+            }
+
+            // Creating a file is followed by writing and closing it, so wait for that instead.
+            if ((event->mask & file_change_mask) != 0 && IsWantedFile(Options, relative)) {
+                changed.push_back(relative);
+            }
+        }
+    }
+}
+
+static bool IsInExcludedDirectory(const WatchOptions& options,
+                                  const std::filesystem::path& relative) {
+    std::filesystem::path directory;
+    for (auto it = relative.begin(); it != relative.end() && std::next(it) != relative.end();
+         ++it) {
+        directory /= *it;
+        if (IsExcluded(options, directory)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Adds every file below the source whose output is missing or older than the input to 'files'.
+// Outputs without an input are added as well, as the events of their deletion may be among those
+// that got lost; the compressor removes them.
+static void FindOutdatedFiles(Watcher& watcher,
+                              const std::filesystem::path& source,
+                              const std::filesystem::path& target,
+                              const WatchOptions& options,
+                              std::vector<std::filesystem::path>& files) {
+    std::vector<std::filesystem::path> all;
+    watcher.AddTree(std::filesystem::path(), &all);
+    for (auto& file : all) {
+        if (!IsUpToDate(source / file, target / file)) {
+            files.push_back(std::move(file));
+        }
+    }
+
+    std::vector<std::filesystem::path> outputs;
+    std::vector<std::filesystem::path> unreadable;
+    list_files_recursive(target, outputs, unreadable);
+    for (const auto& output : outputs) {
+        auto relative = output.lexically_relative(target);
+        std::error_code ec;
+        if (IsWantedFile(options, relative) && !IsInExcludedDirectory(options, relative)
+            && std::filesystem::symlink_status(source / relative, ec).type()
+                   == std::filesystem::file_type::not_found) {
+            files.push_back(std::move(relative));
+        }
+    }
+}
+
+static volatile std::sig_atomic_t s_StopRequested = 0;
+
+static void HandleStopSignal(int) {
+    s_StopRequested = 1;
+}
+
+static void PrintWatchUsage() {
+    printf(
+        "Usage for watch mode:\n"
+        "  topdec watch [options] (input directory) (output directory)\n"
+        "  Compresses the input directory into the output directory like 'topdec c -r', then\n"
+        "  keeps the output up to date until interrupted: changed files are compressed again and\n"
+        "  the outputs of deleted or moved files are removed.\n"
+        "  Options are:\n"
+        "    --type 01/03/81/83 (defaults to 83)\n"
+        "    --level 1-9 (defaults to 9, lower levels search less for matches)\n"
+        "    --include (glob) (only process matching files, may be given more than once)\n"
+        "    --exclude (glob) (skip matching files and directories, may be given more than once)\n"
+        "    --debounce MS (wait this long after the last change to a file, defaults to 50)\n"
+        "    --priority N (nice value of the compression threads, defaults to 10)\n"
+        "    --no-initial-sync (only process files that change while watching)\n"
+        "    --threads N (defaults to the number of hardware threads)\n"
+        "    --io auto/sync/uring (file access method, auto uses io_uring where available)\n");
+}
+
+int WatchMain(int argc, char** argv) {
+    WatchOptions options;
+    options.Mirror.Op = BatchOp::Compress;
+    int idx = 2;
+    while (idx < argc) {
+        const bool hasValue = (idx + 1) < argc;
+        if (strcmp("--type", argv[idx]) == 0 && hasValue) {
+            const std::string_view type(argv[idx + 1]);
+            if (type == "01") {
+                options.Mirror.Type = 0x01;
+            } else if (type == "03") {
+                options.Mirror.Type = 0x03;
+            } else if (type == "81") {
+                options.Mirror.Type = 0x81;
+            } else if (type == "83") {
+                options.Mirror.Type = 0x83;
+            } else {
+                printf("Invalid compression type.\n");
+                return -1;
+            }
+            idx += 2;
+        } else if (strcmp("--level", argv[idx]) == 0 && hasValue) {
+            options.Mirror.Level = atoi(argv[idx + 1]);
+            if (options.Mirror.Level < compress_min_level
+                || options.Mirror.Level > compress_max_level) {
+                printf("Invalid compression level.\n");
+                return -1;
+            }
+            idx += 2;
+        } else if (strcmp("--include", argv[idx]) == 0 && hasValue) {
+            options.Mirror.Include.emplace_back(argv[idx + 1]);
+            idx += 2;
+        } else if (strcmp("--exclude", argv[idx]) == 0 && hasValue) {
+            options.Mirror.Exclude.emplace_back(argv[idx + 1]);
+            idx += 2;
+        } else if (strcmp("--debounce", argv[idx]) == 0 && hasValue) {
+            options.Debounce = std::chrono::milliseconds(strtoul(argv[idx + 1], nullptr, 10));
+            idx += 2;
+        } else if (strcmp("--priority", argv[idx]) == 0 && hasValue) {
+            options.Priority = atoi(argv[idx + 1]);
+            if (options.Priority < 0 || options.Priority > 19) {
+                printf("Invalid priority, must be between 0 and 19.\n");
+                return -1;
+            }
+            idx += 2;
+        } else if (strcmp("--no-initial-sync", argv[idx]) == 0) {
+            options.InitialSync = false;
+            ++idx;
+        } else if (strcmp("--threads", argv[idx]) == 0 && hasValue) {
+            options.Mirror.Batch.Threads =
+                static_cast<size_t>(strtoull(argv[idx + 1], nullptr, 10));
+            idx += 2;
+        } else if (strcmp("--io", argv[idx]) == 0 && hasValue) {
+            if (!parse_batch_io(argv[idx + 1], options.Mirror.Batch.Io)) {
+                PrintWatchUsage();
+                return -1;
+            }
+            idx += 2;
+        } else {
+            break;
+        }
+    }
+    if (argc - idx != 2) {
+        PrintWatchUsage();
+        return -1;
+    }
+    const std::filesystem::path source(argv[idx]);
+    const std::filesystem::path target(argv[idx + 1]);
+
+    std::error_code ec;
+    if (!std::filesystem::is_directory(source, ec)) {
+        printf("input is not a directory\n");
+        return -1;
+    }
+
+    // writing the outputs would trigger events of their own
+    const auto canonicalSource = std::filesystem::weakly_canonical(source, ec);
+    const auto canonicalTarget = std::filesystem::weakly_canonical(target, ec);
+    const auto mismatch = std::mismatch(canonicalSource.begin(),
+                                        canonicalSource.end(),
+                                        canonicalTarget.begin(),
+                                        canonicalTarget.end());
+    if (!ec && mismatch.first == canonicalSource.end()) {
+        printf("output directory must not be inside the input directory\n");
+        return -1;
+    }
+
+    // Watch first, so nothing that changes during the initial sync is missed.
+    Watcher watcher(source, target, options);
+    if (!watcher.Open()) {
+        printf("failed to initialize inotify: %s\n", strerror(errno));
+        return -1;
+    }
+    watcher.AddTree(std::filesystem::path(), nullptr);
+
+    if (options.InitialSync) {
+        MirrorOptions mirror = options.Mirror;
+        mirror.SkipIfNewer = true;
+        run_mirror(source, target, mirror);
+    }
+
+    struct sigaction action {};
+    action.sa_handler = HandleStopSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    printf("watching %s\n", source.string().c_str());
+    fflush(stdout);
+
+    // leaving this scope finishes the queued files before returning
+    Compressor compressor(source, target, options);
+
+    // when each changed file is due, pushed back by every further event for it
+    std::map<std::filesystem::path, WatchClock::time_point> pending;
+    std::vector<std::filesystem::path> changed;
+    while (s_StopRequested == 0) {
+        int timeout = -1;
+        if (!pending.empty()) {
+            const auto next = std::min_element(
+                pending.begin(), pending.end(), [](const auto& lhs, const auto& rhs) {
+                    return lhs.second < rhs.second;
+                });
+            const int64_t wait = std::chrono::ceil<std::chrono::milliseconds>(
+                                     next->second - WatchClock::now())
+                                     .count();
+            timeout = static_cast<int>(std::max(int64_t(0), wait));
+        }
+
+        pollfd fd{watcher.GetFd(), POLLIN, 0};
+        if (poll(&fd, 1, timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("poll failed: %s\n", strerror(errno));
+            break;
+        }
+
+        changed.clear();
+        if ((fd.revents & POLLIN) != 0 && !watcher.ReadEvents(changed)) {
+            printf("too many changes at once, checking the whole input directory\n");
+            fflush(stdout);
+            FindOutdatedFiles(watcher, source, target, options, changed);
+        }
+        const auto now = WatchClock::now();
+        for (auto& file : changed) {
+            pending.insert_or_assign(std::move(file), now + options.Debounce);
+        }
+
+        std::vector<std::filesystem::path> due;
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (it->second <= now) {
+                due.push_back(it->first);
+                it = pending.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (!due.empty()) {
+            compressor.Enqueue(std::move(due));
+        }
+    }
+
+    // don't lose changes that were still waiting for their debounce to pass
+    std::vector<std::filesystem::path> remaining;
+    for (auto& entry : pending) {
+        remaining.push_back(entry.first);
+    }
+    compressor.Enqueue(std::move(remaining));
+    return 0;
+}
+#else
+int WatchMain(int /*argc*/, char** /*argv*/) {
+    printf("'topdec watch' is only supported on Linux.\n");
+    return -1;
+}
+#endif
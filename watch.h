@@ -0,0 +1,5 @@
+#pragma once
+
+// 'topdec watch': keeps a directory of compressed files in sync with a directory of uncompressed
+// ones. Changes are picked up with inotify, so this is only supported on Linux.
+int WatchMain(int argc, char** argv);